@@ -0,0 +1,468 @@
+#define _GNU_SOURCE
+#include "engine/engine.h"
+#include "engine/latency.h"
+#include "engine/socksink.h"
+#include "engine/utils.h"
+#include "scope/scope.h"
+#include "visa_loopback.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/wait.h>
+#include <time.h>
+#include <unistd.h>
+
+/*
+ * make bench: micro and end-to-end benchmarks against an in-memory VISA stand-in.
+ * Results are JSON lines ({"rev","bench","case","value","unit"}) written to argv[1]
+ * (default stdout) so runs can be diffed between commits. Environment:
+ *   BENCH_REV    revision tag stored in every line (Makefile passes git describe)
+ *   BENCH_TMPFS  directory on tmpfs for writer benchmarks (default /dev/shm, else /tmp)
+ *   BENCH_DISK   directory on a real disk (default .)
+ *   BENCH_QUICK  non-empty => ~10x smaller workloads (smoke test)
+ *   BENCH_SOCK_RECV  tools/sock_recv binary for the socket sink cases (Makefile passes it)
+ * Cases that also check the data (sock) make the exit status non-zero when they fail.
+ */
+
+static FILE       *g_out;
+static const char *g_rev;
+static unsigned    g_scale = 1; // workload divisor (BENCH_QUICK)
+static int         g_failed;    // a data check failed
+
+static void emit(const char *bench, const char *cas, double value, const char *unit) {
+    fprintf(g_out, "{\"rev\":\"%s\",\"bench\":\"%s\",\"case\":\"%s\",\"value\":%.6g,\"unit\":\"%s\"}\n",
+            g_rev, bench, cas, value, unit);
+    fflush(g_out);
+    fprintf(stderr, "[bench] %-14s %-28s %12.3f %s\n", bench, cas, value, unit);
+}
+
+static double now_s(void) {
+    return (double)latency_now_ns() / 1e9;
+}
+
+static void sleep_us(unsigned us) {
+    if (!us) return;
+    struct timespec ts = { (time_t)(us / 1000000u), (long)(us % 1000000u) * 1000L };
+    nanosleep(&ts, NULL);
+}
+
+// ===============================================================
+// ============= Software stand-in scope
+// ===============================================================
+
+#define BENCH_CHUNK_PTS 250000u
+
+typedef struct {
+    unsigned arm_us;      // emulated :SING round trip
+    unsigned trig_us;     // time from arm to trigger
+    uint64_t armed_at_us;
+} BenchScope;
+
+static int bench_init(Scope *s, RunConfig *cfg) {
+    if (scope_open(s) != 0) return -1;
+    if (cfg->raw_start_idx == 0) cfg->raw_start_idx = 1;
+    return (cfg->n_samples > 0) ? 0 : -2;
+}
+
+static void bench_destroy(Scope *s) {
+    scope_close(s);
+    free(s->instr_name);
+    free(s->priv);
+    free(s);
+}
+
+static int bench_arm(Scope *s) {
+    BenchScope *b = (BenchScope*)s->priv;
+    const uint64_t t0 = latency_now_ns();
+    sleep_us(b->arm_us);
+    b->armed_at_us = latency_now_us();
+    phase_stats_add(s->stats, PHASE_ARM, latency_now_ns() - t0);
+    return 0;
+}
+
+static int bench_stop(Scope *s) { (void)s; return 0; }
+
+static int bench_check_armed(Scope *s, bool *out) { (void)s; *out = true; return 0; }
+
+static int bench_check_triggered(Scope *s, bool *out) {
+    BenchScope *b = (BenchScope*)s->priv;
+    *out = latency_now_us() >= b->armed_at_us + b->trig_us;
+    return 0;
+}
+
+// Same request/readout pattern as ds1000ze_read_trace, served by the loopback
+static int bench_read_trace(Scope *s, uint8_t *dst, const RunConfig *cfg) {
+    const size_t bps = run_config_sample_bytes(cfg);
+    for (uint8_t ch = 0; ch < cfg->n_channels; ++ch) {
+        uint8_t *out = dst ? dst + (size_t)ch * cfg->n_samples * bps : NULL;
+        size_t start = cfg->raw_start_idx, remaining = cfg->n_samples;
+        while (remaining > 0) {
+            const size_t pts = (remaining > BENCH_CHUNK_PTS) ? BENCH_CHUNK_PTS : remaining;
+            const uint64_t t0 = latency_now_ns();
+            char cmd[96];
+            int n = snprintf(cmd, sizeof cmd, ":WAV:STARt %zu;:WAV:STOP %zu;:WAV:DATA?\n", start, start + pts - 1);
+            if (scope_write(s, cmd, (size_t)n) != 0) return -2;
+
+            const size_t need = pts * bps;
+            uint8_t *buf = out;
+            uint64_t t_slot = 0;
+            if (s->stream) {
+                const uint64_t tb = latency_now_ns();
+                buf = s->stream->get_buf(s->stream->ctx, need);
+                if (!buf) return -3;
+                t_slot = latency_now_ns() - tb;
+            }
+            size_t got = 0;
+            if (scope_read_defblock(s, buf, need, &got) != 0 || got != need) return -4;
+            phase_stats_add(s->stats, PHASE_READ_CHUNK, latency_now_ns() - t0 - t_slot);
+            if (s->stream) {
+                if (s->stream->commit(s->stream->ctx, buf, got) != 0) return -5;
+            } else {
+                out += got;
+            }
+            start += pts;
+            remaining -= pts;
+        }
+    }
+    return 0;
+}
+
+static int bench_dump_log(Scope *s, FILE *fp, const RunConfig *cfg) {
+    (void)s; (void)cfg;
+    fprintf(fp, "INSTR_NAME=\"LOOPBACK\"\n");
+    return 0;
+}
+
+static const ScopeDriver bench_driver = {
+    .init               = bench_init,
+    .destroy            = bench_destroy,
+    .arm                = bench_arm,
+    .stop               = bench_stop,
+    .force_trigger      = bench_stop,
+    .read_trace         = bench_read_trace,
+    .check_if_armed     = bench_check_armed,
+    .check_if_triggered = bench_check_triggered,
+    .dump_log           = bench_dump_log,
+};
+
+static Scope *bench_scope_new(unsigned arm_us, unsigned trig_us) {
+    Scope *s = calloc(1, sizeof *s);
+    BenchScope *b = calloc(1, sizeof *b);
+    if (!s || !b) { free(s); free(b); return NULL; }
+    b->arm_us  = arm_us;
+    b->trig_us = trig_us;
+    s->priv = b;
+    s->driver = &bench_driver;
+    s->instr_name = strdup("LOOPBACK::INSTR");
+    s->timeout_ms = 2000;
+    return s;
+}
+
+static LatencyModel g_arm_lat, g_trig_lat;
+
+static int bench_acquire(Scope *s, uint8_t *dst, const RunConfig *cfg) {
+    if (s->driver->arm(s) != 0) return -1;
+    int rc = engine_wait_armed(s, &g_arm_lat, 0);
+    if (rc != ACQ_OK) return rc;
+    rc = engine_wait_triggered(s, &g_trig_lat, 0);
+    if (rc != ACQ_OK) return rc;
+    return s->driver->read_trace(s, dst, cfg);
+}
+
+// ===============================================================
+// ============= Engine runs
+// ===============================================================
+
+typedef struct {
+    const char *dir;
+    size_t      n_samples;
+    uint8_t     n_channels;
+    size_t      n_traces;
+    size_t      batch;
+    bool        stream;
+    unsigned    arm_us, trig_us;
+    double      link_bytes_per_s;
+    const char *sock_addr;       // --sock
+    uint8_t     sock_mode;
+    bool        keep_bin;        // leave <dir>/scope_bench_<pid>.bin for the caller
+} EngineCase;
+
+// Runs engine_run() to completion; core keeps the phase histograms for the caller
+static int run_engine(const EngineCase *c, EngineCore *core, double *secs) {
+    static const char *chans[] = { "CHAN1", "CHAN2", "CHAN3", "CHAN4" };
+    RunConfig *cfg = calloc(1, sizeof *cfg);
+    if (!cfg) return -1;
+    memset(core, 0, sizeof *core);
+    core->cfg = cfg;
+
+    char base[512];
+    snprintf(base, sizeof base, "%s/scope_bench_%ld", c->dir, (long)getpid());
+    cfg->outfile        = strdup(base);
+    cfg->n_samples      = c->n_samples;
+    cfg->raw_start_idx  = 1;
+    cfg->n_traces       = c->n_traces;
+    cfg->n_flush_traces = c->batch;
+    cfg->n_frames       = 1;
+    cfg->stream         = c->stream;
+    cfg->sock_addr      = c->sock_addr ? strdup(c->sock_addr) : NULL;
+    cfg->sock_mode      = c->sock_mode;
+    for (uint8_t i = 0; i < c->n_channels && i < 4; ++i) (void)add_channel(cfg, chans[i]);
+
+    core->scope = bench_scope_new(c->arm_us, c->trig_us);
+    if (!cfg->outfile || !core->scope) return -2;
+    loopback_set_rate(c->link_bytes_per_s);
+    latency_model_init(&g_arm_lat);
+    latency_model_init(&g_trig_lat);
+
+    double t0 = now_s();
+    int rc = engine_run(core, bench_acquire, NULL, NULL);
+    *secs = now_s() - t0;
+    loopback_set_rate(0.0);
+
+    char path[600];
+    snprintf(path, sizeof path, "%s.bin", base);
+    if (!c->keep_bin) unlink(path);
+    snprintf(path, sizeof path, "%s.log", base);
+    unlink(path);
+    snprintf(path, sizeof path, "%s.ckpt", base);
+    unlink(path);
+    free(cfg);
+    return rc;
+}
+
+// ===============================================================
+// ============= Benchmarks
+// ===============================================================
+
+// Definite-length block parsing + copy out of the VISA layer
+static void bench_defblock(void) {
+    static const size_t sizes[] = { 1000, 15625, 62500, 250000 };
+    Scope s = {0};
+    s.instr_name = (char*)"LOOPBACK::INSTR";
+    s.timeout_ms = 2000;
+    if (scope_open(&s) != 0) return;
+
+    uint8_t *buf = malloc(2 * 250000);
+    if (!buf) { scope_close(&s); return; }
+    for (size_t k = 0; k < sizeof sizes / sizeof sizes[0]; ++k) {
+        const size_t pts = sizes[k];
+        const size_t iters = (size_t)(256u << 20) / g_scale / pts + 1;
+        char cmd[96], cas[48];
+        int n = snprintf(cmd, sizeof cmd, ":WAV:STARt 1;:WAV:STOP %zu;:WAV:DATA?\n", pts);
+
+        // A failed read ends the case without a result: a partial loop would inflate the rate
+        loopback_set_bytes_per_point(1);
+        size_t done = 0;
+        double t0 = now_s();
+        for (; done < iters; ++done) {
+            size_t got = 0;
+            (void)scope_write(&s, cmd, (size_t)n);
+            if (scope_read_defblock(&s, buf, pts, &got) != 0 || got != pts) break;
+        }
+        double dt = now_s() - t0;
+        snprintf(cas, sizeof cas, "byte_%zu_pts", pts);
+        if (done == iters) {
+            emit("defblock", cas, (double)(pts * done) / dt / 1e6, "MB/s");
+            emit("defblock", cas, dt / (double)done * 1e9, "ns/call");
+        } else {
+            fprintf(stderr, "[bench] defblock %s: read failed after %zu of %zu calls, no result\n", cas, done, iters);
+        }
+
+        loopback_set_bytes_per_point(2);
+        done = 0;
+        t0 = now_s();
+        for (; done < iters; ++done) {
+            size_t got = 0;
+            (void)scope_write(&s, cmd, (size_t)n);
+            if (scope_read_defblock_word(&s, buf, pts, &got) != 0 || got != pts) break;
+        }
+        dt = now_s() - t0;
+        snprintf(cas, sizeof cas, "word_packed_%zu_pts", pts);
+        if (done == iters) {
+            emit("defblock", cas, (double)(pts * done) / dt / 1e6, "Mpts/s");
+        } else {
+            fprintf(stderr, "[bench] defblock %s: read failed after %zu of %zu calls, no result\n", cas, done, iters);
+        }
+    }
+    loopback_set_bytes_per_point(1);
+    free(buf);
+    scope_close(&s);
+}
+
+// WORD -> BYTE narrowing kernel alone
+static void bench_narrow(void) {
+    const size_t pts = 1u << 20;
+    uint8_t *src = malloc(2 * pts), *dst = malloc(pts);
+    if (!src || !dst) { free(src); free(dst); return; }
+    for (size_t i = 0; i < 2 * pts; ++i) src[i] = (uint8_t)i;
+    const unsigned iters = 512u / g_scale + 1;
+    double t0 = now_s();
+    for (unsigned i = 0; i < iters; ++i) scope_narrow_word(dst, src, pts);
+    double dt = now_s() - t0;
+    emit("narrow_word", "1M_pts", (double)pts * iters / dt / 1e6, "Mpts/s");
+    free(src);
+    free(dst);
+}
+
+// Tiny traces, batch of 1: dominated by the producer/writer ping-pong
+static void bench_handoff(const char *tmpfs) {
+    EngineCore *core = malloc(sizeof *core);
+    if (!core) return;
+    EngineCase c = { .dir = tmpfs, .n_samples = 64, .n_channels = 1,
+                     .n_traces = 200000 / g_scale, .batch = 1 };
+    double dt = 0.0;
+    if (run_engine(&c, core, &dt) == 0 && dt > 0.0) {
+        emit("handoff", "batch1_64B", (double)c.n_traces / dt, "traces/s");
+        emit("handoff", "wait_p50", (double)phase_stats_quantile_ns(&core->phase_stats, PHASE_HANDOFF_WAIT, 0.5) / 1e3, "us");
+        emit("handoff", "wait_p99", (double)phase_stats_quantile_ns(&core->phase_stats, PHASE_HANDOFF_WAIT, 0.99) / 1e3, "us");
+    }
+    free(core);
+}
+
+// Big traces, zero acquisition latency: the writer thread is the bottleneck
+static void bench_writer(const char *label, const char *dir) {
+    EngineCore *core = malloc(sizeof *core);
+    if (!core) return;
+    EngineCase c = { .dir = dir, .n_samples = 1u << 20, .n_channels = 1,
+                     .n_traces = 512 / g_scale, .batch = 16 };
+    double dt = 0.0;
+    char cas[48];
+    if (run_engine(&c, core, &dt) == 0 && dt > 0.0) {
+        snprintf(cas, sizeof cas, "%s_batch", label);
+        emit("writer", cas, (double)(c.n_traces * c.n_samples) / dt / 1e6, "MB/s");
+        snprintf(cas, sizeof cas, "%s_write_p99", label);
+        emit("writer", cas, (double)phase_stats_quantile_ns(&core->phase_stats, PHASE_WRITE, 0.99) / 1e6, "ms");
+    }
+    c.stream = true;
+    if (run_engine(&c, core, &dt) == 0 && dt > 0.0) {
+        snprintf(cas, sizeof cas, "%s_stream", label);
+        emit("writer", cas, (double)(c.n_traces * c.n_samples) / dt / 1e6, "MB/s");
+    }
+    free(core);
+}
+
+// Realistic cycle: 200 us arm, 1 ms to trigger, 2 x 250 kpts over an 8 MB/s link
+static void bench_e2e(const char *dir) {
+    EngineCore *core = malloc(sizeof *core);
+    if (!core) return;
+    EngineCase c = { .dir = dir, .n_samples = 250000, .n_channels = 2,
+                     .n_traces = 100 / g_scale + 4, .batch = 10,
+                     .arm_us = 200, .trig_us = 1000, .link_bytes_per_s = 8e6 };
+    const double ideal = (c.arm_us + c.trig_us) / 1e6 + (double)(c.n_samples * c.n_channels) / c.link_bytes_per_s;
+    double dt = 0.0;
+    if (run_engine(&c, core, &dt) == 0 && dt > 0.0) {
+        emit("e2e", "batch_traces_per_s", (double)c.n_traces / dt, "traces/s");
+        emit("e2e", "batch_efficiency", ideal * (double)c.n_traces / dt, "ratio");
+    }
+    c.stream = true;
+    if (run_engine(&c, core, &dt) == 0 && dt > 0.0) {
+        emit("e2e", "stream_traces_per_s", (double)c.n_traces / dt, "traces/s");
+        emit("e2e", "stream_efficiency", ideal * (double)c.n_traces / dt, "ratio");
+    }
+    free(core);
+}
+
+static int files_equal(const char *a, const char *b) {
+    FILE *fa = fopen(a, "rb"), *fb = fopen(b, "rb");
+    int eq = (fa && fb);
+    static uint8_t ba[1u << 16], bb[1u << 16];
+    while (eq) {
+        const size_t na = fread(ba, 1, sizeof ba, fa), nb = fread(bb, 1, sizeof bb, fb);
+        if (na != nb || memcmp(ba, bb, na) != 0) eq = 0;
+        if (na < sizeof ba) break;
+    }
+    if (fa) fclose(fa);
+    if (fb) fclose(fb);
+    return eq;
+}
+
+// --sock to a forked tools/sock_recv --out in every send mode; the received payload must
+// match the .bin byte for byte. Splice runs over both socket kinds (TCP corks, Unix sockets
+// do not); zerocopy only pays off (and is only offered) on TCP. The 64 B frames show a
+// frame tail left corked (~200 ms each in sock_blocked_max).
+static void bench_sock(const char *dir) {
+    const char *recv_exe = getenv("BENCH_SOCK_RECV");
+    if (!recv_exe || access(recv_exe, X_OK) != 0) {
+        fprintf(stderr, "[bench] sock: BENCH_SOCK_RECV not set or not executable, skipped\n");
+        return;
+    }
+    static const struct { uint8_t mode; bool tcp; size_t n_samples, batch; } modes[] = {
+        { SOCKSINK_COPY,   false, 1u << 16, 16 }, { SOCKSINK_SPLICE,   false, 1u << 16, 16 },
+        { SOCKSINK_SPLICE, true,  1u << 16, 16 }, { SOCKSINK_ZEROCOPY, true,  1u << 16, 16 },
+        { SOCKSINK_SPLICE, true,  32,       1  },
+    };
+    EngineCore *core = malloc(sizeof *core);
+    if (!core) return;
+    for (size_t k = 0; k < sizeof modes / sizeof modes[0]; ++k) {
+        const char *name = socksink_mode_name(modes[k].mode);
+        char addr[256], bin[512], rx[512], cas[48];
+        if (modes[k].tcp) snprintf(addr, sizeof addr, "tcp:127.0.0.1:%d", 20000 + (int)(getpid() % 20000) + (int)k);
+        else              snprintf(addr, sizeof addr, "unix:%s/scope_bench_%ld.sock", dir, (long)getpid());
+        snprintf(bin, sizeof bin, "%s/scope_bench_%ld.bin", dir, (long)getpid());
+        snprintf(rx, sizeof rx, "%s/scope_bench_%ld.rx", dir, (long)getpid());
+
+        // The engine retries the connection, so the receiver need not be listening yet
+        pid_t pid = fork();
+        if (pid < 0) break;
+        if (pid == 0) {
+            execl(recv_exe, recv_exe, addr, "--out", rx, "--quiet", (char*)NULL);
+            _exit(127);
+        }
+        EngineCase c = { .dir = dir, .n_samples = modes[k].n_samples, .n_channels = 2,
+                         .n_traces = 2000 / g_scale, .batch = modes[k].batch,
+                         .sock_addr = addr, .sock_mode = modes[k].mode, .keep_bin = true };
+        double dt = 0.0;
+        const int rc = run_engine(&c, core, &dt);
+        int status = 0;
+        if (rc != 0) kill(pid, SIGTERM);
+        (void)waitpid(pid, &status, 0);
+
+        const bool ok = rc == 0 && WIFEXITED(status) && WEXITSTATUS(status) == 0 && files_equal(bin, rx);
+        if (ok && dt > 0.0) {
+            const size_t frame = c.batch * c.n_samples * c.n_channels;
+            snprintf(cas, sizeof cas, "%s_%s", modes[k].tcp ? "tcp" : "unix", name);
+            if (frame < 4096) {
+                snprintf(cas + strlen(cas), sizeof cas - strlen(cas), "_%zuB", frame);
+                emit("sock", cas, (double)c.n_traces / c.batch / dt, "frames/s");
+                snprintf(cas + strlen(cas), sizeof cas - strlen(cas), "_blocked_max");
+                emit("sock", cas, (double)core->sock.blocked_ns_max / 1e6, "ms");
+            } else {
+                emit("sock", cas, (double)(c.n_traces * frame / c.batch) / dt / 1e6, "MB/s");
+            }
+        } else {
+            fprintf(stderr, "[bench] sock %s: FAILED (engine rc=%d, receiver status=%d, payload %s)\n",
+                    name, rc, status, files_equal(bin, rx) ? "matches" : "differs from the .bin");
+            g_failed = 1;
+        }
+        unlink(bin);
+        unlink(rx);
+        if (!modes[k].tcp) unlink(addr + 5);
+    }
+    free(core);
+}
+
+int main(int argc, char **argv) {
+    g_out = stdout;
+    if (argc > 1 && !(g_out = fopen(argv[1], "w"))) {
+        perror(argv[1]);
+        return 1;
+    }
+    g_rev = getenv("BENCH_REV") ? getenv("BENCH_REV") : "unknown";
+    if (getenv("BENCH_QUICK") && getenv("BENCH_QUICK")[0]) g_scale = 10;
+
+    const char *tmpfs = getenv("BENCH_TMPFS");
+    if (!tmpfs) tmpfs = (access("/dev/shm", W_OK) == 0) ? "/dev/shm" : "/tmp";
+    const char *disk = getenv("BENCH_DISK") ? getenv("BENCH_DISK") : ".";
+
+    bench_defblock();
+    bench_narrow();
+    bench_handoff(tmpfs);
+    bench_writer("tmpfs", tmpfs);
+    bench_writer("disk", disk);
+    bench_e2e(tmpfs);
+    bench_sock(tmpfs);
+
+    if (g_out != stdout) fclose(g_out);
+    return g_failed;
+}
@@ -0,0 +1,126 @@
+#define _GNU_SOURCE
+#include "visa_loopback.h"
+
+#include <visa.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#define LB_PATTERN_BYTES 4096u
+
+/* Single-threaded by design: the benchmarks drive one session at a time */
+static char     lb_hdr[16];
+static size_t   lb_hdr_len, lb_hdr_off;
+static size_t   lb_payload_len, lb_payload_off;
+static int      lb_trailer;           /* pending '\n' after the block */
+static char     lb_text[64];          /* pending ASCII reply */
+static size_t   lb_text_len, lb_text_off;
+static unsigned lb_bps = 1;
+static double   lb_rate;              /* bytes/s, 0 => unthrottled */
+static uint64_t lb_served;
+static uint8_t  lb_pattern[LB_PATTERN_BYTES];
+
+void loopback_set_rate(double bytes_per_s) { lb_rate = bytes_per_s; }
+void loopback_set_bytes_per_point(unsigned bps) { lb_bps = bps ? bps : 1u; }
+uint64_t loopback_bytes_served(void) { return lb_served; }
+
+static void lb_throttle(size_t bytes) {
+    if (lb_rate <= 0.0 || bytes == 0) return;
+    double s = (double)bytes / lb_rate;
+    struct timespec ts = { (time_t)s, (long)((s - (double)(time_t)s) * 1e9) };
+    nanosleep(&ts, NULL);
+}
+
+ViStatus _VI_FUNC viOpenDefaultRM(ViPSession vi) { *vi = 1; return VI_SUCCESS; }
+
+ViStatus _VI_FUNC viOpen(ViSession sesn, ViConstRsrc name, ViAccessMode mode, ViUInt32 timeout, ViPSession vi) {
+    (void)sesn; (void)name; (void)mode; (void)timeout;
+    for (unsigned i = 0; i < LB_PATTERN_BYTES; ++i) lb_pattern[i] = (uint8_t)(i * 131u + 7u);
+    *vi = 2;
+    return VI_SUCCESS;
+}
+
+ViStatus _VI_FUNC viClose(ViObject vi) { (void)vi; return VI_SUCCESS; }
+ViStatus _VI_FUNC viSetAttribute(ViObject vi, ViAttr attrName, ViAttrState attrValue) {
+    (void)vi; (void)attrName; (void)attrValue;
+    return VI_SUCCESS;
+}
+
+ViStatus _VI_FUNC viWrite(ViSession vi, ViConstBuf buf, ViUInt32 cnt, ViPUInt32 retCnt) {
+    (void)vi;
+    char cmd[160];
+    size_t n = (cnt < sizeof cmd - 1) ? cnt : sizeof cmd - 1;
+    memcpy(cmd, buf, n);
+    cmd[n] = '\0';
+
+    if (strstr(cmd, ":DATA?")) {
+        const char *a = strstr(cmd, ":WAV:STAR");
+        const char *b = strstr(cmd, ":WAV:STOP");
+        size_t start = a ? strtoull(strchr(a, ' ') + 1, NULL, 10) : 1;
+        size_t stop  = b ? strtoull(strchr(b, ' ') + 1, NULL, 10) : start;
+        lb_payload_len = (stop >= start ? stop - start + 1 : 0) * lb_bps;
+        lb_payload_off = 0;
+        lb_hdr_len = (size_t)snprintf(lb_hdr, sizeof lb_hdr, "#9%09zu", lb_payload_len);
+        lb_hdr_off = 0;
+        lb_trailer = 1;
+    } else if (strstr(cmd, "*IDN?")) {
+        lb_text_len = (size_t)snprintf(lb_text, sizeof lb_text, "LOOPBACK,BENCH,0,0\n");
+        lb_text_off = 0;
+    }
+    if (retCnt) *retCnt = cnt;
+    return VI_SUCCESS;
+}
+
+ViStatus _VI_FUNC viRead(ViSession vi, ViPBuf buf, ViUInt32 cnt, ViPUInt32 retCnt) {
+    (void)vi;
+    size_t got = 0;
+    if (lb_text_off < lb_text_len) {
+        size_t k = lb_text_len - lb_text_off;
+        if (k > cnt) k = cnt;
+        memcpy(buf, lb_text + lb_text_off, k);
+        lb_text_off += k;
+        got = k;
+    } else if (lb_hdr_off < lb_hdr_len) {
+        size_t k = lb_hdr_len - lb_hdr_off;
+        if (k > cnt) k = cnt;
+        memcpy(buf, lb_hdr + lb_hdr_off, k);
+        lb_hdr_off += k;
+        got = k;
+    } else if (lb_payload_off < lb_payload_len) {
+        size_t k = lb_payload_len - lb_payload_off;
+        if (k > cnt) k = cnt;
+        for (size_t o = 0; o < k; ) {
+            size_t p = (lb_payload_off + o) % LB_PATTERN_BYTES;
+            size_t m = LB_PATTERN_BYTES - p;
+            if (m > k - o) m = k - o;
+            memcpy(buf + o, lb_pattern + p, m);
+            o += m;
+        }
+        lb_payload_off += k;
+        lb_throttle(k);
+        got = k;
+    } else if (lb_trailer) {
+        buf[0] = '\n';
+        lb_trailer = 0;
+        got = 1;
+    } else {
+        if (retCnt) *retCnt = 0;
+        return VI_ERROR_TMO;
+    }
+    lb_served += got;
+    if (retCnt) *retCnt = (ViUInt32)got;
+    return (got == cnt) ? VI_SUCCESS_MAX_CNT : VI_SUCCESS;
+}
+
+ViStatus _VI_FUNC viFlush(ViSession vi, ViUInt16 mask) { (void)vi; (void)mask; return VI_SUCCESS; }
+ViStatus _VI_FUNC viSetBuf(ViSession vi, ViUInt16 mask, ViUInt32 size) { (void)vi; (void)mask; (void)size; return VI_SUCCESS; }
+
+ViStatus _VI_FUNC viFindRsrc(ViSession sesn, ViConstString expr, ViPFindList vi, ViPUInt32 retCnt, ViChar _VI_FAR desc[]) {
+    (void)sesn; (void)expr;
+    *vi = 0;
+    *retCnt = 0;
+    desc[0] = '\0';
+    return VI_ERROR_RSRC_NFOUND;
+}
+ViStatus _VI_FUNC viFindNext(ViFindList vi, ViChar _VI_FAR desc[]) { (void)vi; desc[0] = '\0'; return VI_ERROR_RSRC_NFOUND; }
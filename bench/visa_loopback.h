@@ -0,0 +1,24 @@
+#ifndef VISA_LOOPBACK_H
+#define VISA_LOOPBACK_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* In-memory NI-VISA stand-in for benchmarks (linked instead of the real VISA library).
+   Every session is one fake instrument: ":WAV:STARt a;:WAV:STOP b;:WAV:DATA?" is
+   answered with a definite-length block of (b-a+1)*bytes_per_point bytes, "*IDN?"
+   with a fixed identity. Reads can be throttled to emulate the USB link. */
+
+void     loopback_set_rate(double bytes_per_s);      /* 0 => unthrottled */
+void     loopback_set_bytes_per_point(unsigned bps); /* 1 BYTE, 2 WORD */
+uint64_t loopback_bytes_served(void);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // VISA_LOOPBACK_H
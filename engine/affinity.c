@@ -0,0 +1,251 @@
+#define _GNU_SOURCE
+#include "affinity.h"
+
+#include <errno.h>
+#include <pthread.h>
+#include <sched.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+// Scheduling class to apply (pthread policies are not portable constants)
+enum { SCHED_KEEP = 0, SCHED_TO_OTHER, SCHED_TO_FIFO };
+
+// Mask of the acquisition thread before it was pinned: what the other roles fall back to
+static pthread_mutex_t g_base_mutex = PTHREAD_MUTEX_INITIALIZER;
+static CpuList         g_base;
+static bool            g_base_set;
+
+static void cl_set(CpuList *l, unsigned cpu) { l->bits[cpu / 64] |= (uint64_t)1 << (cpu % 64); }
+static bool cl_has(const CpuList *l, unsigned cpu) { return (l->bits[cpu / 64] >> (cpu % 64)) & 1u; }
+
+static void cl_or(CpuList *a, const CpuList *b) {
+    for (size_t i = 0; i < AFFINITY_MAX_CPUS / 64; ++i) a->bits[i] |= b->bits[i];
+}
+
+static void cl_andnot(CpuList *a, const CpuList *b) {
+    for (size_t i = 0; i < AFFINITY_MAX_CPUS / 64; ++i) a->bits[i] &= ~b->bits[i];
+}
+
+int cpulist_parse(const char *s, CpuList *out) {
+    if (!s || !out) return -1;
+    memset(out, 0, sizeof *out);
+    const char *p = s;
+    do {
+        char *end;
+        errno = 0;
+        unsigned long lo = strtoul(p, &end, 10), hi = lo;
+        if (end == p || errno) return -1;
+        if (*end == '-') {
+            p = end + 1;
+            hi = strtoul(p, &end, 10);
+            if (end == p || errno) return -1;
+        }
+        if (lo > hi || hi >= AFFINITY_MAX_CPUS) return -1;
+        for (unsigned long c = lo; c <= hi; ++c) cl_set(out, (unsigned)c);
+        if (*end != ',' && *end != '\0' && *end != '\n') return -1;
+        p = end + 1;
+        if (*end != ',') break;
+    } while (1);
+    return 0;
+}
+
+bool cpulist_empty(const CpuList *l) {
+    if (!l) return true;
+    for (size_t i = 0; i < AFFINITY_MAX_CPUS / 64; ++i) {
+        if (l->bits[i]) return false;
+    }
+    return true;
+}
+
+void cpulist_format(const CpuList *l, char *out, size_t cap) {
+    if (!out || cap == 0) return;
+    out[0] = '\0';
+    if (!l) return;
+    size_t len = 0;
+    for (unsigned c = 0; c < AFFINITY_MAX_CPUS; ++c) {
+        if (!cl_has(l, c)) continue;
+        unsigned e = c;
+        while (e + 1 < AFFINITY_MAX_CPUS && cl_has(l, e + 1)) ++e;
+        int n = (e == c) ? snprintf(out + len, cap - len, "%s%u", len ? "," : "", c)
+                         : snprintf(out + len, cap - len, "%s%u-%u", len ? "," : "", c, e);
+        if (n < 0 || (size_t)n >= cap - len) break; // truncated
+        len += (size_t)n;
+        c = e;
+    }
+}
+
+// CPUs sharing an L2 cache (else an SMT core) with any CPU of `in`, from sysfs
+static void cache_siblings(const CpuList *in, CpuList *out) {
+    memset(out, 0, sizeof *out);
+    for (unsigned c = 0; c < AFFINITY_MAX_CPUS; ++c) {
+        if (!cl_has(in, c)) continue;
+        cl_set(out, c);
+        char path[128], buf[512];
+        bool found = false;
+        for (int idx = 0; idx < 8 && !found; ++idx) {
+            snprintf(path, sizeof path, "/sys/devices/system/cpu/cpu%u/cache/index%d/level", c, idx);
+            FILE *fp = fopen(path, "r");
+            if (!fp) break;
+            bool l2 = (fgets(buf, sizeof buf, fp) && atoi(buf) == 2);
+            fclose(fp);
+            if (!l2) continue;
+            snprintf(path, sizeof path, "/sys/devices/system/cpu/cpu%u/cache/index%d/shared_cpu_list", c, idx);
+            found = true;
+        }
+        if (!found) snprintf(path, sizeof path, "/sys/devices/system/cpu/cpu%u/topology/thread_siblings_list", c);
+        FILE *fp = fopen(path, "r");
+        if (!fp) continue;
+        CpuList sib;
+        if (fgets(buf, sizeof buf, fp) && cpulist_parse(buf, &sib) == 0) cl_or(out, &sib);
+        fclose(fp);
+    }
+}
+
+static int get_cpus(CpuList *out) {
+    memset(out, 0, sizeof *out);
+#if defined(__linux__)
+    cpu_set_t set;
+    if (pthread_getaffinity_np(pthread_self(), sizeof set, &set) != 0) return -1;
+    for (unsigned c = 0; c < AFFINITY_MAX_CPUS && c < CPU_SETSIZE; ++c) {
+        if (CPU_ISSET(c, &set)) cl_set(out, c);
+    }
+    return 0;
+#else
+    return -1;
+#endif
+}
+
+static int set_cpus(const CpuList *l) {
+#if defined(__linux__)
+    cpu_set_t set;
+    CPU_ZERO(&set);
+    for (unsigned c = 0; c < AFFINITY_MAX_CPUS && c < CPU_SETSIZE; ++c) {
+        if (cl_has(l, c)) CPU_SET(c, &set);
+    }
+    return pthread_setaffinity_np(pthread_self(), sizeof set, &set);
+#else
+    (void)l;
+    return ENOSYS;
+#endif
+}
+
+// Target CPUs and scheduling class of role; cpus empty => leave the mask alone
+static void plan(const EngineSched *s, AffinityRole role, CpuList *cpus, int *sched) {
+    memset(cpus, 0, sizeof *cpus);
+    if (role == AFFINITY_ACQUIRE) {
+        *cpus  = s->acquire;
+        *sched = (s->rt_priority > 0) ? SCHED_TO_FIFO : SCHED_KEEP;
+        return;
+    }
+
+    // Threads created by a SCHED_FIFO acquisition thread inherit its class: set it explicitly
+    if (role == AFFINITY_WORKER) *sched = (s->rt_priority > 0) ? SCHED_TO_FIFO : SCHED_KEEP;
+    else                         *sched = (s->rt_priority > 0) ? SCHED_TO_OTHER : SCHED_KEEP;
+
+    const CpuList *own = (role == AFFINITY_WORKER) ? &s->workers : &s->writer;
+    if (!cpulist_empty(own)) { *cpus = *own; return; } // explicit lists are taken as given
+    if (cpulist_empty(&s->acquire)) return;
+
+    // Default: wherever the process may run, minus the acquisition CPU(s) (and their L2)
+    pthread_mutex_lock(&g_base_mutex);
+    bool have = g_base_set;
+    if (have) *cpus = g_base;
+    pthread_mutex_unlock(&g_base_mutex);
+    if (!have && get_cpus(cpus) != 0) return;
+
+    CpuList excl = s->acquire;
+    if (s->isolate) cache_siblings(&s->acquire, &excl);
+    CpuList rest = *cpus;
+    cl_andnot(&rest, &excl);
+    if (cpulist_empty(&rest)) {
+        cl_andnot(cpus, &s->acquire); // no CPU outside the cache domain: at least not the same core
+        if (cpulist_empty(cpus)) return;
+    } else {
+        *cpus = rest;
+    }
+}
+
+static void describe(const CpuList *cpus, int sched, int prio, char *desc, size_t cap) {
+    if (!desc || cap == 0) return;
+    char list[256];
+    cpulist_format(cpus, list, sizeof list);
+    char cls[32];
+    if      (sched == SCHED_TO_FIFO)  snprintf(cls, sizeof cls, "fifo:%d", prio);
+    else if (sched == SCHED_TO_OTHER) snprintf(cls, sizeof cls, "other");
+    else                              snprintf(cls, sizeof cls, "inherit");
+    snprintf(desc, cap, "cpus=%s sched=%s", list[0] ? list : "any", cls);
+}
+
+void affinity_describe(const EngineSched *sched, AffinityRole role, char *desc, size_t cap) {
+    if (!sched) { if (desc && cap) desc[0] = '\0'; return; }
+    CpuList cpus;
+    int cls;
+    plan(sched, role, &cpus, &cls);
+    describe(&cpus, cls, sched->rt_priority, desc, cap);
+}
+
+int affinity_apply(const EngineSched *sched, AffinityRole role, char *desc, size_t cap) {
+    if (desc && cap) desc[0] = '\0';
+    if (!sched) return -1;
+
+    if (role == AFFINITY_ACQUIRE) {
+        CpuList base;
+        if (get_cpus(&base) == 0) {
+            pthread_mutex_lock(&g_base_mutex);
+            g_base = base;
+            g_base_set = true;
+            pthread_mutex_unlock(&g_base_mutex);
+        }
+    }
+
+    CpuList cpus;
+    int cls;
+    plan(sched, role, &cpus, &cls);
+    if (cpulist_empty(&cpus) && cls == SCHED_KEEP) return -1;
+
+    static const char *const role_names[] = { "acquisition", "writer", "worker" };
+    int rc = 0;
+    if (!cpulist_empty(&cpus)) {
+        int err = set_cpus(&cpus);
+        if (err != 0) {
+            char list[256];
+            cpulist_format(&cpus, list, sizeof list);
+            fprintf(stderr, "[engine] affinity: cannot pin %s thread to CPUs %s: %s\n",
+                    role_names[role], list, strerror(err));
+            memset(&cpus, 0, sizeof cpus);
+            rc = -2;
+        }
+    }
+    if (cls != SCHED_KEEP) {
+        struct sched_param sp = { .sched_priority = (cls == SCHED_TO_FIFO) ? sched->rt_priority : 0 };
+        int err = pthread_setschedparam(pthread_self(), (cls == SCHED_TO_FIFO) ? SCHED_FIFO : SCHED_OTHER, &sp);
+        if (err != 0) {
+            fprintf(stderr, "[engine] affinity: SCHED_%s for the %s thread failed: %s%s\n",
+                    (cls == SCHED_TO_FIFO) ? "FIFO" : "OTHER", role_names[role], strerror(err),
+                    (err == EPERM) ? " (needs CAP_SYS_NICE or RLIMIT_RTPRIO)" : "");
+            cls = SCHED_KEEP;
+            rc = -2;
+        }
+    }
+    describe(&cpus, cls, sched->rt_priority, desc, cap);
+    return rc;
+}
+
+int affinity_save(ThreadSched *out) {
+    if (!out) return -1;
+    memset(out, 0, sizeof *out);
+    struct sched_param sp;
+    if (pthread_getschedparam(pthread_self(), &out->policy, &sp) != 0) return -1;
+    out->priority = sp.sched_priority;
+    (void)get_cpus(&out->cpus); // empty => mask not restorable here, leave it
+    out->valid = true;
+    return 0;
+}
+
+void affinity_restore(const ThreadSched *s) {
+    if (!s || !s->valid) return;
+    if (!cpulist_empty(&s->cpus)) (void)set_cpus(&s->cpus);
+    struct sched_param sp = { .sched_priority = s->priority };
+    (void)pthread_setschedparam(pthread_self(), s->policy, &sp);
+}
@@ -0,0 +1,67 @@
+#ifndef AFFINITY_H
+#define AFFINITY_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <stdbool.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#ifndef AFFINITY_MAX_CPUS
+#define AFFINITY_MAX_CPUS 1024
+#endif
+
+/* CPU set as parsed from a Linux cpulist ("2", "0-3,8"); portable, fixed size */
+typedef struct CpuList {
+    uint64_t bits[AFFINITY_MAX_CPUS / 64];
+} CpuList;
+
+/* Thread placement requested on the command line (RunConfig.sched).
+   Empty lists leave the thread where it is, unless the acquisition thread is pinned:
+   then every other engine thread is kept off its CPUs (and, with isolate, off the
+   CPUs sharing its L2 cache), so neither the writer's memcpy/write traffic nor its
+   scheduling lands next to the trigger poll. */
+typedef struct EngineSched {
+    CpuList acquire;      // --cpu-acquire
+    CpuList writer;       // --cpu-writer (also the phased prepare and metrics threads)
+    CpuList workers;      // --cpu-workers (multi-instrument worker threads)
+    int     rt_priority;  // --rt-priority: SCHED_FIFO for acquisition + workers (0 => off)
+    bool    isolate;      // --isolate-acquire
+} EngineSched;
+
+typedef enum {
+    AFFINITY_ACQUIRE = 0,
+    AFFINITY_WRITER,      // writer, prepare_next and metrics threads
+    AFFINITY_WORKER,
+} AffinityRole;
+
+/* Scheduling state of a thread, to put it back after a run */
+typedef struct ThreadSched {
+    CpuList cpus;
+    int     policy;
+    int     priority;
+    bool    valid;
+} ThreadSched;
+
+int  cpulist_parse(const char *s, CpuList *out);                // 0 ok, -1 malformed / out of range
+bool cpulist_empty(const CpuList *l);
+void cpulist_format(const CpuList *l, char *out, size_t cap);   // "0-3,8" ("" when empty)
+
+int  affinity_save(ThreadSched *out);                           // calling thread; 0 ok
+void affinity_restore(const ThreadSched *s);
+
+/* Apply the policy of role to the calling thread; desc (optional) gets what was
+   applied, e.g. "cpus=2 sched=fifo:50" or "cpus=0-1,4-7 sched=other".
+   0 ok, -1 nothing to do, -2 partially applied (warned on stderr) */
+int  affinity_apply(const EngineSched *sched, AffinityRole role, char *desc, size_t cap);
+
+/* What affinity_apply would do for role, without touching any thread (for the .log) */
+void affinity_describe(const EngineSched *sched, AffinityRole role, char *desc, size_t cap);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // AFFINITY_H
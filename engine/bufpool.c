@@ -0,0 +1,195 @@
+#define _GNU_SOURCE
+#include "bufpool.h"
+
+#include <errno.h>
+#include <pthread.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#if defined(__linux__)
+#include <sched.h>
+#include <sys/syscall.h>
+#endif
+
+#if defined(__linux__) && !defined(MPOL_BIND)
+#define MPOL_BIND 2
+#endif
+#ifndef BUFPOOL_HUGE_BYTES
+#define BUFPOOL_HUGE_BYTES ((size_t)2 << 20) // default x86-64/arm64 hugepage size
+#endif
+
+typedef struct {
+    uint8_t    *p;
+    size_t      len;       // mapped length
+    bool        in_use;
+    BufPoolOpts opts;      // what it was requested with (reuse needs the same)
+    BufPoolInfo info;      // what it actually got
+} BufRegion;
+
+static pthread_mutex_t g_pool_mutex = PTHREAD_MUTEX_INITIALIZER;
+static BufRegion       g_regions[BUFPOOL_MAX_REGIONS];
+
+static size_t round_up(size_t v, size_t a) {
+    return (v + a - 1) / a * a;
+}
+
+static bool same_opts(const BufPoolOpts *a, const BufPoolOpts *b) {
+    return a->hugetlb == b->hugetlb && a->lock == b->lock && a->numa == b->numa;
+}
+
+// NUMA node of the calling thread, -1 if unknown or the machine has a single node
+static int local_node(void) {
+#if defined(__linux__) && defined(SYS_getcpu)
+    if (access("/sys/devices/system/node/node1", F_OK) != 0) return -1;
+    unsigned cpu = 0, node = 0;
+    if (syscall(SYS_getcpu, &cpu, &node, NULL) != 0) return -1;
+    return (int)node;
+#else
+    return -1;
+#endif
+}
+
+static int bind_node(void *p, size_t len, int node) {
+#if defined(__linux__) && defined(SYS_mbind)
+    if (node < 0 || node >= 64) return -1;
+    unsigned long mask = 1ul << node;
+    return (syscall(SYS_mbind, p, len, MPOL_BIND, &mask, (unsigned long)(sizeof mask * 8), 0u) == 0) ? 0 : -1;
+#else
+    (void)p; (void)len; (void)node;
+    return -1;
+#endif
+}
+
+static int map_region(BufRegion *r, size_t bytes, const BufPoolOpts *o) {
+    const size_t page = (size_t)sysconf(_SC_PAGESIZE);
+    memset(&r->info, 0, sizeof r->info);
+    r->info.node = -1;
+    r->p = MAP_FAILED;
+
+#if defined(MAP_HUGETLB)
+    if (o->hugetlb) {
+        r->len = round_up(bytes, BUFPOOL_HUGE_BYTES);
+        r->p = mmap(NULL, r->len, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB, -1, 0);
+        r->info.hugetlb = (r->p != MAP_FAILED);
+    }
+#endif
+    if (r->p == MAP_FAILED) {
+        r->len = round_up(bytes, page);
+        r->p = mmap(NULL, r->len, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+        if (r->p == MAP_FAILED) { r->p = NULL; return -1; }
+#if defined(MADV_HUGEPAGE)
+        r->info.thp = (r->len >= BUFPOOL_HUGE_BYTES && madvise(r->p, r->len, MADV_HUGEPAGE) == 0);
+#endif
+    }
+
+    // Placement policy must be in place before the first touch
+    if (o->numa) {
+        int node = local_node();
+        if (node >= 0) {
+            if (bind_node(r->p, r->len, node) == 0) r->info.node = node;
+            else fprintf(stderr, "[engine] bufpool: mbind to node %d failed: %s\n", node, strerror(errno));
+        }
+    }
+
+    // Pre-fault: one write per page so the first trace does not pay for it
+    const size_t step = r->info.hugetlb ? BUFPOOL_HUGE_BYTES : page;
+    for (size_t off = 0; off < r->len; off += step) r->p[off] = 0;
+
+    if (o->lock) {
+        if (mlock(r->p, r->len) == 0) r->info.locked = true;
+        else fprintf(stderr, "[engine] bufpool: mlock of %.2f MiB failed: %s (raise RLIMIT_MEMLOCK)\n",
+                     r->len / 1048576.0, strerror(errno));
+    }
+    r->opts = *o;
+    return 0;
+}
+
+void *bufpool_get(size_t bytes, const BufPoolOpts *opts, BufPoolInfo *info) {
+    if (bytes == 0) return NULL;
+    const BufPoolOpts none = {0};
+    const BufPoolOpts *o = opts ? opts : &none;
+
+    pthread_mutex_lock(&g_pool_mutex);
+
+    // 1) Smallest free region that fits and was set up the same way
+    BufRegion *best = NULL;
+    for (int i = 0; i < BUFPOOL_MAX_REGIONS; ++i) {
+        BufRegion *r = &g_regions[i];
+        if (!r->p || r->in_use || r->len < bytes || !same_opts(&r->opts, o)) continue;
+        if (!best || r->len < best->len) best = r;
+    }
+    if (best) {
+        best->in_use = true;
+        best->info.reused = true;
+        if (info) *info = best->info;
+        pthread_mutex_unlock(&g_pool_mutex);
+        return best->p;
+    }
+
+    // 2) Free regions that cannot serve this request only pin memory: drop them first
+    for (int i = 0; i < BUFPOOL_MAX_REGIONS; ++i) {
+        BufRegion *r = &g_regions[i];
+        if (r->p && !r->in_use) {
+            munmap(r->p, r->len);
+            memset(r, 0, sizeof *r);
+        }
+    }
+
+    // 3) New mapping
+    BufRegion *slot = NULL;
+    for (int i = 0; i < BUFPOOL_MAX_REGIONS && !slot; ++i) {
+        if (!g_regions[i].p) slot = &g_regions[i];
+    }
+    void *p = NULL;
+    if (slot && map_region(slot, bytes, o) == 0) {
+        slot->in_use = true;
+        slot->info.reused = false;
+        if (info) *info = slot->info;
+        p = slot->p;
+    } else if (!slot) {
+        fprintf(stderr, "[engine] bufpool: all %d regions in use.\n", BUFPOOL_MAX_REGIONS);
+    }
+    pthread_mutex_unlock(&g_pool_mutex);
+    return p;
+}
+
+void bufpool_put(void *p) {
+    if (!p) return;
+    pthread_mutex_lock(&g_pool_mutex);
+    for (int i = 0; i < BUFPOOL_MAX_REGIONS; ++i) {
+        if (g_regions[i].p == p) {
+            g_regions[i].in_use = false;
+            break;
+        }
+    }
+    pthread_mutex_unlock(&g_pool_mutex);
+}
+
+void bufpool_trim(void) {
+    pthread_mutex_lock(&g_pool_mutex);
+    for (int i = 0; i < BUFPOOL_MAX_REGIONS; ++i) {
+        BufRegion *r = &g_regions[i];
+        if (r->p && !r->in_use) {
+            munmap(r->p, r->len);
+            memset(r, 0, sizeof *r);
+        }
+    }
+    pthread_mutex_unlock(&g_pool_mutex);
+}
+
+size_t bufpool_idle_bytes(void) {
+    size_t n = 0;
+    pthread_mutex_lock(&g_pool_mutex);
+    for (int i = 0; i < BUFPOOL_MAX_REGIONS; ++i) {
+        if (g_regions[i].p && !g_regions[i].in_use) n += g_regions[i].len;
+    }
+    pthread_mutex_unlock(&g_pool_mutex);
+    return n;
+}
+
+void bufpool_describe(const BufPoolInfo *info, char *out, size_t cap) {
+    if (!out || cap == 0) return;
+    if (!info) { out[0] = '\0'; return; }
+    snprintf(out, cap, "hugetlb=%d thp=%d mlock=%d numa_node=%d reused=%d",
+             (int)info->hugetlb, (int)info->thp, (int)info->locked, info->node, (int)info->reused);
+}
@@ -0,0 +1,56 @@
+#ifndef BUFPOOL_H
+#define BUFPOOL_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <stdio.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#ifndef BUFPOOL_MAX_REGIONS
+#define BUFPOOL_MAX_REGIONS 16      // mapped regions kept by the process-wide pool
+#endif
+
+/* Process-wide pool of large, page-aligned buffers for flush batches and stream chunks.
+   Regions are mmap'ed (MAP_HUGETLB on request, else transparent huge pages where
+   available), bound to the NUMA node of the calling thread, pre-faulted and optionally
+   mlock'ed, so no page fault or swap-in lands in the middle of an acquisition.
+   bufpool_put() keeps the region mapped: the next run in the same process reuses it. */
+typedef struct BufPoolOpts {
+    bool hugetlb;   // try MAP_HUGETLB first (needs reserved hugepages), fall back silently
+    bool lock;      // mlock the region (RLIMIT_MEMLOCK permitting; warns otherwise)
+    bool numa;      // bind to the NUMA node of the calling thread (Linux, >1 node)
+} BufPoolOpts;
+
+typedef struct BufPoolInfo {
+    bool hugetlb;   // backed by explicit hugepages
+    bool thp;       // MADV_HUGEPAGE applied
+    bool locked;
+    bool reused;    // came from the pool, no new mapping
+    int  node;      // bound NUMA node, -1 => not bound
+} BufPoolInfo;
+
+/* >= bytes, page-aligned, pre-faulted; NULL on failure. info (optional) describes the region */
+void *bufpool_get(size_t bytes, const BufPoolOpts *opts, BufPoolInfo *info);
+
+/* Return a region to the pool (NULL => no-op). It stays mapped for reuse */
+void  bufpool_put(void *p);
+
+/* Unmap every region that is not in use */
+void  bufpool_trim(void);
+
+/* Bytes mapped by regions not in use: the next bufpool_get() calls reuse them or unmap them
+   before mapping anything new, so they are memory the next run has, not memory it needs */
+size_t bufpool_idle_bytes(void);
+
+/* "hugetlb=0 thp=1 mlock=1 numa_node=0 reused=0" */
+void  bufpool_describe(const BufPoolInfo *info, char *out, size_t cap);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // BUFPOOL_H
@@ -1,5 +1,7 @@
 #define _GNU_SOURCE
 #include "engine.h"
+#include "latency.h"
+#include "trace.h"
 #include "utils.h"
 
 #include <stdlib.h>
@@ -14,33 +16,100 @@
 #include <fcntl.h>
 #include <getopt.h>
 #include <ctype.h>
+#include <math.h>
 
 
-static volatile sig_atomic_t g_stop = 0;
+// Process-wide stop (SIGINT, engine_request_stop) on top of each engine's own flag,
+// so several EngineCore instances can run side by side in one process.
+static volatile sig_atomic_t g_stop_all = 0;
 
-void engine_request_stop(void) { g_stop = 1; }
+void engine_request_stop(void) { g_stop_all = 1; }
+
+void engine_request_core_stop(EngineCore *core) { if (core) core->stop = 1; }
+
+static inline bool stopping(const EngineCore *core) { return g_stop_all || core->stop; }
 
 static void on_sigint(int signo) {
     (void)signo; // silence unused param warning
-    g_stop = 1;
+    g_stop_all = 1;
 }
 
 // Minimal usage text (keep in sync with options below)
 static const char usage[] =
     "Usage: acquire [options]\n"
     "  -o, --out <base>          Base output filename (omit to disable file writing)\n"
-    "  -i, --instrument <visa>   VISA resource string\n"
+    "      --resume <base>       Continue an interrupted run: append to <base>.bin after its checkpoint\n"
+    "  -i, --instrument <visa>   VISA resource string (repeat to drive several scopes)\n"
     "  -n, --ntraces <N>         Number of traces to capture (0 = unlimited)\n"
-    "  -b, --batch <N>           Traces per flush batch (>=1)\n"
-    "  -w, --coding <0|1>        0=BYTE, 1=WORD\n"
+    "  -b, --batch <N|auto>      Traces per flush batch (>=1; omit to size from available memory;\n"
+    "                            auto: adapt to the measured acquisition rate and writer bandwidth)\n"
+    "  -w, --coding <0|1>        0=BYTE, 1=WORD (WORD is stored packed, 1 byte/sample)\n"
+    "      --keep-high-byte      WORD: store both bytes per sample (2 bytes/sample)\n"
+    "      --metrics-file <path> Publish live metrics as a Prometheus text file (atomically replaced)\n"
+    "      --metrics-socket <path> Push live metrics snapshots to clients of a Unix socket\n"
+    "      --metrics-interval <ms> Metrics publishing interval (default 1000)\n"
+    "      --trace <file.json>   Record a per-thread timeline, written as Chrome trace-event JSON at exit\n"
     "  -s, --nsamples <N>        Samples per trace per channel (0=auto-detect)\n"
+    "  -k, --frames <K>          Frames captured per arm cycle (waveform record, default 1)\n"
     "  -c, --chan <NAME>         Add a single channel (repeatable)\n"
     "      --channels <LIST>     Comma-separated channel list\n"
+    "      --stream              Write each readout chunk as it arrives (no flush batches)\n"
+    "      --writeback <mode>    kernel (default) | throttle (sync_file_range per write) | dsync (fdatasync per write)\n"
+    "      --sync-interval <ms>  fdatasync + checkpoint period (default 5000)\n"
+    "      --drop-cache          Evict written ranges from the page cache once they are on disk\n"
+    "      --hugepages           Back batch buffers with explicit hugepages (MAP_HUGETLB) if reserved\n"
+    "      --mlock               Lock batch buffers in RAM\n"
+    "      --shm <name>          Publish batches to shared memory /dev/shm/<name> for live readers\n"
+    "      --shm-size <MiB>      Shared-memory ring size (default 64)\n"
+    "      --sock <addr>         Stream batches to a receiver: unix:/path or tcp:host:port\n"
+    "      --sock-mode <mode>    auto (default) | splice (vmsplice+splice) | zerocopy (MSG_ZEROCOPY, TCP) | copy\n"
+    "      --stats               Accumulate per-sample mean/std over the run into <base>.stats\n"
+    "      --null-sink           Add a sink that discards every batch (fan-out overhead baseline)\n"
+    "      --sink-policy <list>  Per sink, what a slow one does: kind=block|drop|spill,... (kinds shm, sock,\n"
+    "                            stats, null; default block; the .bin is always block)\n"
+    "      --cpu-acquire <list>  Pin the acquisition thread (e.g. 3); other threads then avoid it\n"
+    "      --cpu-writer <list>   Pin the writer, prepare and metrics threads (e.g. 0-1)\n"
+    "      --cpu-workers <list>  Pin the per-instrument worker threads (several -i)\n"
+    "      --rt-priority <1-99>  Run acquisition (and workers) as SCHED_FIFO with this priority\n"
+    "      --isolate-acquire     Also keep other threads off CPUs sharing the acquisition L2 cache\n"
     "      --diagnose            Run connectivity/capability checks and exit\n"
     "  -v, --verbose             Verbose logging\n"
     "  -h, --help                Show this help\n";
 
 
+// --sink-policy shm=drop,sock=spill
+static int parse_sink_policies(RunConfig *cfg, const char *list) {
+    static const char *const kinds[ENGINE_SINK_KINDS] = { "file", "shm", "sock", "stats", "null" };
+    char *dup = strdup(list);
+    if (!dup) return -1;
+    int rc = 0;
+    char *save = NULL;
+    for (char *tok = strtok_r(dup, ",", &save); tok && rc == 0; tok = strtok_r(NULL, ",", &save)) {
+        char *eq = strchr(tok, '=');
+        int kind = -1;
+        if (eq) {
+            *eq = '\0';
+            for (int k = 0; k < ENGINE_SINK_KINDS; ++k) {
+                if (strcmp(tok, kinds[k]) == 0) kind = k;
+            }
+        }
+        const char *p = eq ? eq + 1 : "";
+        const int policy = (strcmp(p, "block") == 0) ? SINK_BLOCK : (strcmp(p, "drop") == 0) ? SINK_DROP
+                         : (strcmp(p, "spill") == 0) ? SINK_SPILL : -1;
+        if (kind < 0 || policy < 0) {
+            fprintf(stderr, "[engine] bad --sink-policy entry '%s' (e.g. shm=drop,sock=spill).\n", tok);
+            rc = -1;
+        } else if (kind == ENGINE_SINK_FILE && policy != SINK_BLOCK) {
+            fprintf(stderr, "[engine] the .bin must see every trace: file=block only.\n");
+            rc = -1;
+        } else {
+            cfg->sink_policy[kind] = (uint8_t)policy;
+        }
+    }
+    free(dup);
+    return rc;
+}
+
 int engine_parse_cli_args(int argc, char **argv, EngineCore *engine) {
     if (!engine || !engine->cfg) return -1;
     memset(engine->cfg, 0, sizeof(*engine->cfg));
@@ -52,18 +121,45 @@ int engine_parse_cli_args(int argc, char **argv, EngineCore *engine) {
         {"batch",       required_argument, 0, 'b'},
         {"coding",      required_argument, 0, 'w'},
         {"nsamples",    required_argument, 0, 's'},
+        {"frames",      required_argument, 0, 'k'},
         {"chan",        required_argument, 0, 'c'},
         {"channels",    required_argument, 0, 1000},
         {"diagnose",    no_argument,       0, 1001},
+        {"stream",      no_argument,       0, 1002},
+        {"keep-high-byte", no_argument,    0, 1003},
+        {"metrics-file",     required_argument, 0, 1004},
+        {"metrics-socket",   required_argument, 0, 1005},
+        {"metrics-interval", required_argument, 0, 1006},
+        {"trace",            required_argument, 0, 1007},
+        {"resume",           required_argument, 0, 1008},
+        {"writeback",        required_argument, 0, 1009},
+        {"sync-interval",    required_argument, 0, 1010},
+        {"drop-cache",       no_argument,       0, 1011},
+        {"hugepages",        no_argument,       0, 1012},
+        {"mlock",            no_argument,       0, 1013},
+        {"cpu-acquire",      required_argument, 0, 1014},
+        {"cpu-writer",       required_argument, 0, 1015},
+        {"cpu-workers",      required_argument, 0, 1016},
+        {"rt-priority",      required_argument, 0, 1017},
+        {"isolate-acquire",  no_argument,       0, 1018},
+        {"shm",              required_argument, 0, 1019},
+        {"shm-size",         required_argument, 0, 1020},
+        {"sock",             required_argument, 0, 1021},
+        {"sock-mode",        required_argument, 0, 1022},
+        {"sink-policy",      required_argument, 0, 1023},
+        {"stats",            no_argument,       0, 1024},
+        {"null-sink",        no_argument,       0, 1025},
         {"verbose",     no_argument,       0, 'v'},
         {"help",        no_argument,       0, 'h'},
         {0,0,0,0}
     };
 
     int opt, idx = 0;
-    while ((opt = getopt_long(argc, argv, "o:i:n:b:w:c:vh", longopts, &idx)) != -1) {
+    while ((opt = getopt_long(argc, argv, "o:i:n:b:w:s:k:c:vh", longopts, &idx)) != -1) {
         switch (opt) {
             case 'o': {
+                free(engine->cfg->outfile);
+                engine->cfg->resume  = false;
                 engine->cfg->outfile = make_timestamped_filename(optarg);
                 if (!engine->cfg->outfile) {
                     fprintf(stderr, "[engine] failed to allocate outfile string.\n");
@@ -71,8 +167,14 @@ int engine_parse_cli_args(int argc, char **argv, EngineCore *engine) {
                 }
             } break;
             case 'i': {
-                engine->cfg->instr_name = strdup(optarg);
-                if (!engine->cfg->instr_name) return -1;
+                if (engine->cfg->n_instr >= ENGINE_MAX_INSTRUMENTS) {
+                    fprintf(stderr, "[engine] at most %d instruments.\n", ENGINE_MAX_INSTRUMENTS);
+                    return -1;
+                }
+                char *name = strdup(optarg);
+                if (!name) return -1;
+                engine->cfg->instr_names[engine->cfg->n_instr++] = name;
+                if (!engine->cfg->instr_name) engine->cfg->instr_name = name;
             } break;
             case 'n':
                 engine->cfg->n_traces = strtoull(optarg, NULL, 10);
@@ -82,7 +184,11 @@ int engine_parse_cli_args(int argc, char **argv, EngineCore *engine) {
                 engine->cfg->raw_start_idx = 1; 
                 break;
             case 'b':
-                engine->cfg->n_flush_traces = strtoull(optarg, NULL, 10);
+                engine->cfg->adaptive_batch = (strcmp(optarg, "auto") == 0);
+                engine->cfg->n_flush_traces = engine->cfg->adaptive_batch ? 0 : strtoull(optarg, NULL, 10);
+                break;
+            case 'k':
+                engine->cfg->n_frames = strtoull(optarg, NULL, 10);
                 break;
             case 'w': {
                 unsigned long t = strtoul(optarg, NULL, 10);
@@ -98,6 +204,109 @@ int engine_parse_cli_args(int argc, char **argv, EngineCore *engine) {
             case 1001: // --diagnose
                 engine->cfg->diagnose = true;
                 break;
+            case 1002: // --stream
+                engine->cfg->stream = true;
+                break;
+            case 1003: // --keep-high-byte
+                engine->cfg->keep_high_byte = true;
+                break;
+            case 1004: // --metrics-file
+                free(engine->cfg->metrics_file);
+                engine->cfg->metrics_file = strdup(optarg);
+                if (!engine->cfg->metrics_file) return -1;
+                break;
+            case 1005: // --metrics-socket
+                free(engine->cfg->metrics_socket);
+                engine->cfg->metrics_socket = strdup(optarg);
+                if (!engine->cfg->metrics_socket) return -1;
+                break;
+            case 1006: // --metrics-interval
+                engine->cfg->metrics_interval_ms = (unsigned)strtoul(optarg, NULL, 10);
+                break;
+            case 1007: // --trace
+                free(engine->cfg->trace_file);
+                engine->cfg->trace_file = strdup(optarg);
+                if (!engine->cfg->trace_file) return -1;
+                break;
+            case 1008: { // --resume (exact base of the earlier run; a trailing .bin is accepted)
+                free(engine->cfg->outfile);
+                size_t len = strlen(optarg);
+                if (len > 4 && strcmp(optarg + len - 4, ".bin") == 0) len -= 4;
+                engine->cfg->outfile = strndup(optarg, len);
+                if (!engine->cfg->outfile) return -1;
+                engine->cfg->resume = true;
+            } break;
+            case 1009: // --writeback
+                if      (strcmp(optarg, "kernel") == 0)   engine->cfg->writeback = WRITEBACK_KERNEL;
+                else if (strcmp(optarg, "throttle") == 0) engine->cfg->writeback = WRITEBACK_THROTTLE;
+                else if (strcmp(optarg, "dsync") == 0)    engine->cfg->writeback = WRITEBACK_DSYNC;
+                else { fputs(usage, stderr); return -1; }
+#if !defined(__linux__)
+                if (engine->cfg->writeback == WRITEBACK_THROTTLE) {
+                    fprintf(stderr, "[engine] --writeback throttle needs sync_file_range (Linux); using dsync.\n");
+                    engine->cfg->writeback = WRITEBACK_DSYNC;
+                }
+#endif
+                break;
+            case 1010: // --sync-interval
+                engine->cfg->sync_interval_ms = (unsigned)strtoul(optarg, NULL, 10);
+                break;
+            case 1011: // --drop-cache
+                engine->cfg->drop_cache = true;
+                break;
+            case 1012: // --hugepages
+                engine->cfg->hugepages = true;
+                break;
+            case 1013: // --mlock
+                engine->cfg->mlock_buffers = true;
+                break;
+            case 1014: // --cpu-acquire
+            case 1015: // --cpu-writer
+            case 1016: { // --cpu-workers
+                CpuList *l = (opt == 1014) ? &engine->cfg->sched.acquire
+                           : (opt == 1015) ? &engine->cfg->sched.writer : &engine->cfg->sched.workers;
+                if (cpulist_parse(optarg, l) != 0) {
+                    fprintf(stderr, "[engine] bad CPU list '%s' (e.g. 3 or 0-1,4).\n", optarg);
+                    return -1;
+                }
+            } break;
+            case 1017: { // --rt-priority
+                long p = strtol(optarg, NULL, 10);
+                if (p < 0 || p > 99) { fputs(usage, stderr); return -1; }
+                engine->cfg->sched.rt_priority = (int)p;
+            } break;
+            case 1018: // --isolate-acquire
+                engine->cfg->sched.isolate = true;
+                break;
+            case 1019: // --shm
+                free(engine->cfg->shm_name);
+                engine->cfg->shm_name = strdup(optarg);
+                if (!engine->cfg->shm_name) return -1;
+                break;
+            case 1020: // --shm-size
+                engine->cfg->shm_bytes = (size_t)strtoull(optarg, NULL, 10) << 20;
+                break;
+            case 1021: // --sock
+                free(engine->cfg->sock_addr);
+                engine->cfg->sock_addr = strdup(optarg);
+                if (!engine->cfg->sock_addr) return -1;
+                break;
+            case 1022: // --sock-mode
+                if      (strcmp(optarg, "auto") == 0)     engine->cfg->sock_mode = SOCKSINK_AUTO;
+                else if (strcmp(optarg, "splice") == 0)   engine->cfg->sock_mode = SOCKSINK_SPLICE;
+                else if (strcmp(optarg, "zerocopy") == 0) engine->cfg->sock_mode = SOCKSINK_ZEROCOPY;
+                else if (strcmp(optarg, "copy") == 0)     engine->cfg->sock_mode = SOCKSINK_COPY;
+                else { fputs(usage, stderr); return -1; }
+                break;
+            case 1023: // --sink-policy
+                if (parse_sink_policies(engine->cfg, optarg) != 0) return -1;
+                break;
+            case 1024: // --stats
+                engine->cfg->stats_sink = true;
+                break;
+            case 1025: // --null-sink
+                engine->cfg->null_sink = true;
+                break;
             case 'v':
                 engine->cfg->verbose = true;
                 break;
@@ -123,15 +332,29 @@ int engine_parse_cli_args(int argc, char **argv, EngineCore *engine) {
     // }
 
 
-    if (engine->cfg->n_flush_traces <= 0) 
-        engine->cfg->n_flush_traces = 1; // avoid deadlock logic with 0
+    if ((engine->cfg->shm_name || engine->cfg->sock_addr || engine->cfg->stats_sink || engine->cfg->null_sink) &&
+        engine->cfg->stream) {
+        fprintf(stderr, "[engine] --shm/--sock/--stats/--null-sink take whole batches; they cannot be combined with --stream.\n");
+        return -1;
+    }
+
+    // n_flush_traces == 0 (no --batch) is resolved against the memory budget in engine_run
+    if (engine->cfg->n_frames == 0)
+        engine->cfg->n_frames = 1;
+    if (engine->cfg->n_flush_traces % engine->cfg->n_frames != 0) {
+        // keep whole arm cycles per batch: round up to a multiple of n_frames
+        size_t k = engine->cfg->n_frames;
+        engine->cfg->n_flush_traces = ((engine->cfg->n_flush_traces + k - 1) / k) * k;
+        fprintf(stderr, "[engine] --batch rounded up to %zu (multiple of --frames %zu).\n",
+                engine->cfg->n_flush_traces, k);
+    }
     if (engine->cfg->n_channels == 0 && (!engine->cfg->channels || !engine->cfg->channels[0])) {
         add_channel(engine->cfg, "CHAN1"); // default in case none is active on the scope.
     }
 
     // Enforce memory/limits
     int rc = 0;
-    if (!engine->cfg->diagnose && engine->cfg->n_samples > 0) {
+    if (!engine->cfg->diagnose && !engine->cfg->stream && engine->cfg->n_samples > 0 && engine->cfg->n_flush_traces > 0) {
         rc = enforce_flush_limit(engine->cfg);
         if (rc != 0) return rc;
     }
@@ -139,57 +362,695 @@ int engine_parse_cli_args(int argc, char **argv, EngineCore *engine) {
     return 0;
 }
 
+// --drop-cache: evict [wb_dropped, upto) of the .bin; only call once that range is on disk
+static void writeback_drop(EngineCore *core, uint64_t upto) {
+    if (!core->cfg->drop_cache || upto <= core->wb_dropped) return;
+#if defined(POSIX_FADV_DONTNEED)
+    const uint64_t tt = trace_begin();
+    (void)posix_fadvise(core->fd_out, (off_t)core->wb_dropped, (off_t)(upto - core->wb_dropped), POSIX_FADV_DONTNEED);
+    trace_end("syscall", "fadvise_dontneed", tt, upto - core->wb_dropped);
+#endif
+    core->wb_dropped = upto;
+}
+
+// Apply --writeback to the len bytes just written at wb_pos, then advance wb_pos.
+// THROTTLE keeps at most ~two writes' worth of dirty pages: start writeback of this
+// range, wait for the previous one (which had a whole write period to complete).
+static void writeback_done(EngineCore *core, size_t len) {
+    const uint64_t pos = core->wb_pos;
+    core->wb_pos += len;
+    if (len == 0 || core->fd_out < 0) return;
+
+    const uint64_t tt = trace_begin();
+#if defined(__linux__)
+    if (core->cfg->writeback == WRITEBACK_THROTTLE) {
+        (void)sync_file_range(core->fd_out, (off_t)pos, (off_t)len, SYNC_FILE_RANGE_WRITE);
+        if (core->wb_prev_len) {
+            (void)sync_file_range(core->fd_out, (off_t)core->wb_prev_pos, (off_t)core->wb_prev_len,
+                                  SYNC_FILE_RANGE_WAIT_BEFORE | SYNC_FILE_RANGE_WRITE | SYNC_FILE_RANGE_WAIT_AFTER);
+            writeback_drop(core, core->wb_prev_pos + core->wb_prev_len);
+        }
+        trace_end("syscall", "sync_file_range", tt, len);
+        core->wb_prev_pos = pos;
+        core->wb_prev_len = len;
+        return;
+    }
+#endif
+    if (core->cfg->writeback != WRITEBACK_KERNEL) { // DSYNC (and THROTTLE without sync_file_range)
+        (void)file_sync_data(core->fd_out);
+        trace_end("syscall", "fdatasync", tt, len);
+        writeback_drop(core, core->wb_pos);
+    }
+}
+
+// Make the first `traces` traces of the .bin durable, then record them in <base>.ckpt
+static int engine_checkpoint(EngineCore *core, size_t traces) {
+    const RunConfig *cfg = core->cfg;
+    if (core->fd_out < 0) return 0; // nothing durable to record
+    RunCheckpoint ck = {0};
+    ck.traces_written   = traces;
+    ck.bytes_per_trace  = core->bytes_per_trace;
+    ck.n_samples        = cfg->n_samples;
+    ck.bytes_per_sample = run_config_sample_bytes(cfg);
+    run_config_channels(cfg, ck.channels, sizeof ck.channels);
+
+    const uint64_t tt = trace_begin();
+    int rc = file_sync_data(core->fd_out);
+    trace_end("syscall", "fdatasync", tt, 0);
+    if (rc == 0) writeback_drop(core, core->wb_pos);
+    if (rc == 0) rc = checkpoint_write(cfg->outfile, &ck);
+    if (rc != 0) fprintf(stderr, "[engine] checkpoint of %s failed (rc=%d).\n", cfg->outfile, rc);
+    core->checkpoint_last_us = latency_now_us();
+    return rc;
+}
+
+// Writer side: checkpoint at most every --sync-interval
+static void engine_checkpoint_due(EngineCore *core, size_t traces) {
+    const unsigned ms = core->cfg->sync_interval_ms ? core->cfg->sync_interval_ms : ENGINE_CHECKPOINT_INTERVAL_MS;
+    if (latency_now_us() - core->checkpoint_last_us < (uint64_t)ms * 1000u) return;
+    (void)engine_checkpoint(core, traces);
+}
+
+// --resume: open <base>.bin for appending, cut it back to the checkpointed trace count
+// (drops a partial tail and anything not yet known durable). Returns fd or <0.
+static int open_resumed_out_file(EngineCore *core) {
+    const RunConfig *cfg = core->cfg;
+    char *path = NULL;
+    if (asprintf(&path, "%s.bin", cfg->outfile) < 0) return -1;
+    int fd = open(path, O_CREAT | O_WRONLY, 0644);
+    if (fd < 0) {
+        fprintf(stderr, "[engine] Failed to open '%s': %s\n", path, strerror(errno));
+        free(path);
+        return -1;
+    }
+    struct stat st;
+    if (fstat(fd, &st) != 0) { close(fd); free(path); return -1; }
+    const size_t on_disk = (size_t)st.st_size / core->bytes_per_trace;
+
+    RunCheckpoint ck;
+    int crc = checkpoint_read(cfg->outfile, &ck);
+    if (crc != 0) {
+        if (st.st_size != 0) {
+            fprintf(stderr, "[engine] --resume: %s has data but no usable %s.ckpt; refusing to append.\n",
+                    path, cfg->outfile);
+            close(fd); free(path);
+            return -2;
+        }
+        ck.traces_written = 0; // nothing written yet: plain fresh start
+    } else {
+        char chbuf[256];
+        run_config_channels(cfg, chbuf, sizeof chbuf);
+        if (ck.bytes_per_trace != core->bytes_per_trace || ck.n_samples != cfg->n_samples ||
+            ck.bytes_per_sample != run_config_sample_bytes(cfg) || strcmp(ck.channels, chbuf) != 0) {
+            fprintf(stderr, "[engine] --resume: trace geometry changed (checkpoint: %zu samples x [%s] x %zu B, "
+                            "now: %zu samples x [%s] x %zu B).\n",
+                    ck.n_samples, ck.channels, ck.bytes_per_sample,
+                    cfg->n_samples, chbuf, run_config_sample_bytes(cfg));
+            close(fd); free(path);
+            return -3;
+        }
+        if (on_disk < ck.traces_written) {
+            fprintf(stderr, "[engine] --resume: %s holds %zu whole traces, checkpoint says %zu; continuing from %zu.\n",
+                    path, on_disk, ck.traces_written, on_disk);
+        }
+    }
+
+    const size_t keep = (ck.traces_written < on_disk) ? ck.traces_written : on_disk;
+    const off_t  keep_bytes = (off_t)keep * (off_t)core->bytes_per_trace;
+    if (ftruncate(fd, keep_bytes) != 0 || lseek(fd, keep_bytes, SEEK_SET) < 0) {
+        fprintf(stderr, "[engine] --resume: cannot truncate '%s': %s\n", path, strerror(errno));
+        close(fd); free(path);
+        return -4;
+    }
+    fprintf(stdout, "[engine] resuming %s at trace %zu (dropped %zu unsynced trace(s) and %lld tail byte(s)).\n",
+            path, keep, on_disk - keep, (long long)(st.st_size - (off_t)on_disk * (off_t)core->bytes_per_trace));
+    free(path);
+    core->resumed_traces = keep;
+    return fd;
+}
+
+// --- Batch sinks: each runs on its own fan-out thread (engine/sink.h) ---
+
+// <base>.bin: sees every batch, in order; also drives --writeback and checkpoints
+static int sink_file_write(void *ctx, const uint8_t *src, size_t traces, uint64_t first) {
+    EngineCore *engine = (EngineCore*)ctx;
+    const size_t bytes_to_write = traces * engine->bytes_per_trace;
+
+    uint64_t t0 = latency_now_ns();
+    const uint64_t tt = trace_begin();
+    size_t off = 0;
+    while (off < bytes_to_write) {
+        const uint64_t tw = trace_begin();
+        ssize_t w = write(engine->fd_out, src + off, bytes_to_write - off);
+        trace_end("syscall", "write", tw, (w > 0) ? (uint64_t)w : 0);
+        if (w < 0) {
+            if (errno == EINTR) continue;
+            fprintf(stderr,"[engine] writer_thread => write() failed\n");
+            engine->stop = 1;
+            break;
+        }
+        off += (size_t)w;
+    }
+    phase_stats_add(&engine->phase_stats, PHASE_WRITE, latency_now_ns() - t0);
+    trace_end("phase", phase_name(PHASE_WRITE), tt, off);
+    metrics_add(&engine->metrics.bytes_written, off);
+    writeback_done(engine, off);
+    if (off != bytes_to_write) return -1;
+
+    engine_checkpoint_due(engine, first + traces);
+    return 0;
+}
+
+// --shm: waits only for blocking readers, at most SHMRING_BLOCK_TIMEOUT_MS each before they
+// are demoted to lossy (lossy readers never hold the producer)
+static int sink_shm_write(void *ctx, const uint8_t *src, size_t traces, uint64_t first) {
+    EngineCore *engine = (EngineCore*)ctx;
+    const uint64_t tt = trace_begin();
+    (void)shmring_publish(&engine->shm, src, traces, first);
+    trace_end("engine", "shm_publish", tt, traces * engine->bytes_per_trace);
+    return 0;
+}
+
+// --sock: a receiver that went away only loses the stream; the run goes on
+static int sink_sock_write(void *ctx, const uint8_t *src, size_t traces, uint64_t first) {
+    EngineCore *engine = (EngineCore*)ctx;
+    const uint64_t tt = trace_begin();
+    int rc = socksink_send(&engine->sock, src, traces, engine->bytes_per_trace, first);
+    trace_end("engine", "sock_send", tt, traces * engine->bytes_per_trace);
+    return (rc == 0) ? 0 : -1;
+}
+
+// --stats: running sum and sum of squares per sample position (channel-major, as in the .bin)
+static int sink_stats_write(void *ctx, const uint8_t *src, size_t traces, uint64_t first) {
+    (void)first;
+    EngineCore *engine = (EngineCore*)ctx;
+    const size_t bps = run_config_sample_bytes(engine->cfg);
+    const size_t n   = engine->bytes_per_trace / bps;
+    double *sum = engine->stats_sum, *sq = engine->stats_sumsq;
+    const uint64_t tt = trace_begin();
+    for (size_t t = 0; t < traces; ++t) {
+        const uint8_t *p = src + t * engine->bytes_per_trace;
+        if (bps == 2) {
+            for (size_t i = 0; i < n; ++i) {
+                uint16_t v;
+                memcpy(&v, p + 2 * i, sizeof v);
+                const double x = (double)v;
+                sum[i] += x;
+                sq[i]  += x * x;
+            }
+        } else {
+            for (size_t i = 0; i < n; ++i) {
+                const double x = (double)p[i];
+                sum[i] += x;
+                sq[i]  += x * x;
+            }
+        }
+    }
+    engine->stats_traces += traces;
+    trace_end("engine", "stats", tt, traces * engine->bytes_per_trace);
+    return 0;
+}
+
+// --null-sink: takes its reference and gives it back
+static int sink_null_write(void *ctx, const uint8_t *src, size_t traces, uint64_t first) {
+    (void)ctx; (void)src; (void)traces; (void)first;
+    return 0;
+}
+
+// Fan-out hooks: sink threads run where the writer used to
+static void on_sink_thread(void *ctx, const char *name) {
+    EngineCore *engine = (EngineCore*)ctx;
+    trace_thread_name(name);
+    (void)affinity_apply(&engine->cfg->sched, AFFINITY_WRITER, NULL, 0);
+}
+
+// Every sink is done with a batch (fan-out mutex held)
+static void on_batch_retired(void *ctx, size_t traces) {
+    EngineCore *engine = (EngineCore*)ctx;
+    engine->total_traces_written += traces;
+    metrics_set(&engine->metrics.traces_written, engine->total_traces_written);
+    metrics_sub(&engine->metrics.writer_queue, 1);
+}
+
+static bool producer_stopping(void *ctx) { return stopping((const EngineCore*)ctx); }
+
+// <base>.stats: float64 mean[n] then std[n], n = channels x samples (host byte order)
+static void stats_finish(EngineCore *core) {
+    const RunConfig *cfg = core->cfg;
+    if (!core->stats_sum) return;
+    const size_t n = core->bytes_per_trace / run_config_sample_bytes(cfg);
+    const double k = (double)core->stats_traces;
+    for (size_t i = 0; i < n && k > 0; ++i) {
+        const double mean = core->stats_sum[i] / k;
+        const double var  = core->stats_sumsq[i] / k - mean * mean;
+        core->stats_sum[i]   = mean;
+        core->stats_sumsq[i] = (var > 0.0) ? sqrt(var) : 0.0;
+    }
+    if (cfg->outfile && core->stats_traces > 0) {
+        int fd = open_out_file(cfg->outfile, ".stats");
+        if (fd >= 0) {
+            if (write(fd, core->stats_sum, n * sizeof(double)) != (ssize_t)(n * sizeof(double)) ||
+                write(fd, core->stats_sumsq, n * sizeof(double)) != (ssize_t)(n * sizeof(double))) {
+                fprintf(stderr, "[engine] writing %s.stats failed.\n", cfg->outfile);
+            }
+            close(fd);
+        }
+    }
+    if (cfg->verbose && core->stats_traces > 0) {
+        fprintf(stdout, "[engine] stats over %llu traces: sample 0 mean %.3f std %.3f\n",
+                (unsigned long long)core->stats_traces, core->stats_sum[0], core->stats_sumsq[0]);
+    }
+    if (core->fp_log) fprintf(core->fp_log, "stats_traces=%llu\n", (unsigned long long)core->stats_traces);
+    free(core->stats_sum);   core->stats_sum   = NULL;
+    free(core->stats_sumsq); core->stats_sumsq = NULL;
+}
+
+// Batch mode: one fan-out sink per output; with none, filled buffers are simply recycled
+static int engine_sinks_start(EngineCore *core) {
+    const RunConfig *cfg = core->cfg;
+    if (sink_fanout_init(&core->fanout, core->batch_bufs, core->n_batch_bufs,
+                         core->bytes_per_buffer, core->bytes_per_trace) != 0) return -1;
+    core->fanout.thread_init = on_sink_thread;
+    core->fanout.retired     = on_batch_retired;
+    core->fanout.hook_ctx    = core;
+
+    // Spill backlogs live next to the .bin (the filesystem sized for the data), else in /tmp
+    char spill_dir[4096] = "";
+    if (cfg->outfile) {
+        snprintf(spill_dir, sizeof spill_dir, "%s", cfg->outfile);
+        char *slash = strrchr(spill_dir, '/');
+        if (!slash) snprintf(spill_dir, sizeof spill_dir, ".");
+        else slash[slash == spill_dir ? 1 : 0] = '\0';
+    }
+
+    core->stats_traces = 0;
+    if (cfg->stats_sink) {
+        const size_t n = core->bytes_per_trace / run_config_sample_bytes(cfg);
+        core->stats_sum   = calloc(n, sizeof(double));
+        core->stats_sumsq = calloc(n, sizeof(double));
+        if (!core->stats_sum || !core->stats_sumsq) return -2;
+    }
+
+    const uint8_t *pol = cfg->sink_policy;
+    int rc = 0;
+    if (rc >= 0 && core->fd_out >= 0) rc = sink_add(&core->fanout, "writer", sink_file_write, core, SINK_BLOCK, spill_dir);
+    if (rc >= 0 && core->shm.hdr)     rc = sink_add(&core->fanout, "shm", sink_shm_write, core, (SinkPolicy)pol[ENGINE_SINK_SHM], spill_dir);
+    if (rc >= 0 && core->sock.fd >= 0) rc = sink_add(&core->fanout, "sock", sink_sock_write, core, (SinkPolicy)pol[ENGINE_SINK_SOCK], spill_dir);
+    if (rc >= 0 && cfg->stats_sink)   rc = sink_add(&core->fanout, "stats", sink_stats_write, core, (SinkPolicy)pol[ENGINE_SINK_STATS], spill_dir);
+    if (rc >= 0 && cfg->null_sink)    rc = sink_add(&core->fanout, "null", sink_null_write, core, (SinkPolicy)pol[ENGINE_SINK_NULL], spill_dir);
+    if (rc < 0) return -3;
+    return (sink_fanout_start(&core->fanout) == 0) ? 0 : -4;
+}
+
+// "writer:block,shm:drop"
+static void sinks_describe(const SinkFanout *f, char *buf, size_t len) {
+    size_t off = 0;
+    buf[0] = '\0';
+    for (unsigned i = 0; i < f->n_sinks && off < len; ++i) {
+        int w = snprintf(buf + off, len - off, "%s%s:%s", i ? "," : "", f->sinks[i].name,
+                         sink_policy_name(f->sinks[i].policy));
+        if (w < 0) break;
+        off += (size_t)w;
+    }
+}
+
+// Per-sink delivery after sink_fanout_close (threads joined, counters final)
+static void sinks_report(EngineCore *core) {
+    const SinkFanout *f = &core->fanout;
+    for (unsigned i = 0; i < f->n_sinks; ++i) {
+        const Sink *s = &f->sinks[i];
+        if (core->fp_log) {
+            fprintf(core->fp_log, "sink_%s=policy=%s batches=%llu traces=%llu dropped_batches=%llu dropped_traces=%llu "
+                    "spilled_batches=%llu spilled_bytes=%llu busy_ms=%.3f busy_max_ms=%.3f queue_max=%u failed=%d\n",
+                    s->name, sink_policy_name(s->policy), (unsigned long long)s->batches,
+                    (unsigned long long)s->traces, (unsigned long long)s->dropped_batches,
+                    (unsigned long long)s->dropped_traces, (unsigned long long)s->spilled_batches,
+                    (unsigned long long)s->spilled_bytes, s->busy_ns / 1e6, s->busy_ns_max / 1e6,
+                    s->queue_max, s->gone ? 1 : 0);
+        }
+        if (core->cfg->verbose) {
+            fprintf(stdout, "[engine] sink %s (%s): %llu batches, %llu dropped, %llu spilled, busy %.3f ms (max %.3f ms)%s\n",
+                    s->name, sink_policy_name(s->policy), (unsigned long long)s->batches,
+                    (unsigned long long)s->dropped_batches, (unsigned long long)s->spilled_batches,
+                    s->busy_ns / 1e6, s->busy_ns_max / 1e6, s->gone ? ", failed" : "");
+        }
+    }
+    if (core->fp_log && f->n_sinks > 0) {
+        fprintf(core->fp_log, "sink_buffer_waits=%llu\n", (unsigned long long)f->acquire_waits);
+    }
+}
+
+static size_t batch_round(const EngineCore *core, size_t n) {
+    const size_t k = core->cfg->n_frames;
+    n -= n % k;
+    if (n < k) n = k;
+    return (n > core->cfg->n_flush_traces) ? core->cfg->n_flush_traces : n;
+}
+
+/*
+ * --batch auto, called by the producer at each handoff (next buffer in hand): grow on a
+ * stall, shrink towards the smallest size that keeps the block sinks (the writer) ahead.
+ */
+static void adapt_batch(EngineCore *core, bool stalled, uint64_t fill_ns) {
+    const size_t old = core->batch_traces;
+    pthread_mutex_lock(&core->fanout.mutex);
+    const uint64_t write_ns_last  = core->fanout.last_block_ns;
+    const size_t   handoff_traces = core->fanout.last_block_traces;
+    pthread_mutex_unlock(&core->fanout.mutex);
+
+    // Rates for the log: fill rate of this batch, bandwidth of the previous write
+    if (fill_ns) {
+        const double r = (double)old * 1e9 / (double)fill_ns;
+        core->acq_traces_per_s = core->acq_traces_per_s ? 0.75 * core->acq_traces_per_s + 0.25 * r : r;
+    }
+    if (write_ns_last && handoff_traces) {
+        const double bw = (double)(handoff_traces * core->bytes_per_trace) * 1e9 / (double)write_ns_last;
+        core->writer_bytes_per_s = core->writer_bytes_per_s ? 0.75 * core->writer_bytes_per_s + 0.25 * bw : bw;
+    }
+
+    if (stalled) {
+        // This size (and anything smaller) cannot hide the write: the floor rises geometrically,
+        // so the stall/shrink cycle ends after a few rounds
+        const size_t floor = batch_round(core, old + old / 2 + core->cfg->n_frames);
+        if (floor > core->batch_floor) core->batch_floor = floor;
+        core->batch_traces = batch_round(core, old * 2);
+        core->adapt_calm = 0;
+    } else if (write_ns_last && core->handoff_fill_ns &&
+               write_ns_last * 100u < core->handoff_fill_ns * ENGINE_ADAPT_BUSY_PCT &&
+               ++core->adapt_calm >= ENGINE_ADAPT_STEADY) {
+        // Writer idle most of the time: a smaller handoff cuts latency (the buffers stay full-size)
+        size_t next = batch_round(core, old - old / 4);
+        if (next < core->batch_floor) next = core->batch_floor;
+        core->batch_traces = next;
+        core->adapt_calm = 0;
+    }
+
+    if (core->batch_traces != old) {
+        core->batch_resizes++;
+        metrics_set(&core->metrics.batch_traces, core->batch_traces);
+        if (core->cfg->verbose) {
+            fprintf(stdout, "[engine] batch %zu -> %zu traces (%s; acq %.1f traces/s, writer %.1f MiB/s)\n",
+                    old, core->batch_traces, stalled ? "stall" : "writer idle",
+                    core->acq_traces_per_s, core->writer_bytes_per_s / 1048576.0);
+        }
+    }
+}
+
 /*
- * writer_thread stores a full batch of traces into persistent storage.
+ * Streaming mode: read_trace fills pool chunks in order; the writer drains them in order.
  */
-static void *writer_thread_func(void *arg) {
+static uint8_t *stream_get_buf(void *ctx, size_t len) {
+    EngineCore *engine = (EngineCore*)ctx;
+    if (len > ENGINE_STREAM_CHUNK_BYTES) return NULL;
+
+    pthread_mutex_lock(&engine->mutex);
+    if (engine->chunk_used == ENGINE_STREAM_CHUNKS) {
+        uint64_t t0 = latency_now_ns();
+        const uint64_t tt = trace_begin();
+        while (engine->chunk_used == ENGINE_STREAM_CHUNKS && !stopping(engine)) {
+            pthread_cond_wait(&engine->condvar_written, &engine->mutex);
+        }
+        phase_stats_add(&engine->phase_stats, PHASE_HANDOFF_WAIT, latency_now_ns() - t0);
+        trace_end("phase", phase_name(PHASE_HANDOFF_WAIT), tt, 0);
+    } else {
+        phase_stats_add(&engine->phase_stats, PHASE_HANDOFF_WAIT, 0);
+    }
+    uint8_t *buf = (engine->chunk_used == ENGINE_STREAM_CHUNKS) ? NULL
+                 : engine->chunk_pool[engine->chunk_head];
+    pthread_mutex_unlock(&engine->mutex);
+    return buf;
+}
+
+static int stream_commit(void *ctx, uint8_t *buf, size_t len) {
+    EngineCore *engine = (EngineCore*)ctx;
+    if (!engine->cfg->outfile) return 0; // no-store: chunk slot is simply reused
+
+    pthread_mutex_lock(&engine->mutex);
+    if (buf != engine->chunk_pool[engine->chunk_head]) {
+        pthread_mutex_unlock(&engine->mutex);
+        return -1;
+    }
+    engine->chunk_len[engine->chunk_head] = len;
+    engine->chunk_head = (uint8_t)((engine->chunk_head + 1) % ENGINE_STREAM_CHUNKS);
+    engine->chunk_used++;
+    metrics_add(&engine->metrics.writer_queue, 1);
+    pthread_cond_signal(&engine->condvar_can_write);
+    pthread_mutex_unlock(&engine->mutex);
+    return 0;
+}
+
+static void *stream_writer_thread_func(void *arg) {
     EngineCore *engine = (EngineCore*)arg;
-    const RunConfig *cfg = engine->cfg;
+    trace_thread_name("writer");
+    (void)affinity_apply(&engine->cfg->sched, AFFINITY_WRITER, NULL, 0);
 
-    while (!g_stop) {
+    for (;;) {
         pthread_mutex_lock(&engine->mutex);
-        while (engine->ready_batches == 0 && !g_stop) {
+        while (engine->chunk_used == 0 && !stopping(engine)) {
             pthread_cond_wait(&engine->condvar_can_write, &engine->mutex);
         }
-        if (engine->ready_batches == 0 && g_stop) {
+        if (engine->chunk_used == 0 && stopping(engine)) {
             pthread_mutex_unlock(&engine->mutex);
             break;
         }
-        size_t this_idx = engine->next_write_batch_idx;
-        engine->ready_batches = 0; // consume
+        uint8_t idx = engine->chunk_tail;
         pthread_mutex_unlock(&engine->mutex);
 
-        uint8_t *src = (this_idx == 0) ? engine->buf_a : engine->buf_b;
-        size_t bytes_to_write = engine->bytes_per_flush_batch;
-
-        // Write full batch
+        const uint8_t *src = engine->chunk_pool[idx];
+        size_t bytes_to_write = engine->chunk_len[idx];
+        uint64_t t0 = latency_now_ns();
+        const uint64_t tt = trace_begin();
         size_t off = 0;
         while (off < bytes_to_write) {
+            const uint64_t tw = trace_begin();
             ssize_t w = write(engine->fd_out, src + off, bytes_to_write - off);
+            trace_end("syscall", "write", tw, (w > 0) ? (uint64_t)w : 0);
             if (w < 0) {
                 if (errno == EINTR) continue;
-                fprintf(stderr,"[engine] writer_thread => write() failed\n");
-                g_stop = 1;
+                fprintf(stderr,"[engine] stream writer => write() failed\n");
+                engine->stop = 1;
                 break;
             }
             off += (size_t)w;
         }
+        phase_stats_add(&engine->phase_stats, PHASE_WRITE, latency_now_ns() - t0);
+        trace_end("phase", phase_name(PHASE_WRITE), tt, off);
+        metrics_add(&engine->metrics.bytes_written, off);
+        writeback_done(engine, off);
 
-        // Update counters + signal producer that buffer is available again
         pthread_mutex_lock(&engine->mutex);
-        engine->total_traces_written += cfg->n_flush_traces;
-        pthread_cond_signal(&engine->condvar_written);
+        engine->chunk_tail = (uint8_t)((engine->chunk_tail + 1) % ENGINE_STREAM_CHUNKS);
+        engine->chunk_used--;
+        engine->bytes_streamed += off;
+        engine->total_traces_written = (size_t)(engine->bytes_streamed / engine->bytes_per_trace);
+        metrics_sub(&engine->metrics.writer_queue, 1);
+        metrics_set(&engine->metrics.traces_written, engine->total_traces_written);
+        const size_t written = engine->total_traces_written;
+        pthread_cond_broadcast(&engine->condvar_written);
         pthread_mutex_unlock(&engine->mutex);
+
+        if (off == bytes_to_write) engine_checkpoint_due(engine, written);
     }
+    return NULL;
+}
+
+// Wait for queued chunks, then cut the file back to the last fully captured trace
+// (drops chunks of a trace whose readout failed, or frames past --ntraces).
+static void stream_sync_to_traces(EngineCore *core, size_t n_traces) {
+    pthread_mutex_lock(&core->mutex);
+    while (core->chunk_used != 0 && !stopping(core)) {
+        pthread_cond_wait(&core->condvar_written, &core->mutex);
+    }
+    uint64_t keep = (uint64_t)n_traces * core->bytes_per_trace;
+    if (keep > core->bytes_streamed) keep = core->bytes_streamed - (core->bytes_streamed % core->bytes_per_trace);
+    if (keep != core->bytes_streamed && core->chunk_used == 0) {
+        if (ftruncate(core->fd_out, (off_t)keep) == 0 && lseek(core->fd_out, (off_t)keep, SEEK_SET) >= 0) {
+            core->bytes_streamed = keep;
+            core->wb_pos = keep;
+            if (core->wb_prev_pos + core->wb_prev_len > keep) core->wb_prev_len = 0;
+            if (core->wb_dropped > keep) core->wb_dropped = keep;
+        }
+    }
+    core->total_traces_written = (size_t)(core->bytes_streamed / core->bytes_per_trace);
+    metrics_set(&core->metrics.traces_written, core->total_traces_written);
+    pthread_mutex_unlock(&core->mutex);
+}
+
+// Reopen the link with exponential back-off; the driver/scope layer replays its
+// configuration journal. 0 ok, <0 gave up.
+static int reconnect_with_backoff(EngineCore *core) {
+    Scope *scope = core->scope;
+    const uint64_t t0 = latency_now_us();
+    const uint64_t tt = trace_begin();
+    unsigned backoff_us = ENGINE_RECONNECT_MIN_US;
+
+    for (unsigned attempt = 1; attempt <= ENGINE_RECONNECT_ATTEMPTS && !stopping(core); ++attempt) {
+        usleep(backoff_us);
+        core->reconnect_attempts++;
+        int rc = scope->driver->reconnect ? scope->driver->reconnect(scope) : scope_reconnect(scope);
+        if (rc == 0) {
+            uint64_t dt = latency_now_us() - t0;
+            core->reconnects++;
+            metrics_add(&core->metrics.reconnects, 1);
+            core->reconnect_us_total += dt;
+            if (dt > core->reconnect_us_max) core->reconnect_us_max = dt;
+            trace_end("engine", "reconnect", tt, 0);
+            if (core->fp_log) {
+                fprintf(core->fp_log, "[engine] reconnect ok (attempts:%u, %.3f ms)\n", attempt, dt / 1000.0);
+            }
+            if (core->cfg->verbose) {
+                fprintf(stdout, "[engine] reconnect ok (attempts:%u, %.3f ms)\n", attempt, dt / 1000.0);
+            }
+            return 0;
+        }
+        backoff_us = (backoff_us >= ENGINE_RECONNECT_MAX_US / 2) ? ENGINE_RECONNECT_MAX_US : backoff_us * 2;
+    }
+    return -1;
+}
 
+// Back to the pool: the mappings (pre-faulted, locked) stay for the next run in this process
+static void free_buffers(EngineCore *core) {
+    for (unsigned i = 0; i < SINK_MAX_BUFS; ++i) {
+        bufpool_put(core->batch_bufs[i]);
+        core->batch_bufs[i] = NULL;
+    }
+    core->n_batch_bufs = 0;
+    for (int i = 0; i < ENGINE_STREAM_CHUNKS; ++i) {
+        bufpool_put(core->chunk_pool[i]);
+        core->chunk_pool[i] = NULL;
+    }
+}
+
+/*
+ * Phased acquire: phase_thread runs prepare_next(seq) while the acquisition
+ * thread collects seq-1, so target I/O overlaps the scope readout.
+ */
+static void *phase_thread_func(void *arg) {
+    EngineCore *engine = (EngineCore*)arg;
+    trace_thread_name("prepare");
+    (void)affinity_apply(&engine->cfg->sched, AFFINITY_WRITER, NULL, 0);
+
+    for (;;) {
+        pthread_mutex_lock(&engine->phase_mutex);
+        while (engine->prep_done >= engine->prep_requested && !engine->phase_exit) {
+            pthread_cond_wait(&engine->condvar_phase, &engine->phase_mutex);
+        }
+        if (engine->phase_exit) {
+            pthread_mutex_unlock(&engine->phase_mutex);
+            break;
+        }
+        uint64_t seq = engine->prep_done;
+        pthread_mutex_unlock(&engine->phase_mutex);
+
+        const uint64_t tt = trace_begin();
+        int rc = engine->phases->prepare_next(seq, engine->cfg);
+        trace_end("engine", "prepare_next", tt, 0);
+
+        pthread_mutex_lock(&engine->phase_mutex);
+        engine->prep_rc = rc;
+        engine->prep_done = seq + 1;
+        pthread_cond_broadcast(&engine->condvar_phase);
+        pthread_mutex_unlock(&engine->phase_mutex);
+        if (rc != 0) break;
+    }
     return NULL;
 }
 
+// One acquisition attempt in phased mode; same return convention as acquire().
+static int phased_acquire(EngineCore *core, uint8_t *dst) {
+    const AcquirePhases *ph = core->phases;
+    Scope *scope = core->scope;
+    const RunConfig *cfg = core->cfg;
+    const uint64_t seq = core->phase_seq;
+
+    // 1) Stimulus for seq must be ready (normally prepared during the previous readout)
+    if (ph->prepare_next) {
+        pthread_mutex_lock(&core->phase_mutex);
+        while (core->prep_done <= seq && core->prep_rc == 0 && !stopping(core)) {
+            pthread_cond_wait(&core->condvar_phase, &core->phase_mutex);
+        }
+        int prc = core->prep_rc;
+        bool ready = (core->prep_done > seq);
+        pthread_mutex_unlock(&core->phase_mutex);
+        if (prc != 0 || !ready) {
+            if (prc != 0) fprintf(stderr, "[engine] prepare_next(%llu) failed rc=%d.\n", (unsigned long long)seq, prc);
+            core->stop = 1;
+            return (prc != 0) ? prc : -1;
+        }
+    }
+
+    // 2) Arm + trigger on this thread
+    int rc = ph->arm(scope, seq, cfg);
+    if (rc != 0) return rc;
+    rc = ph->trigger(scope, seq, cfg);
+    if (rc != 0) return rc;
+
+    // 3) Waveform is latched in the scope: target is free, prepare seq+1 during readout
+    core->phase_seq = seq + 1;
+    if (ph->prepare_next) {
+        pthread_mutex_lock(&core->phase_mutex);
+        core->prep_requested = seq + 2;
+        pthread_cond_signal(&core->condvar_phase);
+        pthread_mutex_unlock(&core->phase_mutex);
+    }
+
+    // 4) Collect. A failure consumes seq: the target already ran it and may hold seq+1 by
+    //    now, so it cannot be retried. Log the gap so stored traces can be realigned.
+    rc = ph->collect(scope, dst, seq, cfg);
+    if (rc < 0) {
+        core->phase_seqs_lost++;
+        if (core->fp_log) {
+            fprintf(core->fp_log, "[engine] seq %llu lost (collect rc=%d): stored trace %zu is seq %llu\n",
+                    (unsigned long long)seq, rc, core->total_traces_captured, (unsigned long long)(seq + 1));
+        }
+        if (cfg->verbose) {
+            fprintf(stdout, "[engine] seq %llu lost (collect rc=%d)\n", (unsigned long long)seq, rc);
+        }
+    }
+    return rc;
+}
+
+static int engine_run_impl(EngineCore *core, int (*acquire)(Scope *scope, uint8_t *dst, const RunConfig *cfg), const AcquirePhases *phases, int (*prep)(Scope *scope, const RunConfig *cfg), int (*cleanup)(void));
+static int engine_run_pinned(EngineCore *core, int (*acquire)(Scope *scope, uint8_t *dst, const RunConfig *cfg), const AcquirePhases *phases, int (*prep)(Scope *scope, const RunConfig *cfg), int (*cleanup)(void));
+
 int engine_run(EngineCore *core, int (*acquire)(Scope *scope, uint8_t *dst, const RunConfig *cfg), int (*prep)(Scope *scope, const RunConfig *cfg), int (*cleanup)(void)) {
-    if (!core || !core->cfg || !core->scope || !acquire) return -1;
+    if (!acquire) return -1;
+    return engine_run_pinned(core, acquire, NULL, prep, cleanup);
+}
+
+int engine_run_phased(EngineCore *core, const AcquirePhases *phases, int (*prep)(Scope *scope, const RunConfig *cfg), int (*cleanup)(void)) {
+    if (!phases || !phases->arm || !phases->trigger || !phases->collect) return -1;
+    return engine_run_pinned(core, NULL, phases, prep, cleanup);
+}
+
+// The calling thread becomes the acquisition thread for the run: pin it (and raise it to
+// SCHED_FIFO) before scope init and buffer allocation, so the threads it starts and the
+// NUMA placement of the buffers follow; put it back afterwards.
+static int engine_run_pinned(EngineCore *core, int (*acquire)(Scope *scope, uint8_t *dst, const RunConfig *cfg), const AcquirePhases *phases, int (*prep)(Scope *scope, const RunConfig *cfg), int (*cleanup)(void)) {
+    if (!core || !core->cfg) return -1;
+    ThreadSched saved;
+    const bool restore = (affinity_save(&saved) == 0);
+    if (affinity_apply(&core->cfg->sched, AFFINITY_ACQUIRE, core->sched_acquire, sizeof core->sched_acquire) != -1
+        && core->cfg->verbose) {
+        fprintf(stdout, "[engine] acquisition thread: %s\n", core->sched_acquire);
+    }
+    if (!core->sched_acquire[0]) snprintf(core->sched_acquire, sizeof core->sched_acquire, "cpus=any sched=inherit");
+    // --trace: dumped here for every exit of engine_run_impl, failed setups included (their
+    // returns destroy cfg, hence the copy of the path)
+    char *trace_path = core->cfg->trace_file ? strdup(core->cfg->trace_file) : NULL;
+    int rc = engine_run_impl(core, acquire, phases, prep, cleanup);
+    if (trace_path && atomic_load_explicit(&trace_enabled, memory_order_acquire)) (void)trace_dump(trace_path);
+    free(trace_path);
+    if (restore) affinity_restore(&saved);
+    return rc;
+}
+
+static int engine_run_impl(EngineCore *core, int (*acquire)(Scope *scope, uint8_t *dst, const RunConfig *cfg), const AcquirePhases *phases, int (*prep)(Scope *scope, const RunConfig *cfg), int (*cleanup)(void)) {
+    if (!core || !core->cfg || !core->scope || (!acquire && !phases)) return -1;
     RunConfig *cfg = core->cfg;
     Scope *scope   = core->scope;
 
+    core->stop = 0;
     if (cfg->diagnose) {
         // No outfile/threads; just probe instrument and print
         int rc = engine_diagnose(core);
@@ -203,6 +1064,14 @@ int engine_run(EngineCore *core, int (*acquire)(Scope *scope, uint8_t *dst, cons
     sigemptyset(&sa.sa_mask);
     sigaction(SIGINT, &sa, NULL);
 
+    // -- Per-phase timing (drivers and wait helpers record through scope->stats)
+    phase_stats_reset(&core->phase_stats);
+    metrics_reset(&core->metrics);
+    scope->stats = &core->phase_stats;
+
+    // -- Timeline tracing (--trace): start before init so the setup I/O shows up too
+    if (cfg->trace_file && trace_start() == 0) trace_thread_name("acquire");
+
     // -- Initialize scope
     if (scope->driver->init(scope, cfg) != 0) {
         fprintf(stderr, "[engine] scope init failed.\n");
@@ -210,6 +1079,18 @@ int engine_run(EngineCore *core, int (*acquire)(Scope *scope, uint8_t *dst, cons
         return -2;
     }
 
+    // -- Size batches now that the driver has fixed n_samples
+    if (cfg->n_frames == 0) cfg->n_frames = 1;
+    MemBudget mb; // sampled before our own buffers exist
+    get_memory_budget(&mb);
+    if (cfg->n_flush_traces == 0) {
+        cfg->n_flush_traces = auto_flush_traces(cfg, &mb);
+        if (!cfg->stream) {
+            fprintf(stderr, "[engine] --batch %s: %s%zu traces per flush (memory budget %.2f MiB).\n",
+                    cfg->adaptive_batch ? "auto" : "omitted", cfg->adaptive_batch ? "up to " : "",
+                    cfg->n_flush_traces, mb.budget / 1048576.0);
+        }
+    }
     int rc = enforce_flush_limit(cfg);
     if (rc != 0) {
         scope->driver->destroy(scope);
@@ -223,7 +1104,7 @@ int engine_run(EngineCore *core, int (*acquire)(Scope *scope, uint8_t *dst, cons
     if (cfg->n_channels != 0 && bpt > SIZE_MAX / cfg->n_channels) overflow = true;
     else bpt *= cfg->n_channels;
 
-    unsigned bytes_per_sample = (unsigned)(cfg->coding + 1); // 0=>1 byte, 1=>2 bytes
+    size_t bytes_per_sample = run_config_sample_bytes(cfg); // stored bytes, not wire bytes
     if (!overflow && bytes_per_sample != 0 && bpt > SIZE_MAX / bytes_per_sample) 
         overflow = true;
     if (overflow) {
@@ -242,24 +1123,76 @@ int engine_run(EngineCore *core, int (*acquire)(Scope *scope, uint8_t *dst, cons
     }
     core->bytes_per_flush_batch = core->bytes_per_trace * cfg->n_flush_traces;
 
-    // -- Allocate two flush batches (aligned)
-    if (posix_memalign((void**)&core->buf_a, 64, core->bytes_per_flush_batch) != 0) core->buf_a = NULL;
-    if (posix_memalign((void**)&core->buf_b, 64, core->bytes_per_flush_batch) != 0) core->buf_b = NULL;
-    if (!core->buf_a || !core->buf_b) {
+    // A partial multi-frame cycle can spill past the batch end; keep slack for it
+    if (cfg->n_frames == 0) cfg->n_frames = 1;
+    size_t slack_traces = cfg->n_frames - 1;
+    if (slack_traces > (SIZE_MAX - core->bytes_per_flush_batch) / core->bytes_per_trace) {
+        fprintf(stderr, "[engine] batch size overflow.\n");
+        scope->driver->destroy(scope);
+        destroy_run_config(cfg);
+        return -5;
+    }
+    core->bytes_per_buffer = core->bytes_per_flush_batch + slack_traces * core->bytes_per_trace;
+
+    // -- Allocate the batch buffers (2 + drop/spill sinks), or the chunk pool when streaming. Pool regions are
+    //    pre-faulted on this (acquisition) thread's NUMA node before the first trace.
+    const BufPoolOpts pool_opts = { .hugetlb = cfg->hugepages, .lock = cfg->mlock_buffers, .numa = true };
+    bool alloc_ok = true;
+    if (cfg->stream) {
+        for (int i = 0; i < ENGINE_STREAM_CHUNKS; ++i) {
+            core->chunk_pool[i] = bufpool_get(ENGINE_STREAM_CHUNK_BYTES, &pool_opts, &core->buf_info);
+            if (!core->chunk_pool[i]) alloc_ok = false;
+        }
+    } else {
+        core->n_batch_bufs = engine_batch_buffers(cfg);
+        for (unsigned i = 0; i < core->n_batch_bufs; ++i) {
+            core->batch_bufs[i] = bufpool_get(core->bytes_per_buffer, &pool_opts, &core->buf_info);
+            if (!core->batch_bufs[i]) alloc_ok = false;
+        }
+    }
+    if (!alloc_ok) {
         fprintf(stderr, "[engine] Failed to allocate %.2f MiB buffers.\n",
-                core->bytes_per_flush_batch/1048576.0);
-        free(core->buf_a); free(core->buf_b);
+                (cfg->stream ? ENGINE_STREAM_CHUNK_BYTES : core->bytes_per_flush_batch)/1048576.0);
+        free_buffers(core);
         scope->driver->destroy(scope);
         destroy_run_config(cfg);
         return -6;
     }
+    core->chunk_head = core->chunk_tail = core->chunk_used = 0;
+    core->bytes_streamed = 0;
+    if (cfg->stream) {
+        core->stream_sink.get_buf = stream_get_buf;
+        core->stream_sink.commit  = stream_commit;
+        core->stream_sink.ctx     = core;
+        scope->stream = &core->stream_sink;
+    }
 
-    const bool store = (cfg->outfile != NULL);
-    if (store) {
-        // -- Open trace output file binary
-        core->fd_out = open_out_file(cfg->outfile, ".bin");
+    const bool store = run_config_has_sinks(cfg); // at least one output for the batches
+
+    // -- Handoff size: the whole buffer, or (--batch auto) ~ENGINE_ADAPT_START_BYTES to begin with
+    core->batch_traces       = cfg->n_flush_traces;
+    core->batch_floor        = cfg->n_frames;
+    core->adapt_calm         = 0;
+    core->batch_resizes      = 0;
+    core->handoff_fill_ns    = 0;
+    core->acq_traces_per_s   = 0.0;
+    core->writer_bytes_per_s = 0.0;
+    if (cfg->adaptive_batch && store && !cfg->stream) {
+        core->batch_traces = batch_round(core, ENGINE_ADAPT_START_BYTES / core->bytes_per_trace);
+    }
+    metrics_set(&core->metrics.batch_traces, cfg->stream ? 0 : core->batch_traces);
+
+    core->fd_out = -1;
+    core->fp_log = NULL;
+    core->resumed_traces = 0;
+    memset(&core->shm, 0, sizeof core->shm);
+    memset(&core->sock, 0, sizeof core->sock);
+    core->sock.fd = core->sock.pipe_r = core->sock.pipe_w = -1;
+    if (store && cfg->outfile) {
+        // -- Open trace output file binary (--resume: append after the checkpointed traces)
+        core->fd_out = cfg->resume ? open_resumed_out_file(core) : open_out_file(cfg->outfile, ".bin");
         if (core->fd_out < 0) {
-            free(core->buf_a); free(core->buf_b);
+            free_buffers(core);
             scope->driver->destroy(scope);
             destroy_run_config(cfg);
             return -7;
@@ -273,33 +1206,124 @@ int engine_run(EngineCore *core, int (*acquire)(Scope *scope, uint8_t *dst, cons
         if (!core->fp_log) {
             fprintf(stderr, "[engine] failed to open log file.\n");
             close(core->fd_out);
-            free(core->buf_a); free(core->buf_b);
+            free_buffers(core);
             scope->driver->destroy(scope);
             destroy_run_config(cfg);
             return -8;
         }
+        if (cfg->resume) fprintf(core->fp_log, "resumed_at_trace=%zu\n", core->resumed_traces);
+        char pool_desc[96];
+        bufpool_describe(&core->buf_info, pool_desc, sizeof pool_desc);
+        fprintf(core->fp_log, "buffer_pool=%s\n", pool_desc);
+        char sched_desc[96];
+        fprintf(core->fp_log, "sched_acquire=%s\n", core->sched_acquire);
+        affinity_describe(&cfg->sched, AFFINITY_WRITER, sched_desc, sizeof sched_desc);
+        fprintf(core->fp_log, "sched_writer=%s\n", sched_desc);
+        if (cfg->n_instr > 1) {
+            affinity_describe(&cfg->sched, AFFINITY_WORKER, sched_desc, sizeof sched_desc);
+            fprintf(core->fp_log, "sched_workers=%s\n", sched_desc);
+        }
+        fprintf(core->fp_log, "mem_budget_bytes=%zu\nmem_required_bytes=%zu\n",
+                mb.budget, engine_memory_required(cfg, cfg->n_flush_traces));
+        if (cfg->verbose) fprintf(stdout, "[engine] buffers: %s\n", pool_desc);
         scope->driver->dump_log(scope, core->fp_log, cfg);
         if (cfg->verbose) {
             fprintf(stdout, "[engine] log file created: %s.log\n", cfg->outfile);
         }
+    } else if (store) {
+        scope->driver->dump_log(scope, stdout, cfg);
+    }
+
+    if (store) {
+        // -- Live readers: shared-memory ring (one trace = bytes_per_trace, channel-major)
+        if (cfg->shm_name) {
+            char chbuf[256];
+            run_config_channels(cfg, chbuf, sizeof chbuf);
+            const ShmRingGeometry geo = {
+                .bytes_per_trace  = core->bytes_per_trace,
+                .n_samples        = cfg->n_samples,
+                .n_channels       = cfg->n_channels,
+                .bytes_per_sample = (unsigned)run_config_sample_bytes(cfg),
+                .channels         = chbuf,
+            };
+            if (shmring_create(&core->shm, cfg->shm_name, cfg->shm_bytes, &geo) != 0) {
+                fprintf(stderr, "[engine] cannot create shm ring '%s'.\n", cfg->shm_name);
+                free_buffers(core);
+                scope->driver->destroy(scope);
+                if (core->fd_out >= 0) close(core->fd_out);
+                close_log_file(core);
+                destroy_run_config(cfg);
+                return -10;
+            }
+            if (core->fp_log) {
+                fprintf(core->fp_log, "shm_ring=%s\nshm_slot_bytes=%llu\n", core->shm.name,
+                        (unsigned long long)core->shm.hdr->slot_bytes);
+            }
+            if (cfg->verbose) {
+                fprintf(stdout, "[engine] shm ring %s: %d slots x %.2f MiB\n", core->shm.name, SHMRING_SLOTS,
+                        core->shm.hdr->slot_bytes / 1048576.0);
+            }
+        }
+
+        // -- Receiver process on a socket (connects; the receiver listens)
+        if (cfg->sock_addr) {
+            SockStreamHello hello = {
+                .n_channels       = cfg->n_channels,
+                .bytes_per_trace  = core->bytes_per_trace,
+                .n_samples        = cfg->n_samples,
+                .bytes_per_sample = (uint32_t)run_config_sample_bytes(cfg),
+            };
+            run_config_channels(cfg, hello.channels, sizeof hello.channels);
+            if (socksink_open(&core->sock, cfg->sock_addr, (SockSinkMode)cfg->sock_mode, &hello) != 0) {
+                free_buffers(core);
+                scope->driver->destroy(scope);
+                if (core->shm.hdr) shmring_close(&core->shm, true);
+                if (core->fd_out >= 0) close(core->fd_out);
+                close_log_file(core);
+                destroy_run_config(cfg);
+                return -11;
+            }
+            core->sock.stop     = producer_stopping; // Ctrl-C never waits long for a stuck receiver
+            core->sock.stop_ctx = core;
+            if (core->fp_log) {
+                fprintf(core->fp_log, "sock=%s\nsock_mode=%s\n", core->sock.addr, socksink_mode_name(core->sock.mode));
+            }
+            if (cfg->verbose) {
+                fprintf(stdout, "[engine] streaming to %s (%s)\n", core->sock.addr, socksink_mode_name(core->sock.mode));
+            }
+        }
 
         // -- Init thread sync
         pthread_mutex_init(&core->mutex, NULL);
         pthread_cond_init(&core->condvar_can_write, NULL);
         pthread_cond_init(&core->condvar_written, NULL);
-        core->next_write_batch_idx   = 0;
-        core->ready_batches          = 0;
-        core->total_traces_captured  = 0;
-        core->total_traces_written   = 0;
+        core->total_traces_captured  = core->resumed_traces; // --ntraces counts across sessions
+        core->total_traces_written   = core->resumed_traces;
+        core->bytes_streamed         = (uint64_t)core->resumed_traces * core->bytes_per_trace;
+        core->wb_pos                 = core->bytes_streamed;
+        core->wb_prev_pos            = 0;
+        core->wb_prev_len            = 0;
+        core->wb_dropped             = 0;
         core->handovers_waited       = 0;
         core->handovers_nowait       = 0;
-
-        // -- Launch writer thread
-        if (pthread_create(&core->writer_thread, NULL, writer_thread_func, core) != 0) {
+        core->reconnects             = 0;
+        core->reconnect_attempts     = 0;
+        core->reconnect_us_total     = 0;
+        core->reconnect_us_max       = 0;
+        metrics_set(&core->metrics.traces_captured, core->total_traces_captured);
+        metrics_set(&core->metrics.traces_written, core->total_traces_written);
+
+        // -- Initial checkpoint records the geometry, so even an early crash is resumable
+        (void)engine_checkpoint(core, core->total_traces_written);
+
+        // -- Launch the chunk writer thread (--stream; batches go through the sink threads)
+        if (cfg->stream && pthread_create(&core->writer_thread, NULL, stream_writer_thread_func, core) != 0) {
             fprintf(stderr, "[engine] pthread_create of writer_thread failed.\n");
-            free(core->buf_a); free(core->buf_b);
+            free_buffers(core);
             scope->driver->destroy(scope);
-            close(core->fd_out);
+            if (core->shm.hdr) shmring_close(&core->shm, true);
+            socksink_close(&core->sock);
+            if (core->fd_out >= 0) close(core->fd_out);
             close_log_file(core);
             destroy_run_config(cfg);
             pthread_cond_destroy(&core->condvar_can_write);
@@ -310,20 +1334,57 @@ int engine_run(EngineCore *core, int (*acquire)(Scope *scope, uint8_t *dst, cons
 
     }else {
         // no-store mode: counters still start at zero
-        core->next_write_batch_idx   = 0;
-        core->ready_batches          = 0;
         core->total_traces_captured  = 0;
         core->total_traces_written   = 0;
         core->handovers_waited       = 0;
         core->handovers_nowait       = 0;
+        core->reconnects             = 0;
+        core->reconnect_attempts     = 0;
+        core->reconnect_us_total     = 0;
+        core->reconnect_us_max       = 0;
         scope->driver->dump_log(scope, stdout, cfg);
         if (cfg->verbose) {
-            fprintf(stdout, "[engine] no-store mode: not creating out files nor writer_thread.\n");
+            fprintf(stdout, "[engine] no-store mode: no output files, batches are recycled as they fill.\n");
         }
     }
 
-    // -- Acquisition loop
-    uint8_t *active_buf = core->buf_a;
+    // -- Batch fan-out: one thread per output, each with its own queue and policy
+    if (!cfg->stream) {
+        int src = engine_sinks_start(core);
+        if (src != 0) {
+            fprintf(stderr, "[engine] cannot set up the batch sinks (rc=%d).\n", src);
+            sink_fanout_close(&core->fanout);
+            free(core->stats_sum);   core->stats_sum   = NULL;
+            free(core->stats_sumsq); core->stats_sumsq = NULL;
+            free_buffers(core);
+            scope->driver->destroy(scope);
+            if (core->shm.hdr) shmring_close(&core->shm, true);
+            socksink_close(&core->sock);
+            if (core->fd_out >= 0) close(core->fd_out);
+            close_log_file(core);
+            destroy_run_config(cfg);
+            if (store) {
+                pthread_cond_destroy(&core->condvar_can_write);
+                pthread_cond_destroy(&core->condvar_written);
+                pthread_mutex_destroy(&core->mutex);
+            }
+            return -12;
+        }
+        if (core->fanout.n_sinks > 0) {
+            char sinks_desc[256];
+            sinks_describe(&core->fanout, sinks_desc, sizeof sinks_desc);
+            if (core->fp_log) fprintf(core->fp_log, "sinks=%s\nbatch_buffers=%u\n", sinks_desc, core->n_batch_bufs);
+            if (cfg->verbose) fprintf(stdout, "[engine] sinks: %s (%u batch buffers)\n", sinks_desc, core->n_batch_bufs);
+        }
+    }
+
+    // -- Live metrics exporter (optional; a failure only loses the export)
+    (void)metrics_start(core);
+
+    // -- Acquisition loop (batch mode: every buffer is free at this point)
+    SinkBatch *active = cfg->stream ? NULL : sink_fanout_acquire(&core->fanout, NULL, NULL, NULL);
+    uint8_t *active_buf = active ? active->data : NULL;
+    uint64_t first_in_batch = core->total_traces_written; // run-wide index of the active batch's first trace
     size_t traces_in_flush_batch = 0;
     size_t to_capture_total = cfg->n_traces;
     bool unlimited = (to_capture_total == 0);
@@ -331,120 +1392,205 @@ int engine_run(EngineCore *core, int (*acquire)(Scope *scope, uint8_t *dst, cons
     if(prep != NULL){
         if (prep(scope, cfg)!=0){
             fprintf(stderr, "[engine] prep() failed.\n");
-            g_stop = 1;
+            core->stop = 1;
         }
     }
 
+    // -- Phased mode: start the target-I/O thread and have it prepare seq 0
+    core->phases = phases;
+    bool phase_thread_up = false;
+    if (phases && phases->prepare_next && !stopping(core)) {
+        pthread_mutex_init(&core->phase_mutex, NULL);
+        pthread_cond_init(&core->condvar_phase, NULL);
+        core->phase_seq      = 0;
+        core->phase_seqs_lost = 0;
+        core->prep_requested = 1;
+        core->prep_done      = 0;
+        core->prep_rc        = 0;
+        core->phase_exit     = false;
+        if (pthread_create(&core->phase_thread, NULL, phase_thread_func, core) != 0) {
+            fprintf(stderr, "[engine] pthread_create of phase_thread failed.\n");
+            pthread_cond_destroy(&core->condvar_phase);
+            pthread_mutex_destroy(&core->phase_mutex);
+            core->stop = 1;
+        } else {
+            phase_thread_up = true;
+        }
+    } else {
+        core->phase_seq = 0;
+        core->phase_seqs_lost = 0;
+    }
+
     // --- inside engine_run acquisition loop ---
+    core->fill_start_ns = latency_now_ns();
     int ti = -1;
-    while (!g_stop && (unlimited || core->total_traces_captured < to_capture_total)) {
-        uint8_t *dst = active_buf + (traces_in_flush_batch * core->bytes_per_trace);
+    while (!stopping(core) && (unlimited || core->total_traces_captured < to_capture_total)) {
+        uint8_t *dst = cfg->stream ? NULL : active_buf + (traces_in_flush_batch * core->bytes_per_trace);
         ti++;
-        int rc = acquire(scope, dst, cfg);   // pass cfg if your signature has it
+        const uint64_t tt = trace_begin();
+        int rc = phases ? phased_acquire(core, dst) : acquire(scope, dst, cfg);
+        trace_end("engine", "acquire", tt, 0);
 
         if (rc == ACQ_ERR_ARM_TIMEOUT || rc == ACQ_ERR_TRIGGER_TIMEOUT) {
             // Soft miss: skip this trace and try again
-            fprintf(core->fp_log, "[engine] skipped trace %d (total_captured:%zu, acq_timeout_rc=%d)\n", ti,
+            if (core->fp_log) fprintf(core->fp_log, "[engine] skipped trace %d (total_captured:%zu, acq_timeout_rc=%d)\n", ti,
                         core->total_traces_captured, rc);
             if (cfg->verbose) {
                 fprintf(stdout, "[engine] skipped trace %d (total_captured:%zu, acq_timeout_rc=%d)\n", ti,
                         core->total_traces_captured, rc);
             }
+            metrics_add(rc == ACQ_ERR_ARM_TIMEOUT ? &core->metrics.skipped_arm_timeout
+                                                  : &core->metrics.skipped_trigger_timeout, 1);
             // do NOT increment traces_in_flush_batch nor total_traces_captured
             continue;
         }
 
+        if (rc < 0 && stopping(core)) break; // readout aborted by a stop request
+
         if (rc < 0) {
             // Hard failure: try to re-establish the VISA link
-            fprintf(core->fp_log, "[engine] skipped trace %d (total_captured:%zu, acq_timeout_rc=%d)\n", ti,
+            if (core->fp_log) fprintf(core->fp_log, "[engine] skipped trace %d (total_captured:%zu, acq_timeout_rc=%d)\n", ti,
                         core->total_traces_captured, rc);
             if (cfg->verbose) {
                 fprintf(stdout, "[engine] skipped trace %d (total_captured:%zu, acq_timeout_rc=%d)\n", ti,
                         core->total_traces_captured, rc);
             }
+            metrics_add(&core->metrics.skipped_error, 1);
             fprintf(stderr, "[engine] acquire() rc=%d → attempting reconnect...\n", rc);
+            if (cfg->stream && store) stream_sync_to_traces(core, core->total_traces_captured);
 
-            usleep(1000000); // 1s back-off
-            if (scope_reconnect(scope) == 0) {
-                if (cfg->verbose) fprintf(stdout, "[engine] reconnect OK; continuing.\n");
+            if (reconnect_with_backoff(core) == 0) {
                 continue; // skip this trace, but do not stop the run
             }
 
             fprintf(stderr, "[engine] reconnect failed; stopping gracefully.\n");
-            g_stop = 1;
+            core->stop = 1;
             break;
         }
 
-        // Success path
-        core->total_traces_captured++;
-        traces_in_flush_batch++;
-
-        if (traces_in_flush_batch == cfg->n_flush_traces) {
-            if (store) {
-                // Swap buffers and signal writer
-                pthread_mutex_lock(&core->mutex);
-
-                // Monitoring of writer_thread handoff
-                int had_to_wait = (core->ready_batches != 0);
-                if (had_to_wait) {
-                    core->handovers_waited++;
-                    if (cfg->verbose) {
-                        fprintf(stdout, "[debug] writer_thread => had2wait:%llu, nowait:%llu\n",
-                                (unsigned long long)core->handovers_waited,
-                                (unsigned long long)core->handovers_nowait);
-                    }
-                } else {
-                    core->handovers_nowait++;
-                }
-
-                while (core->ready_batches != 0 && !g_stop) {
-                    pthread_cond_wait(&core->condvar_written, &core->mutex);
-                }
-                if (g_stop) {
-                    pthread_mutex_unlock(&core->mutex);
-                    break;
+        // Success path: rc>0 => partial multi-frame capture, ACQ_OK => all n_frames
+        size_t got = (rc > 0) ? (size_t)rc : cfg->n_frames;
+        if (got > cfg->n_frames) got = cfg->n_frames;
+        if (!unlimited && got > to_capture_total - core->total_traces_captured)
+            got = to_capture_total - core->total_traces_captured; // drop frames past --ntraces
+        core->total_traces_captured += got;
+        metrics_set(&core->metrics.traces_captured, core->total_traces_captured);
+        if (cfg->stream) {
+            continue; // chunks already went to the writer during read_trace
+        }
+        traces_in_flush_batch += got;
+
+        if (traces_in_flush_batch >= core->batch_traces) {
+            const size_t handed = core->batch_traces;
+            const uint64_t fill_ns = latency_now_ns() - core->fill_start_ns;
+
+            // Next buffer first: only waits while block sinks (the writer) hold all the others
+            uint64_t waited_ns = 0;
+            const uint64_t tt = trace_begin();
+            SinkBatch *next = sink_fanout_acquire(&core->fanout, producer_stopping, core, &waited_ns);
+            phase_stats_add(&core->phase_stats, PHASE_HANDOFF_WAIT, waited_ns);
+            trace_end("phase", phase_name(PHASE_HANDOFF_WAIT), tt, 0);
+            const bool had_to_wait = (waited_ns > 0);
+            if (had_to_wait) {
+                core->handovers_waited++;
+                if (cfg->verbose) {
+                    fprintf(stdout, "[debug] writer_thread => had2wait:%llu, nowait:%llu\n",
+                            (unsigned long long)core->handovers_waited,
+                            (unsigned long long)core->handovers_nowait);
                 }
-                // Mark ready
-                core->ready_batches = 1;
-                core->next_write_batch_idx = (active_buf == core->buf_a) ? 0 : 1;
-                pthread_cond_signal(&core->condvar_can_write);
-                pthread_mutex_unlock(&core->mutex);
+            } else {
+                core->handovers_nowait++;
             }
+            if (!next) break; // stop request while waiting: the full batch goes out as the tail
+            if (cfg->adaptive_batch) adapt_batch(core, had_to_wait, fill_ns);
+            core->handoff_fill_ns = fill_ns;
+
+            // Carry frames that spilled past the batch end, then hand the batch to every sink
+            traces_in_flush_batch -= handed;
+            if (traces_in_flush_batch > 0) {
+                memcpy(next->data, active_buf + handed * core->bytes_per_trace,
+                       traces_in_flush_batch * core->bytes_per_trace);
+            }
+            metrics_add(&core->metrics.writer_queue, 1);
+            sink_fanout_submit(&core->fanout, active, handed, first_in_batch);
+            first_in_batch += handed;
+            active     = next;
+            active_buf = next->data;
+            core->fill_start_ns = latency_now_ns();
+        }
+    }
 
-            // Switch active buffer
-            active_buf = (active_buf == core->buf_a) ? core->buf_b : core->buf_a;
-            traces_in_flush_batch = 0;
+    if (phase_thread_up) {
+        pthread_mutex_lock(&core->phase_mutex);
+        core->phase_exit = true;
+        pthread_cond_broadcast(&core->condvar_phase);
+        pthread_mutex_unlock(&core->phase_mutex);
+        pthread_join(core->phase_thread, NULL);
+        pthread_cond_destroy(&core->condvar_phase);
+        pthread_mutex_destroy(&core->phase_mutex);
+    }
+    core->phases = NULL;
+
+    // -- Tail: the partial last batch goes out like the others, then every sink drains
+    if (!cfg->stream) {
+        if (active) {
+            if (traces_in_flush_batch > 0) metrics_add(&core->metrics.writer_queue, 1);
+            sink_fanout_submit(&core->fanout, active, traces_in_flush_batch, first_in_batch);
         }
-        // In no-store mode, add 0.5s delay between iterations
-        if (!store) usleep(500000);
+        sink_fanout_close(&core->fanout);
+        sinks_report(core);
+        stats_finish(core);
     }
 
-    // -- Tail write & teardown
+    // -- Teardown
     if (store) {
-        // Save tail traces (producer writes the partial tail)
-        if (traces_in_flush_batch > 0) {
-            size_t bytes = traces_in_flush_batch * core->bytes_per_trace;
-            uint8_t *src = active_buf;
-            size_t off = 0;
-            while (off < bytes) {
-                ssize_t w = write(core->fd_out, src + off, bytes - off);
-                if (w < 0) { if (errno == EINTR) continue; fprintf(stderr,"[engine] final write() failed: %s\n", strerror(errno)); break; }
-                off += (size_t)w;
-            }
+        if (cfg->stream) {
+            // Stop the chunk writer; it drains the ring first. Then drop any partially streamed trace
             pthread_mutex_lock(&core->mutex);
-            core->total_traces_written += traces_in_flush_batch;
+            core->stop = 1;
+            pthread_cond_broadcast(&core->condvar_can_write);
             pthread_mutex_unlock(&core->mutex);
+            pthread_join(core->writer_thread, NULL);
+            stream_sync_to_traces(core, core->total_traces_captured);
         }
-
-        // Stop writer thread and join
-        pthread_mutex_lock(&core->mutex);
-        g_stop = 1;
-        pthread_cond_broadcast(&core->condvar_can_write);
-        pthread_mutex_unlock(&core->mutex);
-        pthread_join(core->writer_thread, NULL);
+        (void)engine_checkpoint(core, core->total_traces_written);
 
         // Close files & destroy sync
-        close(core->fd_out);
+        if (core->shm.hdr) {
+            if (core->fp_log) {
+                fprintf(core->fp_log, "shm_records=%llu\nshm_blocked_ms=%.3f\nshm_readers_evicted=%llu\n"
+                        "shm_readers_demoted=%llu\n",
+                        (unsigned long long)core->shm.records, core->shm.blocked_ns / 1e6,
+                        (unsigned long long)core->shm.evicted, (unsigned long long)core->shm.demoted);
+            }
+            if (cfg->verbose) {
+                fprintf(stdout, "[engine] shm %s: %llu records, blocked by readers %.3f ms\n", core->shm.name,
+                        (unsigned long long)core->shm.records, core->shm.blocked_ns / 1e6);
+            }
+            shmring_close(&core->shm, true);
+        }
+        if (cfg->sock_addr) {
+            const bool lost = (core->sock.fd < 0);
+            if (core->fp_log) {
+                fprintf(core->fp_log, "sock_frames=%llu\nsock_bytes=%llu\nsock_blocked_ms=%.3f\n"
+                        "sock_blocked_max_ms=%.3f\nsock_stalls=%llu\nsock_receiver_lost=%d\n",
+                        (unsigned long long)core->sock.frames, (unsigned long long)core->sock.bytes,
+                        core->sock.blocked_ns / 1e6, core->sock.blocked_ns_max / 1e6,
+                        (unsigned long long)core->sock.stalls, lost ? 1 : 0);
+                if (core->sock.mode == SOCKSINK_ZEROCOPY) {
+                    fprintf(core->fp_log, "sock_zc_sends=%llu\nsock_zc_copied=%llu\n",
+                            (unsigned long long)core->sock.zc_sent, (unsigned long long)core->sock.zc_copied);
+                }
+            }
+            if (cfg->verbose) {
+                fprintf(stdout, "[engine] sock %s: %llu frames, %.2f MiB, blocked by receiver %.3f ms (%llu stalls, max %.3f ms)%s\n",
+                        core->sock.addr, (unsigned long long)core->sock.frames, core->sock.bytes / 1048576.0,
+                        core->sock.blocked_ns / 1e6, (unsigned long long)core->sock.stalls,
+                        core->sock.blocked_ns_max / 1e6, lost ? ", receiver lost" : "");
+            }
+            socksink_close(&core->sock);
+        }
+        if (core->fd_out >= 0) close(core->fd_out);
         close_log_file(core);
         pthread_cond_destroy(&core->condvar_can_write);
         pthread_cond_destroy(&core->condvar_written);
@@ -456,17 +1602,32 @@ int engine_run(EngineCore *core, int (*acquire)(Scope *scope, uint8_t *dst, cons
             fprintf(stderr, "[engine] cleanup() failed.\n");
         }
     }
-    // Always free buffers, destroy cfg and scope
-    free(core->buf_a);
-    free(core->buf_b);
-    destroy_run_config(cfg);
-    scope->driver->destroy(scope);
-
+    metrics_stop(core);
+    phase_stats_print(&core->phase_stats, stdout, false);
 
+    // Summary before destroy_run_config (it clears verbose)
     if (cfg->verbose) {
         fprintf(stdout, "[engine] Captured %zu traces, wrote %zu traces.\n",
                 core->total_traces_captured, core->total_traces_written);
+        if (cfg->adaptive_batch && !cfg->stream) {
+            fprintf(stdout, "[engine] batch auto: settled at %zu traces after %zu resize(s) (acq %.1f traces/s, writer %.1f MiB/s)\n",
+                    core->batch_traces, core->batch_resizes, core->acq_traces_per_s,
+                    core->writer_bytes_per_s / 1048576.0);
+        }
+        if (core->reconnect_attempts) {
+            fprintf(stdout, "[engine] reconnects:%llu (attempts:%llu, avg %.3f ms, max %.3f ms)\n",
+                    (unsigned long long)core->reconnects, (unsigned long long)core->reconnect_attempts,
+                    core->reconnects ? core->reconnect_us_total / 1000.0 / (double)core->reconnects : 0.0,
+                    core->reconnect_us_max / 1000.0);
+        }
     }
+
+    // Always free buffers, destroy cfg and scope
+    scope->stream = NULL;
+    scope->stats  = NULL;
+    free_buffers(core);
+    destroy_run_config(cfg);
+    scope->driver->destroy(scope);
     return 0;
 }
 
@@ -489,33 +1650,33 @@ int engine_diagnose(EngineCore *core) {
         return -2;
     }
 
-    // 1) *IDN?
-    char idn[256] = {0};
-    if (scope_query(scope, "*IDN?", idn, sizeof idn) != 0) {
-        fprintf(stderr, "[diagnose] *IDN? failed.\n");
+    // Composite multi-scope: no session of its own, let the driver report per instrument
+    if (scope->instr == VI_NULL) {
+        printf("== DIAGNOSE (composite) ==\n");
+        (void)scope->driver->dump_log(scope, stdout, cfg);
+        if (scope->driver->calibrate_transfer &&
+            scope->driver->calibrate_transfer(scope, cfg, stdout) != 0)
+            fprintf(stderr, "[diagnose] transfer calibration failed.\n");
+        fflush(stdout);
         scope->driver->destroy(scope);
-        return -3;
-    }
-
-    // 2) Trigger status
-    char trig[16] = {0};
-    if (scope_query(scope, ":TRIG:STAT?", trig, sizeof trig) != 0) {
-        fprintf(stderr, "[diagnose] :TRIG:STAT? failed.\n");
-        scope->driver->destroy(scope);
-        return -4;
+        destroy_run_config(cfg);
+        return 0;
     }
 
-    // 3) Sample rate
-    char srate[64] = {0};
-    if (scope_query(scope, ":ACQ:SRAT?", srate, sizeof srate) != 0) {
-        fprintf(stderr, "[diagnose] :ACQ:SRAT? failed.\n");
-        scope->driver->destroy(scope);
-        return -5;
+    // 1) *IDN?, trigger status, sample rate, waveform mode: one compound round trip
+    static const char *const q[] = { "*IDN?", ":TRIG:STAT?", ":ACQ:SRAT?", ":WAV:MODE?" };
+    char reply[384] = {0};
+    char *f[4] = {0};
+    if (scope_query_multi(scope, q, 4, reply, sizeof reply, f) < 0) f[0] = f[1] = f[2] = f[3] = NULL;
+    for (int k = 0; k < 3; ++k) {
+        if (!f[k]) {
+            fprintf(stderr, "[diagnose] %s failed.\n", q[k]);
+            scope->driver->destroy(scope);
+            return -3 - k;
+        }
     }
-
-    // 4) Waveform mode / points (and let driver dump a few more lines)
-    char wmode[32] = {0};
-    (void)scope_query(scope, ":WAV:MODE?", wmode, sizeof wmode);
+    const char *idn = f[0], *trig = f[1], *srate = f[2];
+    const char *wmode = f[3] ? f[3] : "";
 
     // Print a concise diagnosis header
     printf("== DIAGNOSE ==\n");
@@ -532,6 +1693,13 @@ int engine_diagnose(EngineCore *core) {
 
     // Reuse driver's dump_log but point it to stdout (no files)
     (void)scope->driver->dump_log(scope, stdout, cfg);
+
+    // Tune and cache readout chunk/buffer sizes for later runs
+    if (scope->driver->calibrate_transfer) {
+        printf("\n");
+        if (scope->driver->calibrate_transfer(scope, cfg, stdout) != 0)
+            fprintf(stderr, "[diagnose] transfer calibration failed.\n");
+    }
     fflush(stdout);
 
     scope->driver->destroy(scope);
@@ -6,7 +6,15 @@
 #include <stdbool.h>
 #include <stdio.h> 
 #include <pthread.h>
+#include <signal.h>
 #include "../scope/scope.h"
+#include "latency.h"
+#include "metrics.h"
+#include "bufpool.h"
+#include "affinity.h"
+#include "shmring.h"
+#include "socksink.h"
+#include "sink.h"
 
 #ifdef __cplusplus
 extern "C" {
@@ -22,35 +30,174 @@ typedef enum {
 
 
 #define SCOPE_MAX_CHANS 8
+#define ENGINE_MAX_INSTRUMENTS 4 // -i repeated => one composite multi-scope
+
+// Reconnect back-off after a hard acquire() failure (doubles per attempt)
+#define ENGINE_RECONNECT_MIN_US   2000u    // first attempt after 2 ms
+#define ENGINE_RECONNECT_MAX_US   2000000u // cap per wait
+#define ENGINE_RECONNECT_ATTEMPTS 12       // ~6 s of waits in total (2 ms .. 1.024 s, then 2 x 2 s)
+
+// Checkpoint (<base>.ckpt) cadence: the writer fdatasyncs the .bin, then records the trace count
+// (default for --sync-interval)
+#ifndef ENGINE_CHECKPOINT_INTERVAL_MS
+#define ENGINE_CHECKPOINT_INTERVAL_MS 5000u
+#endif
+
+// Writeback policy of the .bin (--writeback)
+typedef enum {
+    WRITEBACK_KERNEL   = 0, // leave dirty pages to the kernel (flushed in bursts)
+    WRITEBACK_THROTTLE = 1, // sync_file_range: start writeback per write, wait for the previous one
+    WRITEBACK_DSYNC    = 2, // fdatasync after every batch / chunk
+} EngineWriteback;
+
+// Memory budget: buffers may use this share of min(MemAvailable, cgroup v2 headroom),
+// after a fixed reserve for VISA, driver staging, trace rings and thread stacks
+#ifndef ENGINE_MEM_BUDGET_PCT
+#define ENGINE_MEM_BUDGET_PCT       75u
+#endif
+#ifndef ENGINE_MEM_RESERVE_BYTES
+#define ENGINE_MEM_RESERVE_BYTES    ((size_t)64 << 20)
+#endif
+// --batch omitted: largest batch within the budget, but at most this much per buffer
+#ifndef ENGINE_AUTO_BATCH_MAX_BYTES
+#define ENGINE_AUTO_BATCH_MAX_BYTES ((size_t)512 << 20)
+#endif
+
+// --batch auto: the handoff size moves inside the budget-sized buffers. It doubles on every
+// producer stall and shrinks by 1/4 after ENGINE_ADAPT_STEADY stall-free handoffs in which
+// the writer was busy for less than ENGINE_ADAPT_BUSY_PCT of the time the batch took to fill
+#ifndef ENGINE_ADAPT_START_BYTES
+#define ENGINE_ADAPT_START_BYTES    ((size_t)1 << 20)
+#endif
+#ifndef ENGINE_ADAPT_BUSY_PCT
+#define ENGINE_ADAPT_BUSY_PCT       50u
+#endif
+#ifndef ENGINE_ADAPT_STEADY
+#define ENGINE_ADAPT_STEADY         4u
+#endif
+
+// Batch outputs, each a sink of the fan-out with its own thread, queue and policy (--sink-policy)
+typedef enum {
+    ENGINE_SINK_FILE = 0,   // <base>.bin (always block)
+    ENGINE_SINK_SHM,        // --shm
+    ENGINE_SINK_SOCK,       // --sock
+    ENGINE_SINK_STATS,      // --stats: per-sample mean / standard deviation
+    ENGINE_SINK_NULL,       // --null-sink: discards (measures the handoff alone)
+    ENGINE_SINK_KINDS
+} EngineSinkKind;
+
+// Streaming mode: small fixed pool of chunk buffers instead of two flush batches
+#define ENGINE_STREAM_CHUNKS      4
+#define ENGINE_STREAM_CHUNK_BYTES ((size_t)1 << 19) // >= one 250k BYTE / 125k WORD :WAV:DATA? chunk
+
+// Optional phased acquire API (engine_run_phased). The engine runs arm/trigger/collect on
+// the acquisition thread and prepare_next on a second thread, one trace ahead: host/target
+// I/O for stimulus seq+1 overlaps the waveform readout of seq. prepare_next must not touch
+// the scope. On a soft miss (ACQ_ERR_*_TIMEOUT) the same seq is re-armed and re-triggered; a
+// failed collect consumes seq (logged, with phase_seqs_lost= in the .log trailer).
+typedef struct AcquirePhases {
+    int (*prepare_next)(uint64_t seq, const RunConfig *cfg);             // e.g. generate + send plaintext
+    int (*arm)(Scope *s, uint64_t seq, const RunConfig *cfg);            // arm and wait until armed
+    int (*trigger)(Scope *s, uint64_t seq, const RunConfig *cfg);        // fire stimulus, wait triggered
+    int (*collect)(Scope *s, uint8_t *dst, uint64_t seq, const RunConfig *cfg); // read waveform(s)
+} AcquirePhases;
 
 typedef struct EngineCore {
     Scope   *scope; // scope object
     RunConfig *cfg; // instrument info, tracefile info, scope info.
 
-    // - Double-buffering
-    uint8_t *buf_a; // while one is being written to,
-    uint8_t *buf_b; // the other is being read from.
+    // - Batch buffers (regions of the process-wide bufpool, reused by the next run): the
+    //   producer fills one while the sinks of the fan-out read the others by reference
+    uint8_t *batch_bufs[SINK_MAX_BUFS];
+    unsigned n_batch_bufs;         // 2 + drop/spill sinks
+    SinkFanout fanout;
+    BufPoolInfo buf_info; // how the batch/chunk memory is backed (logged)
+    char     sched_acquire[96]; // policy applied to the acquisition thread (logged)
     size_t   bytes_per_flush_batch;
+    size_t   bytes_per_buffer;  // flush batch + (n_frames-1) traces of overflow slack
     size_t   bytes_per_trace; // accounts the number of channels
 
-    // - Writer thread synchronization
+    // - Stream writer thread synchronization (--stream)
     pthread_t writer_thread;
     pthread_mutex_t mutex;
     pthread_cond_t  condvar_can_write;
     pthread_cond_t  condvar_written;
 
+    // - Streaming mode (--stream): chunk ring, filled by read_trace, drained by writer
+    ScopeChunkSink stream_sink;
+    uint8_t *chunk_pool[ENGINE_STREAM_CHUNKS];
+    size_t   chunk_len[ENGINE_STREAM_CHUNKS];
+    uint8_t  chunk_head;            // next slot to fill
+    uint8_t  chunk_tail;            // next slot to write
+    uint8_t  chunk_used;            // committed, not yet written
+    uint64_t bytes_streamed;
+
     // - Writer thread monitoring
     uint64_t handovers_waited;
     uint64_t handovers_nowait;
 
-    // - File descriptors
+    // - Batch handoff size: cfg->n_flush_traces is the buffer capacity, batch_traces what is
+    //   handed over (equal unless --batch auto moves it within [n_frames, n_flush_traces])
+    size_t   batch_traces;
+    size_t   batch_floor;          // auto: smallest size not yet seen to stall the producer
+    unsigned adapt_calm;           // auto: stall-free handoffs since the last resize
+    size_t   batch_resizes;
+    uint64_t fill_start_ns;        // producer: active buffer started filling
+    uint64_t handoff_fill_ns;      // producer: fill time of the batch handed over last
+    double   acq_traces_per_s;     // auto: EWMA of the fill rate
+    double   writer_bytes_per_s;   // auto: EWMA of the batch write bandwidth
+
+    // - File descriptors (fd_out < 0 => no .bin, e.g. --shm only)
     int   fd_out;
     FILE *fp_log;
 
-    // - State
-    uint8_t next_write_batch_idx;   // 0 => buf_a, 1 => buf_b
-    uint8_t ready_batches;          // 0,1 (at most one waiting since ping-pong)
-    size_t  n_traces_acquired_active; // modulo n_flush_traces
+    // - Live shared-memory ring (--shm), published by its sink thread
+    ShmRing shm;
+
+    // - Socket streaming sink (--sock), sent to by its sink thread (sock.fd < 0 => off)
+    SockSink sock;
+
+    // - Statistics sink (--stats): per-sample sums over the traces it was handed
+    double  *stats_sum;
+    double  *stats_sumsq;
+    uint64_t stats_traces;
+
+    // - Phased acquire: prepare_next runs on phase_thread, at most one seq ahead
+    const AcquirePhases *phases;
+    pthread_t       phase_thread;
+    pthread_mutex_t phase_mutex;
+    pthread_cond_t  condvar_phase;
+    uint64_t phase_seq;       // stimulus sequence number of the current attempt
+    uint64_t phase_seqs_lost; // seqs whose collect failed: fired on the target, no trace stored
+    uint64_t prep_requested;  // prepare_next may run for seq < prep_requested
+    uint64_t prep_done;       // seqs [0, prep_done) are prepared
+    int      prep_rc;
+    bool     phase_exit;
+
+    // - Checkpointing / --resume
+    uint64_t checkpoint_last_us;   // writer: time of the last checkpoint
+    size_t   resumed_traces;       // traces already in the .bin when the run started
+
+    // - Writeback (file sink / stream writer thread; producer only once it is idle)
+    uint64_t wb_pos;               // .bin offset of the next write
+    uint64_t wb_prev_pos;          // THROTTLE: range whose writeback was started last
+    uint64_t wb_prev_len;
+    uint64_t wb_dropped;           // --drop-cache: [0, wb_dropped) already evicted
+
+    // - Reconnect metrics
+    uint64_t reconnects;           // successful reconnects
+    uint64_t reconnect_attempts;   // reconnect calls, incl. failed ones
+    uint64_t reconnect_us_total;   // failure -> link usable again
+    uint64_t reconnect_us_max;
+
+    // - Per-phase timing histograms (arm ... write), printed and logged at the end
+    PhaseStats phase_stats;
+
+    // - Live metrics (--metrics-file / --metrics-socket), lock-free counters + exporter thread
+    EngineMetrics metrics;
+
+    // - Per-instance stop request (writer errors, end of run, engine_request_core_stop)
+    volatile sig_atomic_t stop;
 
     // - Global counters
     size_t total_traces_captured;
@@ -60,31 +207,79 @@ typedef struct EngineCore {
 
 typedef struct RunConfig {
     char   *instr_name;         // VISA resource string (NULL => auto-detect)
+    char   *instr_names[ENGINE_MAX_INSTRUMENTS]; // every -i given, in order (instr_names[0] == instr_name)
+    uint8_t n_instr;
 
     uint8_t coding;             // 0 for BYTE, 1 for WORD
+    bool    keep_high_byte;     // WORD: store both bytes (2 B/sample) instead of packing to 1
     size_t  n_samples;          // samples per trace per channel
     size_t raw_start_idx;       // 1-based left index of visible RAW window (computed at init)
     size_t  n_traces;           // stop after this many traces (0 => unlimited)
-    size_t  n_flush_traces;     // traces kept in RAM before flushing to disk
+    size_t  n_flush_traces;     // traces kept in RAM before flushing to disk (0 => sized from the memory budget)
+    bool    adaptive_batch;     // --batch auto: n_flush_traces is the capacity, the handoff size adapts
+    size_t  n_frames;           // frames captured per arm cycle (waveform record; 1 => off)
 
     char   **channels;          // e.g., {"CHAN1","CHAN2","MATH"}
     uint8_t  n_channels;        // number of elements in channels[]
 
-    char    *outfile;           // base path; .bin/.log derived from it
+    char    *outfile;           // base path; .bin/.log/.ckpt derived from it
+    bool     resume;            // --resume: append to an existing outfile after its checkpoint
+    uint8_t  writeback;         // EngineWriteback
+    unsigned sync_interval_ms;  // fdatasync + checkpoint cadence (0 => ENGINE_CHECKPOINT_INTERVAL_MS)
+    bool     drop_cache;        // posix_fadvise(DONTNEED) written ranges once they are on disk
+    bool     hugepages;         // back batch buffers with MAP_HUGETLB when reserved pages exist
+    bool     mlock_buffers;     // mlock batch buffers (never swapped out mid-run)
+    EngineSched sched;          // CPU pinning / SCHED_FIFO per thread role (--cpu-*, --rt-priority)
 
+    bool     stream;            // hand each readout chunk to the writer (bounded memory)
+    char    *shm_name;          // publish batches to this shared-memory ring (NULL => off)
+    size_t   shm_bytes;         // ring data size (0 => SHMRING_DEFAULT_BYTES)
+    char    *sock_addr;         // send batches to this receiver: unix:/path | tcp:host:port (NULL => off)
+    uint8_t  sock_mode;         // SockSinkMode (--sock-mode)
+    bool     stats_sink;        // --stats: mean / std per sample -> <base>.stats
+    bool     null_sink;         // --null-sink
+    uint8_t  sink_policy[ENGINE_SINK_KINDS]; // SinkPolicy per output (--sink-policy; default block)
+
+    char    *metrics_file;      // Prometheus text file, atomically replaced (NULL => off)
+    char    *metrics_socket;    // Unix socket path pushing the same snapshots (NULL => off)
+    unsigned metrics_interval_ms; // 0 => METRICS_DEFAULT_INTERVAL_MS
+    char    *trace_file;        // Chrome trace-event JSON timeline written at exit (NULL => off)
     bool     verbose;
     bool     diagnose;
 } RunConfig; // instrument info, tracefile info, scope info.
 
+// Bytes stored per sample in batches/.bin: WORD is packed to its significant byte
+// unless keep_high_byte is set (for >8-bit drivers)
+static inline size_t run_config_sample_bytes(const RunConfig *cfg) {
+    return (cfg->coding == 1 && cfg->keep_high_byte) ? 2u : 1u;
+}
+
+// Any batch output at all (otherwise batches are recycled as soon as they are full)
+static inline bool run_config_has_sinks(const RunConfig *cfg) {
+    return cfg->outfile || cfg->shm_name || cfg->sock_addr || cfg->stats_sink || cfg->null_sink;
+}
+
+static inline const char *writeback_name(uint8_t wb) {
+    return (wb == WRITEBACK_THROTTLE) ? "throttle" : (wb == WRITEBACK_DSYNC) ? "dsync" : "kernel";
+}
+
 // CLI argument parsing
 int engine_parse_cli_args(int argc, char **argv, EngineCore *engine);
 
-// Main orchestrator: allocate buffers, spawn writer thread, acquire & store
+// Main orchestrator: allocate buffers, spawn writer thread, acquire & store.
+// acquire() returns ACQ_OK (0) when cfg->n_frames traces were written to dst,
+// a positive count for a partial multi-frame capture, or a negative rc.
 int engine_run(EngineCore *core, int (*acquire)(Scope *scope, uint8_t *dst, const RunConfig *cfg), int (*pre)(Scope *scope, const RunConfig *cfg),int (*cleanup)(void));
 
-// Request a graceful stop (e.g., from a signal handler).
+// Same as engine_run, but drives the split AcquirePhases callbacks across two threads.
+int engine_run_phased(EngineCore *core, const AcquirePhases *phases, int (*prep)(Scope *scope, const RunConfig *cfg), int (*cleanup)(void));
+
+// Request a graceful stop of every engine in the process (e.g., from a signal handler).
 void engine_request_stop(void);
 
+// Request a graceful stop of a single engine instance.
+void engine_request_core_stop(EngineCore *core);
+
 // Diagnose mode: quick connectivity & capability checks, prints to stdout.
 int engine_diagnose(EngineCore *engine);
 
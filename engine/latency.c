@@ -0,0 +1,263 @@
+#define _GNU_SOURCE
+#include "engine.h"
+#include "latency.h"
+#include "trace.h"
+
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+// --------------------
+// Latency model
+// --------------------
+
+static unsigned bucket_of(uint64_t us) {
+    if (us > UINT32_MAX) us = UINT32_MAX;
+    if (us < 4) return (unsigned)us;
+    unsigned msb = 63u - (unsigned)__builtin_clzll(us);
+    return (msb << LATENCY_SUB_BITS) | (unsigned)((us >> (msb - LATENCY_SUB_BITS)) & 3u);
+}
+
+static uint64_t bucket_lo(unsigned idx) {
+    if (idx < 4) return idx;
+    unsigned msb = idx >> LATENCY_SUB_BITS, sub = idx & 3u;
+    return (uint64_t)(4u + sub) << (msb - LATENCY_SUB_BITS);
+}
+
+static uint64_t bucket_hi(unsigned idx) {
+    if (idx < 4) return (uint64_t)idx + 1;
+    unsigned msb = idx >> LATENCY_SUB_BITS, sub = idx & 3u;
+    return (uint64_t)(5u + sub) << (msb - LATENCY_SUB_BITS);
+}
+
+void latency_model_init(LatencyModel *m) {
+    if (m) memset(m, 0, sizeof *m);
+}
+
+void latency_model_add(LatencyModel *m, uint64_t us) {
+    if (!m) return;
+    m->counts[bucket_of(us)]++;
+    m->n++;
+    m->n_total++;
+
+    // Exponential forgetting: halve every bucket periodically
+    if ((m->n_total % LATENCY_DECAY_EVERY) == 0) {
+        m->n = 0;
+        for (unsigned i = 0; i < LATENCY_BUCKETS; ++i) {
+            m->counts[i] = (m->counts[i] + 1) / 2;
+            m->n += m->counts[i];
+        }
+    }
+}
+
+static int quantile_idx(const LatencyModel *m, double q) {
+    if (!m || m->n == 0) return -1;
+    if (q < 0.0) q = 0.0;
+    if (q > 1.0) q = 1.0;
+    uint64_t rank = (uint64_t)(q * (double)(m->n - 1)) + 1;
+    uint64_t acc  = 0;
+    for (unsigned i = 0; i < LATENCY_BUCKETS; ++i) {
+        acc += m->counts[i];
+        if (acc >= rank) return (int)i;
+    }
+    return LATENCY_BUCKETS - 1;
+}
+
+uint64_t latency_model_quantile(const LatencyModel *m, double q) {
+    int idx = quantile_idx(m, q);
+    return (idx < 0) ? 0 : bucket_hi((unsigned)idx);
+}
+
+uint64_t latency_now_us(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000u + (uint64_t)ts.tv_nsec / 1000u;
+}
+
+uint64_t latency_now_ns(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000u + (uint64_t)ts.tv_nsec;
+}
+
+// --------------------
+// Per-phase histograms
+// --------------------
+
+#define PH_SUB (1u << PHASE_HIST_SUB_BITS)
+
+static unsigned ph_bucket_of(uint64_t ns) {
+    if (ns < PH_SUB) return (unsigned)ns;
+    unsigned msb = 63u - (unsigned)__builtin_clzll(ns);
+    unsigned idx = (msb << PHASE_HIST_SUB_BITS) | (unsigned)((ns >> (msb - PHASE_HIST_SUB_BITS)) & (PH_SUB - 1u));
+    return (idx < PHASE_HIST_BUCKETS) ? idx : PHASE_HIST_BUCKETS - 1;
+}
+
+static uint64_t ph_bucket_hi(unsigned idx) {
+    if (idx < PH_SUB) return (uint64_t)idx + 1;
+    unsigned msb = idx >> PHASE_HIST_SUB_BITS, sub = idx & (PH_SUB - 1u);
+    return (uint64_t)(PH_SUB + sub + 1u) << (msb - PHASE_HIST_SUB_BITS);
+}
+
+static const char *const phase_names[PHASE_COUNT] = {
+    "arm", "armed_wait", "trigger_wait", "read_chunk", "handoff_wait", "write"
+};
+
+const char *phase_name(EnginePhase ph) {
+    return ((unsigned)ph < PHASE_COUNT) ? phase_names[ph] : "?";
+}
+
+void phase_stats_reset(PhaseStats *ps) {
+    if (!ps) return;
+    for (unsigned p = 0; p < PHASE_COUNT; ++p) {
+        PhaseHist *h = &ps->h[p];
+        for (unsigned i = 0; i < PHASE_HIST_BUCKETS; ++i) atomic_init(&h->counts[i], 0);
+        atomic_init(&h->n, 0);
+        atomic_init(&h->sum_ns, 0);
+        atomic_init(&h->max_ns, 0);
+    }
+}
+
+void phase_stats_add(PhaseStats *ps, EnginePhase ph, uint64_t ns) {
+    if (!ps || (unsigned)ph >= PHASE_COUNT) return;
+    PhaseHist *h = &ps->h[ph];
+    atomic_fetch_add_explicit(&h->counts[ph_bucket_of(ns)], 1, memory_order_relaxed);
+    atomic_fetch_add_explicit(&h->n, 1, memory_order_relaxed);
+    atomic_fetch_add_explicit(&h->sum_ns, ns, memory_order_relaxed);
+    uint64_t cur = atomic_load_explicit(&h->max_ns, memory_order_relaxed);
+    while (ns > cur &&
+           !atomic_compare_exchange_weak_explicit(&h->max_ns, &cur, ns, memory_order_relaxed, memory_order_relaxed)) {
+    }
+}
+
+uint64_t phase_stats_quantile_ns(const PhaseStats *ps, EnginePhase ph, double q) {
+    if (!ps || (unsigned)ph >= PHASE_COUNT) return 0;
+    const PhaseHist *h = &ps->h[ph];
+    uint64_t n = atomic_load_explicit(&h->n, memory_order_relaxed);
+    if (n == 0) return 0;
+    if (q < 0.0) q = 0.0;
+    if (q > 1.0) q = 1.0;
+    uint64_t rank = (uint64_t)(q * (double)(n - 1)) + 1;
+    uint64_t acc  = 0;
+    uint64_t max  = atomic_load_explicit(&h->max_ns, memory_order_relaxed);
+    for (unsigned i = 0; i < PHASE_HIST_BUCKETS; ++i) {
+        acc += atomic_load_explicit(&h->counts[i], memory_order_relaxed);
+        if (acc >= rank) {
+            uint64_t hi = ph_bucket_hi(i);
+            return (hi < max) ? hi : max;
+        }
+    }
+    return max;
+}
+
+void phase_stats_print(const PhaseStats *ps, FILE *fp, bool log_format) {
+    if (!ps || !fp) return;
+    static const double qs[] = { 0.5, 0.9, 0.99, 0.999 };
+    if (!log_format) {
+        fprintf(fp, "[engine] phase latency (us):  %12s %10s %10s %10s %10s %10s %10s\n",
+                "count", "mean", "p50", "p90", "p99", "p99.9", "max");
+    }
+    for (unsigned p = 0; p < PHASE_COUNT; ++p) {
+        const PhaseHist *h = &ps->h[p];
+        uint64_t n = atomic_load_explicit(&h->n, memory_order_relaxed);
+        if (n == 0) continue;
+        double mean = (double)atomic_load_explicit(&h->sum_ns, memory_order_relaxed) / (double)n / 1000.0;
+        double v[4];
+        for (unsigned k = 0; k < 4; ++k) v[k] = (double)phase_stats_quantile_ns(ps, (EnginePhase)p, qs[k]) / 1000.0;
+        double max = (double)atomic_load_explicit(&h->max_ns, memory_order_relaxed) / 1000.0;
+        if (log_format) {
+            fprintf(fp, "latency_%s_us=count:%llu,mean:%.3f,p50:%.3f,p90:%.3f,p99:%.3f,p999:%.3f,max:%.3f\n",
+                    phase_names[p], (unsigned long long)n, mean, v[0], v[1], v[2], v[3], max);
+        } else {
+            fprintf(fp, "[engine]   %-18s %12llu %10.1f %10.1f %10.1f %10.1f %10.1f %10.1f\n",
+                    phase_names[p], (unsigned long long)n, mean, v[0], v[1], v[2], v[3], max);
+        }
+    }
+}
+
+// --------------------
+// Wait helpers
+// --------------------
+
+// Timeout from the model (bounded by cap_us); widened after consecutive misses.
+static uint64_t learned_timeout_us(const LatencyModel *m, uint64_t cap_us) {
+    if (m->n < WAIT_MIN_SAMPLES) return cap_us;
+    uint64_t t = latency_model_quantile(m, WAIT_TIMEOUT_QUANTILE) * WAIT_TIMEOUT_FACTOR;
+    if (t < WAIT_TIMEOUT_FLOOR_US) t = WAIT_TIMEOUT_FLOOR_US;
+    t <<= m->widen;
+    return (t < cap_us) ? t : cap_us;
+}
+
+static void record_outcome(LatencyModel *m, bool ok, uint64_t elapsed_us) {
+    if (ok) {
+        latency_model_add(m, elapsed_us);
+        m->widen = 0;
+    } else {
+        m->n_timeouts++;
+        if (m->widen < 16) m->widen++;
+    }
+}
+
+// 0 done, 1 timeout, <0 driver error
+static int learned_poll(Scope *s, LatencyModel *m, int (*check)(Scope *s, bool *out),
+                        uint64_t t0, uint64_t timeout_us) {
+    const bool warm = (m->n >= WAIT_MIN_SAMPLES);
+
+    // Sleep through the part of the distribution where completion is unlikely
+    if (warm) {
+        int idx = quantile_idx(m, WAIT_SLEEP_QUANTILE);
+        uint64_t early   = (idx < 0) ? 0 : bucket_lo((unsigned)idx);
+        uint64_t elapsed = latency_now_us() - t0;
+        if (early > timeout_us) early = timeout_us;
+        if (early > elapsed) usleep((useconds_t)(early - elapsed));
+    }
+
+    // Then poll: tight when warm, exponential back-off while still learning
+    unsigned sleep_us = SCOPE_POLL_MIN_US;
+    for (;;) {
+        bool done = false;
+        if (check(s, &done) != 0) return -1;
+        uint64_t elapsed = latency_now_us() - t0;
+        if (done) {
+            record_outcome(m, true, elapsed);
+            return 0;
+        }
+        if (elapsed >= timeout_us) {
+            record_outcome(m, false, elapsed);
+            return 1;
+        }
+        uint64_t left = timeout_us - elapsed;
+        usleep((useconds_t)((sleep_us < left) ? sleep_us : left));
+        if (!warm) {
+            sleep_us = (sleep_us >= SCOPE_POLL_MAX_US / 2) ? SCOPE_POLL_MAX_US : sleep_us * 2;
+        }
+    }
+}
+
+int engine_wait_armed(Scope *s, LatencyModel *m, unsigned cap_ms) {
+    if (!s || !m || !s->driver || !s->driver->check_if_armed) return -1;
+    const uint64_t t0 = latency_now_us();
+    const uint64_t tt = trace_begin();
+    const uint64_t cap_us = (uint64_t)(cap_ms ? cap_ms : s->timeout_ms) * 1000u;
+
+    int rc = learned_poll(s, m, s->driver->check_if_armed, t0, learned_timeout_us(m, cap_us));
+    phase_stats_add(s->stats, PHASE_ARMED_WAIT, (latency_now_us() - t0) * 1000u);
+    trace_end("phase", phase_name(PHASE_ARMED_WAIT), tt, 0);
+    if (rc < 0) return -2;
+    return (rc == 0) ? ACQ_OK : ACQ_ERR_ARM_TIMEOUT;
+}
+
+int engine_wait_triggered(Scope *s, LatencyModel *m, unsigned cap_ms) {
+    if (!s || !m || !s->driver) return -1;
+    const uint64_t t0 = latency_now_us();
+    const uint64_t tt = trace_begin();
+    const uint64_t cap_us = (uint64_t)(cap_ms ? cap_ms : s->timeout_ms) * 1000u;
+    const uint64_t timeout_us = learned_timeout_us(m, cap_us);
+
+    if (!s->driver->check_if_triggered) return -1;
+    int rc = learned_poll(s, m, s->driver->check_if_triggered, t0, timeout_us);
+    phase_stats_add(s->stats, PHASE_TRIGGER_WAIT, (latency_now_us() - t0) * 1000u);
+    trace_end("phase", phase_name(PHASE_TRIGGER_WAIT), tt, 0);
+    if (rc < 0) return -3;
+    return (rc == 0) ? ACQ_OK : ACQ_ERR_TRIGGER_TIMEOUT;
+}
@@ -0,0 +1,105 @@
+#ifndef LATENCY_H
+#define LATENCY_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdatomic.h>
+#include "../scope/scope.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* Online latency model: log2 histogram with 4 sub-buckets per octave (1 us .. ~70 min),
+   halved every LATENCY_DECAY_EVERY samples so it follows drifting targets. */
+#define LATENCY_SUB_BITS    2
+#define LATENCY_BUCKETS     (32 << LATENCY_SUB_BITS)
+
+#ifndef LATENCY_DECAY_EVERY
+#define LATENCY_DECAY_EVERY 512u
+#endif
+
+/* Wait-helper tuning */
+#ifndef WAIT_MIN_SAMPLES
+#define WAIT_MIN_SAMPLES        16u     /* below this, use the caller's cap and back-off polling */
+#endif
+#ifndef WAIT_SLEEP_QUANTILE
+#define WAIT_SLEEP_QUANTILE     0.05    /* sleep blindly until this quantile, then poll tightly */
+#endif
+#ifndef WAIT_TIMEOUT_QUANTILE
+#define WAIT_TIMEOUT_QUANTILE   0.999
+#endif
+#ifndef WAIT_TIMEOUT_FACTOR
+#define WAIT_TIMEOUT_FACTOR     4u      /* timeout = factor * quantile (doubled per consecutive miss) */
+#endif
+#ifndef WAIT_TIMEOUT_FLOOR_US
+#define WAIT_TIMEOUT_FLOOR_US   2000u
+#endif
+
+typedef struct LatencyModel {
+    uint32_t counts[LATENCY_BUCKETS];
+    uint32_t n;           // samples currently in the (decayed) histogram
+    uint64_t n_total;     // samples ever recorded
+    uint64_t n_timeouts;  // waits that hit the learned timeout
+    uint8_t  widen;       // timeout doublings after consecutive misses
+} LatencyModel;
+
+/* Per-phase timing of the acquisition cycle: cumulative HDR-style histogram
+   (log-linear, 8 sub-buckets per octave => <=12.5% bucket width, 1 ns .. ~3 days).
+   Recording is lock-free (relaxed atomics), so any thread may add. */
+typedef enum {
+    PHASE_ARM,            // driver arm()
+    PHASE_ARMED_WAIT,     // engine_wait_armed()
+    PHASE_TRIGGER_WAIT,   // engine_wait_triggered()
+    PHASE_READ_CHUNK,     // one :WAV:DATA? chunk (request + transfer)
+    PHASE_HANDOFF_WAIT,   // acquisition thread blocked on the writer (batch swap / chunk slot)
+    PHASE_WRITE,          // writer write() of one batch / chunk
+    PHASE_COUNT
+} EnginePhase;
+
+#define PHASE_HIST_SUB_BITS 3
+#define PHASE_HIST_OCTAVES  48
+#define PHASE_HIST_BUCKETS  (PHASE_HIST_OCTAVES << PHASE_HIST_SUB_BITS)
+
+typedef struct PhaseHist {
+    _Atomic uint64_t counts[PHASE_HIST_BUCKETS];
+    _Atomic uint64_t n;
+    _Atomic uint64_t sum_ns;
+    _Atomic uint64_t max_ns;
+} PhaseHist;
+
+typedef struct PhaseStats {
+    PhaseHist h[PHASE_COUNT];
+} PhaseStats;
+
+void        phase_stats_reset(PhaseStats *ps);
+void        phase_stats_add(PhaseStats *ps, EnginePhase ph, uint64_t ns); /* ps NULL => no-op */
+/* Upper bound (ns) of the bucket holding quantile q, clamped to the exact max; 0 if empty */
+uint64_t    phase_stats_quantile_ns(const PhaseStats *ps, EnginePhase ph, double q);
+const char *phase_name(EnginePhase ph);
+/* Summary table (log_format=false) or key=value lines for the .log trailer */
+void        phase_stats_print(const PhaseStats *ps, FILE *fp, bool log_format);
+
+void     latency_model_init(LatencyModel *m);
+void     latency_model_add(LatencyModel *m, uint64_t us);
+/* Upper bound (us) of the bucket holding quantile q in [0,1]; 0 if empty */
+uint64_t latency_model_quantile(const LatencyModel *m, double q);
+
+/* Monotonic clock in microseconds / nanoseconds */
+uint64_t latency_now_us(void);
+uint64_t latency_now_ns(void);
+
+/* Engine-provided wait helpers for acquire(): call right after arm()/trigger.
+   cap_ms bounds the wait (0 => s->timeout_ms); once WAIT_MIN_SAMPLES were seen the
+   timeout shrinks to the learned percentile. Return ACQ_OK, ACQ_ERR_ARM_TIMEOUT /
+   ACQ_ERR_TRIGGER_TIMEOUT, or <0 on driver error. */
+int engine_wait_armed    (Scope *s, LatencyModel *m, unsigned cap_ms);
+int engine_wait_triggered(Scope *s, LatencyModel *m, unsigned cap_ms);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // LATENCY_H
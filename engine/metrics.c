@@ -0,0 +1,250 @@
+#define _GNU_SOURCE
+#include "engine.h"
+#include "metrics.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+
+// Snapshot of the counters plus the rates derived over the last interval
+typedef struct {
+    uint64_t captured, written, bytes, skip_arm, skip_trig, skip_err, reconnects, queue, batch;
+    double   uptime_s, traces_per_s, bytes_per_s;
+    bool     store;   // no-store runs have no writer backlog
+} MetricsSnap;
+
+static uint64_t load(const _Atomic uint64_t *v) {
+    return atomic_load_explicit(v, memory_order_relaxed);
+}
+
+void metrics_reset(EngineMetrics *m) {
+    if (!m) return;
+    atomic_init(&m->traces_captured, 0);
+    atomic_init(&m->traces_written, 0);
+    atomic_init(&m->bytes_written, 0);
+    atomic_init(&m->skipped_arm_timeout, 0);
+    atomic_init(&m->skipped_trigger_timeout, 0);
+    atomic_init(&m->skipped_error, 0);
+    atomic_init(&m->reconnects, 0);
+    atomic_init(&m->writer_queue, 0);
+    atomic_init(&m->batch_traces, 0);
+    m->up = false;
+    m->exit = false;
+    m->listen_fd = -1;
+    for (int i = 0; i < METRICS_MAX_CLIENTS; ++i) m->clients[i] = -1;
+}
+
+static size_t format_snapshot(const MetricsSnap *s, char *out, size_t cap) {
+    const uint64_t skipped  = s->skip_arm + s->skip_trig + s->skip_err;
+    const uint64_t attempts = s->captured + skipped;
+    const uint64_t backlog  = (s->store && s->captured > s->written) ? s->captured - s->written : 0;
+    int n = snprintf(out, cap,
+        "# TYPE scope_acquire_traces_captured_total counter\n"
+        "scope_acquire_traces_captured_total %llu\n"
+        "# TYPE scope_acquire_traces_written_total counter\n"
+        "scope_acquire_traces_written_total %llu\n"
+        "# TYPE scope_acquire_bytes_written_total counter\n"
+        "scope_acquire_bytes_written_total %llu\n"
+        "# TYPE scope_acquire_skipped_total counter\n"
+        "scope_acquire_skipped_total{rc=\"arm_timeout\"} %llu\n"
+        "scope_acquire_skipped_total{rc=\"trigger_timeout\"} %llu\n"
+        "scope_acquire_skipped_total{rc=\"error\"} %llu\n"
+        "# TYPE scope_acquire_reconnects_total counter\n"
+        "scope_acquire_reconnects_total %llu\n"
+        "# TYPE scope_acquire_capture_rate_traces_per_second gauge\n"
+        "scope_acquire_capture_rate_traces_per_second %.3f\n"
+        "# TYPE scope_acquire_write_bandwidth_bytes_per_second gauge\n"
+        "scope_acquire_write_bandwidth_bytes_per_second %.0f\n"
+        "# TYPE scope_acquire_skip_ratio gauge\n"
+        "scope_acquire_skip_ratio %.6f\n"
+        "# TYPE scope_acquire_writer_backlog_traces gauge\n"
+        "scope_acquire_writer_backlog_traces %llu\n"
+        "# TYPE scope_acquire_writer_queue_depth gauge\n"
+        "scope_acquire_writer_queue_depth %llu\n"
+        "# TYPE scope_acquire_batch_traces gauge\n"
+        "scope_acquire_batch_traces %llu\n"
+        "# TYPE scope_acquire_uptime_seconds gauge\n"
+        "scope_acquire_uptime_seconds %.3f\n",
+        (unsigned long long)s->captured, (unsigned long long)s->written, (unsigned long long)s->bytes,
+        (unsigned long long)s->skip_arm, (unsigned long long)s->skip_trig, (unsigned long long)s->skip_err,
+        (unsigned long long)s->reconnects,
+        s->traces_per_s, s->bytes_per_s,
+        attempts ? (double)skipped / (double)attempts : 0.0,
+        (unsigned long long)backlog, (unsigned long long)s->queue,
+        (unsigned long long)s->batch, s->uptime_s);
+    if (n < 0) return 0;
+    return ((size_t)n < cap) ? (size_t)n : cap - 1;
+}
+
+// Write to <path>.tmp, then rename(): readers never see a half-written file
+static int publish_file(const char *path, const char *text, size_t len) {
+    char tmp[1024];
+    int n = snprintf(tmp, sizeof tmp, "%s.tmp", path);
+    if (n < 0 || (size_t)n >= sizeof tmp) return -1;
+    int fd = open(tmp, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    if (fd < 0) return -2;
+    size_t off = 0;
+    while (off < len) {
+        ssize_t w = write(fd, text + off, len - off);
+        if (w < 0) {
+            if (errno == EINTR) continue;
+            close(fd);
+            unlink(tmp);
+            return -3;
+        }
+        off += (size_t)w;
+    }
+    close(fd);
+    return (rename(tmp, path) == 0) ? 0 : -4;
+}
+
+static int open_socket(EngineMetrics *m, const char *path) {
+    struct sockaddr_un addr;
+    memset(&addr, 0, sizeof addr);
+    addr.sun_family = AF_UNIX;
+    if (strlen(path) >= sizeof addr.sun_path) return -1;
+    strcpy(addr.sun_path, path);
+
+    int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+    if (fd < 0) return -2;
+    unlink(path); // stale socket from a previous run
+    if (bind(fd, (struct sockaddr*)&addr, sizeof addr) != 0 || listen(fd, METRICS_MAX_CLIENTS) != 0) {
+        close(fd);
+        return -3;
+    }
+    fcntl(fd, F_SETFL, fcntl(fd, F_GETFL) | O_NONBLOCK);
+    m->listen_fd = fd;
+    return 0;
+}
+
+static void publish_socket(EngineMetrics *m, const char *text, size_t len) {
+    // Pick up new subscribers (non-blocking)
+    for (;;) {
+        int c = accept(m->listen_fd, NULL, NULL);
+        if (c < 0) break;
+        int slot = -1;
+        for (int i = 0; i < METRICS_MAX_CLIENTS; ++i) if (m->clients[i] < 0) { slot = i; break; }
+        if (slot < 0) { close(c); continue; }
+        m->clients[slot] = c;
+    }
+    // Push; a slow or gone client is dropped rather than stalling the exporter
+    for (int i = 0; i < METRICS_MAX_CLIENTS; ++i) {
+        if (m->clients[i] < 0) continue;
+        ssize_t a = send(m->clients[i], text, len, MSG_NOSIGNAL | MSG_DONTWAIT);
+        ssize_t b = (a == (ssize_t)len) ? send(m->clients[i], "# EOF\n", 6, MSG_NOSIGNAL | MSG_DONTWAIT) : -1;
+        if (b != 6) {
+            close(m->clients[i]);
+            m->clients[i] = -1;
+        }
+    }
+}
+
+static void publish(EngineCore *core, MetricsSnap *prev, uint64_t t0_us, uint64_t *t_prev_us) {
+    EngineMetrics *m = &core->metrics;
+    const RunConfig *cfg = core->cfg;
+    MetricsSnap s = {
+        .captured   = load(&m->traces_captured),
+        .written    = load(&m->traces_written),
+        .bytes      = load(&m->bytes_written),
+        .skip_arm   = load(&m->skipped_arm_timeout),
+        .skip_trig  = load(&m->skipped_trigger_timeout),
+        .skip_err   = load(&m->skipped_error),
+        .reconnects = load(&m->reconnects),
+        .queue      = load(&m->writer_queue),
+        .batch      = load(&m->batch_traces),
+        .store      = run_config_has_sinks(cfg),
+    };
+    const uint64_t now = latency_now_us();
+    const double dt = (double)(now - *t_prev_us) / 1e6;
+    s.uptime_s     = (double)(now - t0_us) / 1e6;
+    s.traces_per_s = (dt > 0.0) ? (double)(s.captured - prev->captured) / dt : 0.0;
+    s.bytes_per_s  = (dt > 0.0) ? (double)(s.bytes - prev->bytes) / dt : 0.0;
+    *prev = s;
+    *t_prev_us = now;
+
+    char text[2048];
+    size_t len = format_snapshot(&s, text, sizeof text);
+    if (cfg->metrics_file) (void)publish_file(cfg->metrics_file, text, len);
+    if (m->listen_fd >= 0) publish_socket(m, text, len);
+}
+
+static void *metrics_thread_func(void *arg) {
+    EngineCore *core = (EngineCore*)arg;
+    EngineMetrics *m = &core->metrics;
+    (void)affinity_apply(&core->cfg->sched, AFFINITY_WRITER, NULL, 0);
+    const unsigned interval_ms = core->cfg->metrics_interval_ms ? core->cfg->metrics_interval_ms
+                                                               : METRICS_DEFAULT_INTERVAL_MS;
+    const uint64_t t0 = latency_now_us();
+    uint64_t t_prev = t0;
+    MetricsSnap prev = {0};
+
+    pthread_mutex_lock(&m->mutex);
+    while (!m->exit) {
+        struct timespec dl;
+        clock_gettime(CLOCK_REALTIME, &dl);
+        dl.tv_sec  += interval_ms / 1000u;
+        dl.tv_nsec += (long)(interval_ms % 1000u) * 1000000L;
+        if (dl.tv_nsec >= 1000000000L) { dl.tv_sec++; dl.tv_nsec -= 1000000000L; }
+        while (!m->exit && pthread_cond_timedwait(&m->condvar_tick, &m->mutex, &dl) != ETIMEDOUT) {
+        }
+        pthread_mutex_unlock(&m->mutex);
+        publish(core, &prev, t0, &t_prev); // last round publishes the final totals
+        pthread_mutex_lock(&m->mutex);
+    }
+    pthread_mutex_unlock(&m->mutex);
+    return NULL;
+}
+
+int metrics_start(EngineCore *core) {
+    if (!core || !core->cfg) return -1;
+    EngineMetrics *m = &core->metrics;
+    const RunConfig *cfg = core->cfg;
+    if (!cfg->metrics_file && !cfg->metrics_socket) return 0;
+
+    if (cfg->metrics_socket && open_socket(m, cfg->metrics_socket) != 0) {
+        fprintf(stderr, "[engine] cannot listen on metrics socket %s: %s\n", cfg->metrics_socket, strerror(errno));
+        return -2;
+    }
+    pthread_mutex_init(&m->mutex, NULL);
+    pthread_cond_init(&m->condvar_tick, NULL);
+    m->exit = false;
+    if (pthread_create(&m->thread, NULL, metrics_thread_func, core) != 0) {
+        fprintf(stderr, "[engine] pthread_create of metrics thread failed.\n");
+        pthread_cond_destroy(&m->condvar_tick);
+        pthread_mutex_destroy(&m->mutex);
+        if (m->listen_fd >= 0) { close(m->listen_fd); m->listen_fd = -1; unlink(cfg->metrics_socket); }
+        return -3;
+    }
+    m->up = true;
+    return 0;
+}
+
+void metrics_stop(EngineCore *core) {
+    if (!core) return;
+    EngineMetrics *m = &core->metrics;
+    if (!m->up) return;
+
+    pthread_mutex_lock(&m->mutex);
+    m->exit = true;
+    pthread_cond_signal(&m->condvar_tick);
+    pthread_mutex_unlock(&m->mutex);
+    pthread_join(m->thread, NULL);
+    pthread_cond_destroy(&m->condvar_tick);
+    pthread_mutex_destroy(&m->mutex);
+    m->up = false;
+
+    for (int i = 0; i < METRICS_MAX_CLIENTS; ++i) {
+        if (m->clients[i] >= 0) { close(m->clients[i]); m->clients[i] = -1; }
+    }
+    if (m->listen_fd >= 0) {
+        close(m->listen_fd);
+        m->listen_fd = -1;
+        if (core->cfg && core->cfg->metrics_socket) unlink(core->cfg->metrics_socket);
+    }
+}
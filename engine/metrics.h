@@ -0,0 +1,67 @@
+#ifndef METRICS_H
+#define METRICS_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <stdatomic.h>
+#include <pthread.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#ifndef METRICS_DEFAULT_INTERVAL_MS
+#define METRICS_DEFAULT_INTERVAL_MS 1000u
+#endif
+#ifndef METRICS_MAX_CLIENTS
+#define METRICS_MAX_CLIENTS 8       // concurrent --metrics-socket subscribers
+#endif
+
+typedef struct EngineCore EngineCore;
+
+/* Live run metrics. The counters are written by the acquisition/writer threads with
+   relaxed atomics (no locks on the hot path) and snapshotted by the metrics thread. */
+typedef struct EngineMetrics {
+    _Atomic uint64_t traces_captured;
+    _Atomic uint64_t traces_written;
+    _Atomic uint64_t bytes_written;
+    _Atomic uint64_t skipped_arm_timeout;     // ACQ_ERR_ARM_TIMEOUT
+    _Atomic uint64_t skipped_trigger_timeout; // ACQ_ERR_TRIGGER_TIMEOUT
+    _Atomic uint64_t skipped_error;           // other rc < 0 (hard failure)
+    _Atomic uint64_t reconnects;
+    _Atomic uint64_t writer_queue;            // batches / chunks handed over, not yet written
+    _Atomic uint64_t batch_traces;            // traces per batch handoff (moves with --batch auto)
+
+    // Exporter state (metrics thread only)
+    pthread_t       thread;
+    pthread_mutex_t mutex;
+    pthread_cond_t  condvar_tick;
+    bool            up;
+    bool            exit;
+    int             listen_fd;
+    int             clients[METRICS_MAX_CLIENTS];
+} EngineMetrics;
+
+/* Hot-path updates: relaxed, never block */
+static inline void metrics_add(_Atomic uint64_t *c, uint64_t v) { atomic_fetch_add_explicit(c, v, memory_order_relaxed); }
+static inline void metrics_sub(_Atomic uint64_t *c, uint64_t v) { atomic_fetch_sub_explicit(c, v, memory_order_relaxed); }
+static inline void metrics_set(_Atomic uint64_t *c, uint64_t v) { atomic_store_explicit(c, v, memory_order_relaxed); }
+
+/* Zero the counters (call before the run starts) */
+void metrics_reset(EngineMetrics *m);
+
+/* Start publishing every cfg->metrics_interval_ms to cfg->metrics_file (atomically
+   replaced Prometheus text file) and/or cfg->metrics_socket (Unix stream socket; each
+   connected client receives every snapshot, terminated by "# EOF"). No-op if neither
+   is set. 0 ok, <0 err */
+int  metrics_start(EngineCore *core);
+
+/* Publish a final snapshot, stop the thread, close/unlink the socket */
+void metrics_stop(EngineCore *core);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // METRICS_H
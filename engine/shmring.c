@@ -0,0 +1,309 @@
+#define _GNU_SOURCE
+#include "shmring.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <signal.h>
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#define SHMRING_LIVENESS_NS 10000000ull // check pids of blocking readers / the producer every 10 ms
+
+static uint64_t now_ns(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ull + (uint64_t)ts.tv_nsec;
+}
+
+static void poll_sleep(void) {
+    struct timespec ts = { 0, (long)SHMRING_POLL_US * 1000L };
+    nanosleep(&ts, NULL);
+}
+
+static bool pid_alive(uint32_t pid) {
+    return pid != 0 && !(kill((pid_t)pid, 0) != 0 && errno == ESRCH);
+}
+
+// shm_open wants "/name"
+static void shm_path(const char *name, char *out, size_t cap) {
+    snprintf(out, cap, "%s%s", (name[0] == '/') ? "" : "/", name);
+}
+
+static size_t header_size(void) {
+    const size_t page = (size_t)sysconf(_SC_PAGESIZE);
+    return (sizeof(ShmRingHeader) + page - 1) / page * page;
+}
+
+// ---------------------------------------------------------------------------
+// Producer
+// ---------------------------------------------------------------------------
+
+int shmring_create(ShmRing *r, const char *name, size_t ring_bytes, const ShmRingGeometry *g) {
+    if (!r || !name || !name[0] || !g || g->bytes_per_trace == 0) return -1;
+    memset(r, 0, sizeof *r);
+    shm_path(name, r->name, sizeof r->name);
+
+    // Refuse to take over a ring another live producer is publishing into
+    int old = shm_open(r->name, O_RDONLY, 0);
+    if (old >= 0) {
+        struct stat st;
+        if (fstat(old, &st) == 0 && (size_t)st.st_size >= sizeof(ShmRingHeader)) {
+            ShmRingHeader *h = mmap(NULL, sizeof *h, PROT_READ, MAP_SHARED, old, 0);
+            if (h != MAP_FAILED) {
+                uint32_t pid = atomic_load_explicit(&h->producer_pid, memory_order_relaxed);
+                bool busy = (h->magic == SHMRING_MAGIC && pid != (uint32_t)getpid() && pid_alive(pid));
+                munmap(h, sizeof *h);
+                if (busy) {
+                    close(old);
+                    fprintf(stderr, "[engine] shm ring %s is in use by pid %u.\n", r->name, pid);
+                    return -2;
+                }
+            }
+        }
+        close(old);
+        shm_unlink(r->name); // readers of the old ring keep their mapping
+    }
+
+    // Slots hold whole traces; a trace larger than a slot gets a slot of its own
+    size_t per_slot = (ring_bytes ? ring_bytes : SHMRING_DEFAULT_BYTES) / SHMRING_SLOTS / g->bytes_per_trace;
+    if (per_slot == 0) per_slot = 1;
+    const size_t slot_bytes = per_slot * g->bytes_per_trace;
+    const size_t hdr_bytes  = header_size();
+    if (slot_bytes > (SIZE_MAX - hdr_bytes) / SHMRING_SLOTS) return -1;
+    r->map_bytes = hdr_bytes + SHMRING_SLOTS * slot_bytes;
+
+    int fd = shm_open(r->name, O_RDWR | O_CREAT | O_EXCL, 0644);
+    if (fd < 0) {
+        fprintf(stderr, "[engine] shm_open(%s) failed: %s\n", r->name, strerror(errno));
+        return -3;
+    }
+    if (ftruncate(fd, (off_t)r->map_bytes) != 0) {
+        fprintf(stderr, "[engine] shm ring %s: cannot size to %.2f MiB: %s\n",
+                r->name, r->map_bytes / 1048576.0, strerror(errno));
+        close(fd);
+        shm_unlink(r->name);
+        return -4;
+    }
+    void *p = mmap(NULL, r->map_bytes, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    close(fd);
+    if (p == MAP_FAILED) {
+        shm_unlink(r->name);
+        return -5;
+    }
+
+    r->hdr  = (ShmRingHeader*)p;
+    r->data = (uint8_t*)p + hdr_bytes;
+    ShmRingHeader *h = r->hdr;           // zero-filled by ftruncate
+    h->version          = SHMRING_VERSION;
+    h->header_bytes     = (uint32_t)hdr_bytes;
+    h->n_slots          = SHMRING_SLOTS;
+    h->slot_bytes       = slot_bytes;
+    h->bytes_per_trace  = g->bytes_per_trace;
+    h->n_samples        = g->n_samples;
+    h->n_channels       = g->n_channels;
+    h->bytes_per_sample = g->bytes_per_sample;
+    snprintf(h->channels, sizeof h->channels, "%s", g->channels ? g->channels : "");
+    atomic_store_explicit(&h->producer_pid, (uint32_t)getpid(), memory_order_relaxed);
+    atomic_store_explicit(&h->write_seq, 0, memory_order_relaxed);
+    atomic_thread_fence(memory_order_release);
+    h->magic = SHMRING_MAGIC;             // readers validate this last
+    return 0;
+}
+
+// Wait until no blocking reader still needs the record that slot reuse for s overwrites.
+// A reader still holding it after SHMRING_BLOCK_TIMEOUT_MS loses its blocking flag (it keeps
+// its entry and reads on as a lossy reader), so the wait is bounded even if a reader hangs.
+static void wait_blocking_readers(ShmRing *r, uint64_t s) {
+    ShmRingHeader *h = r->hdr;
+    if (s < h->n_slots) return;
+    const uint64_t need = s - h->n_slots + 1; // readers must be past record s - n_slots
+    uint64_t t0 = 0, last_check = 0;
+    for (;;) {
+        bool waiting = false;
+        for (int i = 0; i < SHMRING_MAX_READERS; ++i) {
+            ShmRingReader *rd = &h->readers[i];
+            const uint32_t pid = atomic_load_explicit(&rd->pid, memory_order_acquire);
+            if (!pid || !atomic_load_explicit(&rd->blocking, memory_order_relaxed)) continue;
+            if (atomic_load_explicit(&rd->next_seq, memory_order_acquire) >= need) continue;
+            const uint64_t now = now_ns();
+            if (t0 && now - last_check >= SHMRING_LIVENESS_NS && !pid_alive(pid)) {
+                uint32_t expect = pid;
+                if (atomic_compare_exchange_strong(&rd->pid, &expect, 0)) r->evicted++;
+                continue;
+            }
+            if (t0 && now - t0 >= (uint64_t)SHMRING_BLOCK_TIMEOUT_MS * 1000000ull) {
+                atomic_store_explicit(&rd->blocking, 0, memory_order_release);
+                r->demoted++;
+                fprintf(stderr, "[engine] shm ring %s: blocking reader pid %u stuck for %u ms, now lossy.\n",
+                        r->name, pid, SHMRING_BLOCK_TIMEOUT_MS);
+                continue;
+            }
+            waiting = true;
+        }
+        if (!waiting) break;
+        const uint64_t now = now_ns();
+        if (!t0) t0 = last_check = now;
+        else if (now - last_check >= SHMRING_LIVENESS_NS) last_check = now;
+        poll_sleep();
+    }
+    if (t0) r->blocked_ns += now_ns() - t0;
+}
+
+int shmring_publish(ShmRing *r, const uint8_t *src, size_t n_traces, uint64_t first_trace) {
+    if (!r || !r->hdr || (!src && n_traces)) return -1;
+    ShmRingHeader *h = r->hdr;
+    const size_t per_rec = h->slot_bytes / h->bytes_per_trace;
+
+    while (n_traces > 0) {
+        const size_t n = (n_traces < per_rec) ? n_traces : per_rec;
+        const size_t bytes = n * h->bytes_per_trace;
+        const uint64_t s = atomic_load_explicit(&h->write_seq, memory_order_relaxed);
+        wait_blocking_readers(r, s);
+
+        ShmRingSlot *slot = &h->slots[s % h->n_slots];
+        atomic_store_explicit(&slot->seq, 2 * s + 1, memory_order_relaxed);
+        atomic_thread_fence(memory_order_release);
+        memcpy(r->data + (s % h->n_slots) * h->slot_bytes, src, bytes);
+        slot->first_trace = first_trace;
+        slot->n_traces    = n;
+        slot->bytes       = bytes;
+        atomic_store_explicit(&slot->seq, 2 * s + 2, memory_order_release);
+        atomic_store_explicit(&h->write_seq, s + 1, memory_order_release);
+
+        r->records++;
+        src         += bytes;
+        first_trace += n;
+        n_traces    -= n;
+    }
+    return 0;
+}
+
+void shmring_close(ShmRing *r, bool unlink) {
+    if (!r || !r->hdr) return;
+    atomic_store_explicit(&r->hdr->producer_pid, 0, memory_order_release);
+    munmap(r->hdr, r->map_bytes);
+    if (unlink) shm_unlink(r->name);
+    r->hdr  = NULL;
+    r->data = NULL;
+}
+
+// ---------------------------------------------------------------------------
+// Consumer
+// ---------------------------------------------------------------------------
+
+int shmring_attach(ShmRingConsumer *c, const char *name, bool blocking) {
+    if (!c || !name || !name[0]) return -1;
+    memset(c, 0, sizeof *c);
+    c->reader = -1;
+    char path[128];
+    shm_path(name, path, sizeof path);
+
+    int fd = shm_open(path, O_RDWR, 0);
+    if (fd < 0) return -2;
+    struct stat st;
+    if (fstat(fd, &st) != 0 || (size_t)st.st_size < sizeof(ShmRingHeader)) { close(fd); return -3; }
+    void *p = mmap(NULL, (size_t)st.st_size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    close(fd);
+    if (p == MAP_FAILED) return -4;
+
+    ShmRingHeader *h = (ShmRingHeader*)p;
+    if (h->magic != SHMRING_MAGIC || h->version != SHMRING_VERSION || h->n_slots == 0 ||
+        (uint64_t)h->header_bytes + (uint64_t)h->n_slots * h->slot_bytes > (uint64_t)st.st_size) {
+        munmap(p, (size_t)st.st_size);
+        return -5;
+    }
+    atomic_thread_fence(memory_order_acquire);
+
+    // Claim a reader entry (free, or left behind by a dead reader)
+    const uint32_t me = (uint32_t)getpid();
+    for (int i = 0; i < SHMRING_MAX_READERS && c->reader < 0; ++i) {
+        ShmRingReader *rd = &h->readers[i];
+        uint32_t pid = atomic_load_explicit(&rd->pid, memory_order_relaxed);
+        if (pid && pid_alive(pid)) continue;
+        atomic_store_explicit(&rd->blocking, 0, memory_order_relaxed);
+        if (!atomic_compare_exchange_strong(&rd->pid, &pid, me)) continue;
+        c->next_seq = atomic_load_explicit(&h->write_seq, memory_order_acquire);
+        atomic_store_explicit(&rd->next_seq, c->next_seq, memory_order_release);
+        atomic_store_explicit(&rd->blocking, blocking ? 1u : 0u, memory_order_release);
+        c->reader = i;
+    }
+    if (c->reader < 0) {
+        munmap(p, (size_t)st.st_size);
+        return -6; // SHMRING_MAX_READERS attached
+    }
+
+    c->hdr       = h;
+    c->data      = (const uint8_t*)p + h->header_bytes;
+    c->map_bytes = (size_t)st.st_size;
+    return 0;
+}
+
+int shmring_next(ShmRingConsumer *c, ShmRingRecord *rec, int timeout_ms) {
+    if (!c || !c->hdr || !rec) return -2;
+    ShmRingHeader *h = (ShmRingHeader*)c->hdr;
+    ShmRingReader *rd = &h->readers[c->reader];
+    const uint64_t t0 = now_ns();
+    uint64_t last_check = t0;
+
+    for (;;) {
+        const uint64_t ws = atomic_load_explicit(&h->write_seq, memory_order_acquire);
+        if (c->next_seq >= ws) {
+            const uint32_t pid = atomic_load_explicit(&h->producer_pid, memory_order_acquire);
+            const uint64_t now = now_ns();
+            if (pid == 0) return -1;
+            if (now - last_check >= SHMRING_LIVENESS_NS) {
+                if (!pid_alive(pid)) return -1;
+                last_check = now;
+            }
+            if (timeout_ms >= 0 && now - t0 >= (uint64_t)timeout_ms * 1000000ull) return 0;
+            poll_sleep();
+            continue;
+        }
+
+        // Lossy reader more than a ring behind: jump to the oldest record still there
+        if (ws - c->next_seq > h->n_slots) {
+            c->lost += ws - h->n_slots - c->next_seq;
+            c->next_seq = ws - h->n_slots;
+            atomic_store_explicit(&rd->next_seq, c->next_seq, memory_order_release);
+        }
+
+        const uint64_t s = c->next_seq;
+        const ShmRingSlot *slot = &h->slots[s % h->n_slots];
+        if (atomic_load_explicit(&slot->seq, memory_order_acquire) != 2 * s + 2) {
+            c->lost++; // overwritten since write_seq was read
+            c->next_seq = s + 1;
+            continue;
+        }
+        rec->seq         = s;
+        rec->first_trace = slot->first_trace;
+        rec->n_traces    = slot->n_traces;
+        rec->bytes       = slot->bytes;
+        rec->data        = c->data + (s % h->n_slots) * h->slot_bytes;
+        return 1;
+    }
+}
+
+int shmring_release(ShmRingConsumer *c, const ShmRingRecord *rec) {
+    if (!c || !c->hdr || !rec) return -2;
+    ShmRingHeader *h = (ShmRingHeader*)c->hdr;
+    atomic_thread_fence(memory_order_acquire);
+    const bool intact = (atomic_load_explicit(&h->slots[rec->seq % h->n_slots].seq, memory_order_relaxed)
+                         == 2 * rec->seq + 2);
+    if (!intact) c->lost++;
+    c->next_seq = rec->seq + 1;
+    atomic_store_explicit(&h->readers[c->reader].next_seq, c->next_seq, memory_order_release);
+    return intact ? 0 : -1;
+}
+
+void shmring_detach(ShmRingConsumer *c) {
+    if (!c || !c->hdr) return;
+    ShmRingHeader *h = (ShmRingHeader*)c->hdr;
+    if (c->reader >= 0) atomic_store_explicit(&h->readers[c->reader].pid, 0, memory_order_release);
+    munmap((void*)c->hdr, c->map_bytes);
+    c->hdr  = NULL;
+    c->data = NULL;
+}
@@ -0,0 +1,151 @@
+#ifndef SHMRING_H
+#define SHMRING_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <stdatomic.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* Shared-memory trace ring (--shm <name>): the engine publishes every batch into
+   POSIX shared memory (/dev/shm/<name> on Linux) so live consumers in other processes see
+   traces as they are captured, without the .bin and without copies on their side.
+
+   Layout: a page-aligned ShmRingHeader, then n_slots slots of slot_bytes each. A batch is
+   published as one or more records of whole traces; record s lives in slot s % n_slots.
+   Each slot carries a sequence word (seqlock): 2s+1 while record s is being copied in,
+   2s+2 once complete. write_seq counts the records published so far.
+
+   Readers attach/detach at any time and pick a policy:
+   - lossy:    the producer never waits; a reader that falls more than n_slots behind skips
+               ahead (counted in ShmRingConsumer.lost), and a record overwritten while it
+               was being read fails shmring_release().
+   - blocking: the producer does not overwrite a record until this reader released it.
+               A blocking reader that dies is evicted (pid check). One that holds a record
+               for longer than SHMRING_BLOCK_TIMEOUT_MS is demoted to lossy, so a hung
+               reader stalls the producer once, for a bounded time. */
+
+#define SHMRING_MAGIC   0x47524353u  // "SCRG"
+#define SHMRING_VERSION 1u
+
+#ifndef SHMRING_SLOTS
+#define SHMRING_SLOTS 8
+#endif
+#ifndef SHMRING_MAX_READERS
+#define SHMRING_MAX_READERS 16
+#endif
+#ifndef SHMRING_DEFAULT_BYTES
+#define SHMRING_DEFAULT_BYTES ((size_t)64 << 20)   // data area, all slots
+#endif
+#ifndef SHMRING_POLL_US
+#define SHMRING_POLL_US 100u                       // reader wait / blocked producer poll period
+#endif
+#ifndef SHMRING_BLOCK_TIMEOUT_MS
+#define SHMRING_BLOCK_TIMEOUT_MS 2000u             // longest wait for one blocking reader, then demoted
+#endif
+
+typedef struct ShmRingSlot {
+    _Atomic uint64_t seq;          // 0 empty, 2s+1 record s in progress, 2s+2 record s complete
+    uint64_t first_trace;          // run-wide index of the record's first trace
+    uint64_t n_traces;
+    uint64_t bytes;
+} ShmRingSlot;
+
+typedef struct ShmRingReader {
+    _Atomic uint32_t pid;          // 0 => entry free
+    _Atomic uint32_t blocking;
+    _Atomic uint64_t next_seq;     // first record this reader has not released
+} ShmRingReader;
+
+typedef struct ShmRingHeader {
+    uint32_t magic;
+    uint32_t version;
+    uint32_t header_bytes;         // slot i data at header_bytes + i * slot_bytes
+    uint32_t n_slots;
+    uint64_t slot_bytes;           // whole traces
+    uint64_t bytes_per_trace;
+    uint64_t n_samples;            // per channel
+    uint32_t n_channels;
+    uint32_t bytes_per_sample;
+    char     channels[256];        // "CHAN1,CHAN2"; samples are channel-major within a trace
+    _Atomic uint64_t write_seq;    // records published so far
+    _Atomic uint32_t producer_pid; // 0 once the producer closed the ring
+    _Atomic uint32_t reserved;
+    ShmRingSlot   slots[SHMRING_SLOTS];
+    ShmRingReader readers[SHMRING_MAX_READERS];
+} ShmRingHeader;
+
+// ---------------------------------------------------------------------------
+// Producer (engine)
+// ---------------------------------------------------------------------------
+typedef struct ShmRing {
+    ShmRingHeader *hdr;
+    uint8_t       *data;
+    size_t         map_bytes;
+    char           name[128];
+    uint64_t       records;        // published
+    uint64_t       blocked_ns;     // waiting for blocking readers
+    uint64_t       evicted;        // dead blocking readers dropped
+    uint64_t       demoted;        // blocking readers made lossy after SHMRING_BLOCK_TIMEOUT_MS
+} ShmRing;
+
+typedef struct ShmRingGeometry {
+    size_t      bytes_per_trace;
+    size_t      n_samples;
+    unsigned    n_channels;
+    unsigned    bytes_per_sample;
+    const char *channels;
+} ShmRingGeometry;
+
+/* (Re)create the ring "name" (a leading '/' is optional) with ~ring_bytes of slots.
+   Readers still mapping an older ring see its producer_pid drop to 0. 0 ok, <0 err */
+int  shmring_create(ShmRing *r, const char *name, size_t ring_bytes, const ShmRingGeometry *g);
+
+/* Publish n_traces contiguous traces, the first being trace first_trace of the run.
+   Split into records of at most slot_bytes. 0 ok, <0 err */
+int  shmring_publish(ShmRing *r, const uint8_t *src, size_t n_traces, uint64_t first_trace);
+
+/* Mark the ring closed and unmap it; unlink => remove the name (mapped readers keep it) */
+void shmring_close(ShmRing *r, bool unlink);
+
+// ---------------------------------------------------------------------------
+// Consumer library (other processes): only needs this header and shmring.c
+// ---------------------------------------------------------------------------
+typedef struct ShmRingConsumer {
+    const ShmRingHeader *hdr;
+    const uint8_t       *data;
+    size_t               map_bytes;
+    int                  reader;   // index in hdr->readers
+    uint64_t             next_seq;
+    uint64_t             lost;     // records skipped (lossy readers only)
+} ShmRingConsumer;
+
+typedef struct ShmRingRecord {
+    const uint8_t *data;           // n_traces * bytes_per_trace bytes inside the mapping
+    uint64_t       seq;
+    uint64_t       first_trace;
+    uint64_t       n_traces;
+    uint64_t       bytes;
+} ShmRingRecord;
+
+/* Map the ring and register as a reader, starting at the next record. 0 ok, <0 err */
+int  shmring_attach(ShmRingConsumer *c, const char *name, bool blocking);
+
+/* Wait up to timeout_ms (<0 => forever) for the next record; rec->data points into
+   shared memory (no copy). 1 record, 0 timeout, -1 producer gone, <-1 err */
+int  shmring_next(ShmRingConsumer *c, ShmRingRecord *rec, int timeout_ms);
+
+/* Done with rec. 0 => the data read was intact; -1 => the producer overwrote it
+   meanwhile (lossy reader too slow): discard what was read */
+int  shmring_release(ShmRingConsumer *c, const ShmRingRecord *rec);
+
+void shmring_detach(ShmRingConsumer *c);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // SHMRING_H
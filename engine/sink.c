@@ -0,0 +1,463 @@
+#define _GNU_SOURCE
+#include "sink.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#define SINK_WAIT_MS 50 // producer re-checks its stop condition while waiting for a buffer
+
+// Header of every batch in a spill file; the traces follow
+typedef struct SpillRecord {
+    uint64_t first_trace;
+    uint64_t n_traces;
+} SpillRecord;
+
+static uint64_t now_ns(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ull + (uint64_t)ts.tv_nsec;
+}
+
+static int pwrite_all(int fd, const void *buf, size_t len, uint64_t off) {
+    const uint8_t *p = (const uint8_t*)buf;
+    while (len > 0) {
+        ssize_t w = pwrite(fd, p, len, (off_t)off);
+        if (w < 0) {
+            if (errno == EINTR) continue;
+            return -1;
+        }
+        p += w; off += (uint64_t)w; len -= (size_t)w;
+    }
+    return 0;
+}
+
+static int pread_all(int fd, void *buf, size_t len, uint64_t off) {
+    uint8_t *p = (uint8_t*)buf;
+    while (len > 0) {
+        ssize_t r = pread(fd, p, len, (off_t)off);
+        if (r < 0) {
+            if (errno == EINTR) continue;
+            return -1;
+        }
+        if (r == 0) return -1;
+        p += r; off += (uint64_t)r; len -= (size_t)r;
+    }
+    return 0;
+}
+
+// --- FIFO of waiting batches (all below: mutex held) ---
+
+static void queue_push(Sink *s, SinkBatch *b) {
+    s->queue[(s->q_head + s->q_len) % SINK_MAX_BUFS] = b;
+    if (++s->q_len > s->queue_max) s->queue_max = s->q_len;
+}
+
+static SinkBatch *queue_pop(Sink *s) {
+    SinkBatch *b = s->queue[s->q_head];
+    s->q_head = (s->q_head + 1) % SINK_MAX_BUFS;
+    s->q_len--;
+    return b;
+}
+
+static bool queue_has(const Sink *s, const SinkBatch *b) {
+    for (unsigned i = 0; i < s->q_len; ++i) {
+        if (s->queue[(s->q_head + i) % SINK_MAX_BUFS] == b) return true;
+    }
+    return false;
+}
+
+static void queue_remove(Sink *s, const SinkBatch *b) {
+    unsigned kept = 0;
+    for (unsigned i = 0; i < s->q_len; ++i) {
+        SinkBatch *e = s->queue[(s->q_head + i) % SINK_MAX_BUFS];
+        if (e != b) s->queue[(s->q_head + kept++) % SINK_MAX_BUFS] = e;
+    }
+    s->q_len = kept;
+}
+
+static void batch_release(SinkFanout *f, SinkBatch *b) {
+    if (--b->refs > 0) return;
+    if (f->retired) f->retired(f->hook_ctx, b->n_traces);
+    pthread_cond_signal(&f->cv_free);
+}
+
+static void drop(Sink *s, const SinkBatch *b) {
+    s->dropped_batches++;
+    s->dropped_traces += b->n_traces;
+}
+
+// Hand b (and its reference) to the spill thread of s, behind the backlog
+static void spill(SinkFanout *f, Sink *s, SinkBatch *b) {
+    s->spill_q[(s->sq_head + s->sq_len) % SINK_MAX_BUFS] = b;
+    s->sq_len++;
+    pthread_cond_broadcast(&f->cv_work);
+}
+
+static SinkBatch *spill_pop(Sink *s) {
+    SinkBatch *b = s->spill_q[s->sq_head];
+    s->sq_head = (s->sq_head + 1) % SINK_MAX_BUFS;
+    s->sq_len--;
+    return b;
+}
+
+// Batches on their way into the spill file: the backlog is not complete without them
+static bool spill_inflight(const Sink *s) {
+    return s->sq_len > 0 || s->spilling;
+}
+
+// The oldest backlog batch can be delivered: from the file, or still in memory when
+// nothing older is on its way there
+static bool spill_ready(const Sink *s) {
+    return s->spill_pending > 0 || (s->sq_len > 0 && !s->spilling);
+}
+
+// Give up waiting batches of a drop/spill sink, oldest first, until keep are left.
+// Spill sinks move them into the backlog, which therefore always holds the newest batches.
+static void shed(SinkFanout *f, Sink *s, unsigned keep) {
+    while (s->q_len > keep) {
+        SinkBatch *b = queue_pop(s);
+        if (s->policy == SINK_SPILL) {
+            spill(f, s, b);
+            continue;
+        }
+        drop(s, b);
+        batch_release(f, b);
+    }
+}
+
+static SinkBatch *find_free(SinkFanout *f) {
+    for (unsigned i = 0; i < f->n_bufs; ++i) {
+        if (!f->bufs[i].filling && f->bufs[i].refs == 0) return &f->bufs[i];
+    }
+    return NULL;
+}
+
+// A buffer held only by batches waiting on drop/spill sinks can be taken back (once
+// spilled, for spill sinks)
+static SinkBatch *reclaim(SinkFanout *f) {
+    for (unsigned i = 0; i < f->n_bufs; ++i) {
+        SinkBatch *b = &f->bufs[i];
+        if (b->filling || b->refs == 0) continue;
+        bool pinned = false;
+        for (unsigned k = 0; k < f->n_sinks && !pinned; ++k) {
+            const Sink *s = &f->sinks[k];
+            pinned = (s->active == b) || (s->policy == SINK_BLOCK && queue_has(s, b));
+        }
+        if (pinned) continue;
+        for (unsigned k = 0; k < f->n_sinks; ++k) {
+            Sink *s = &f->sinks[k];
+            if (s->policy == SINK_BLOCK || !queue_has(s, b)) continue;
+            if (s->policy == SINK_SPILL) {
+                shed(f, s, 0); // keeps the backlog in order
+            } else {
+                queue_remove(s, b);
+                drop(s, b);
+                batch_release(f, b);
+            }
+        }
+        if (b->refs == 0) return b;
+    }
+    return NULL;
+}
+
+// Sink failed: release everything it still holds and stop delivering to it
+static void detach(SinkFanout *f, Sink *s) {
+    s->gone = true;
+    while (s->q_len > 0) {
+        SinkBatch *b = queue_pop(s);
+        drop(s, b);
+        batch_release(f, b);
+    }
+    while (s->sq_len > 0) { // the one being spilled is released by the spill thread
+        SinkBatch *b = spill_pop(s);
+        drop(s, b);
+        batch_release(f, b);
+    }
+    s->dropped_batches += s->spill_pending;
+    s->dropped_traces  += s->spill_pending_traces;
+    s->spill_pending = s->spill_pending_traces = 0;
+}
+
+// Spill sinks: appends shed batches to the backlog file, off the producer and outside the
+// mutex. A failing spill file (disk full) loses the batch instead.
+static void *spill_thread(void *arg) {
+    Sink *s = (Sink*)arg;
+    SinkFanout *f = s->owner;
+    if (f->thread_init) {
+        char name[24];
+        snprintf(name, sizeof name, "%s-spill", s->name);
+        f->thread_init(f->hook_ctx, name);
+    }
+
+    pthread_mutex_lock(&f->mutex);
+    for (;;) {
+        while (s->sq_len == 0 && !f->closing) pthread_cond_wait(&f->cv_work, &f->mutex);
+        if (s->sq_len == 0) break; // closing, all appended
+
+        SinkBatch *b = spill_pop(s);
+        s->spilling = b;
+        const uint64_t off = s->spill_wr; // only this thread moves spill_wr while spilling
+        pthread_mutex_unlock(&f->mutex);
+
+        const SpillRecord rec = { b->first_trace, b->n_traces };
+        const size_t len = b->n_traces * f->bytes_per_trace;
+        const int rc = (s->spill_fd >= 0 && pwrite_all(s->spill_fd, &rec, sizeof rec, off) == 0 &&
+                        pwrite_all(s->spill_fd, b->data, len, off + sizeof rec) == 0) ? 0 : -1;
+
+        pthread_mutex_lock(&f->mutex);
+        s->spilling = NULL;
+        if (s->gone) {
+            // detached meanwhile: the batch was counted then
+        } else if (rc == 0) {
+            s->spill_wr += sizeof rec + len;
+            s->spill_pending++;
+            s->spill_pending_traces += b->n_traces;
+            s->spilled_batches++;
+            s->spilled_bytes += len;
+        } else {
+            drop(s, b);
+        }
+        batch_release(f, b);
+        pthread_cond_broadcast(&f->cv_work); // the sink may be waiting for its backlog
+    }
+    pthread_mutex_unlock(&f->mutex);
+    return NULL;
+}
+
+static void *sink_thread(void *arg) {
+    Sink *s = (Sink*)arg;
+    SinkFanout *f = s->owner;
+    if (f->thread_init) f->thread_init(f->hook_ctx, s->name);
+
+    pthread_mutex_lock(&f->mutex);
+    for (;;) {
+        while (s->q_len == 0 && !spill_ready(s) && (!f->closing || spill_inflight(s))) {
+            pthread_cond_wait(&f->cv_work, &f->mutex);
+        }
+        if (s->q_len == 0 && !spill_ready(s)) break; // closing, all delivered
+        if (f->closing && s->policy != SINK_BLOCK && now_ns() >= f->close_deadline_ns) {
+            fprintf(stderr, "[engine] sink %s still behind %u ms after the run; dropping the rest.\n",
+                    s->name, SINK_CLOSE_MS);
+            detach(f, s);
+            break;
+        }
+
+        // Waiting batches are older than the spill backlog, whose file records are older
+        // than the batches the spill thread has not taken yet
+        SinkBatch *b = NULL;
+        SpillRecord rec = {0};
+        const uint8_t *src;
+        int rc = 0;
+        if (s->q_len > 0 || s->spill_pending == 0) {
+            b = (s->q_len > 0) ? queue_pop(s) : spill_pop(s); // the latter skips the file
+            s->active = b;
+            rec.first_trace = b->first_trace;
+            rec.n_traces    = b->n_traces;
+            src = b->data;
+            pthread_mutex_unlock(&f->mutex);
+        } else {
+            const uint64_t off = s->spill_rd; // complete record: the spill thread only appends
+            pthread_mutex_unlock(&f->mutex);
+            src = s->spill_buf;
+            if (pread_all(s->spill_fd, &rec, sizeof rec, off) != 0 ||
+                rec.n_traces * f->bytes_per_trace > f->buf_bytes ||
+                pread_all(s->spill_fd, s->spill_buf, rec.n_traces * f->bytes_per_trace, off + sizeof rec) != 0) {
+                fprintf(stderr, "[engine] sink %s: cannot read back its spill file.\n", s->name);
+                rc = -1;
+            }
+        }
+
+        const uint64_t t0 = now_ns();
+        if (rc == 0) rc = s->write(s->ctx, src, rec.n_traces, rec.first_trace);
+        const uint64_t dt = now_ns() - t0;
+
+        pthread_mutex_lock(&f->mutex);
+        s->busy_ns += dt;
+        if (dt > s->busy_ns_max) s->busy_ns_max = dt;
+        if (rc == 0) {
+            s->batches++;
+            s->traces += rec.n_traces;
+        }
+        if (s->policy == SINK_BLOCK) {
+            f->last_block_ns     = dt;
+            f->last_block_traces = rec.n_traces;
+        }
+        if (b) {
+            s->active = NULL;
+            batch_release(f, b);
+        } else if (rc == 0) { // a failed record stays in the backlog, which detach() counts as dropped
+            s->spill_rd += sizeof rec + rec.n_traces * f->bytes_per_trace;
+            s->spill_pending_traces -= rec.n_traces;
+            if (--s->spill_pending == 0 && !spill_inflight(s)) { // drained: reuse the file from the start
+                s->spill_rd = s->spill_wr = 0;
+                (void)ftruncate(s->spill_fd, 0);
+            }
+        }
+        if (rc != 0) {
+            fprintf(stderr, "[engine] sink %s failed after %llu batches; no longer delivering to it.\n",
+                    s->name, (unsigned long long)s->batches);
+            detach(f, s);
+            break;
+        }
+    }
+    pthread_mutex_unlock(&f->mutex);
+    return NULL;
+}
+
+int sink_fanout_init(SinkFanout *f, uint8_t *const *bufs, unsigned n_bufs, size_t buf_bytes, size_t bytes_per_trace) {
+    if (!f) return -1;
+    memset(f, 0, sizeof *f);
+    if (!bufs || n_bufs == 0 || n_bufs > SINK_MAX_BUFS || bytes_per_trace == 0) return -1;
+    for (unsigned i = 0; i < n_bufs; ++i) {
+        if (!bufs[i]) return -1;
+        f->bufs[i].data = bufs[i];
+    }
+    f->n_bufs          = n_bufs;
+    f->buf_bytes       = buf_bytes;
+    f->bytes_per_trace = bytes_per_trace;
+    pthread_mutex_init(&f->mutex, NULL);
+    pthread_cond_init(&f->cv_free, NULL);
+    pthread_cond_init(&f->cv_work, NULL);
+    return 0;
+}
+
+int sink_add(SinkFanout *f, const char *name, SinkWriteFn write, void *ctx, SinkPolicy policy, const char *spill_dir) {
+    if (!f || !write || f->n_sinks >= SINK_MAX) return -1;
+    Sink *s = &f->sinks[f->n_sinks];
+    memset(s, 0, sizeof *s);
+    s->owner    = f;
+    s->write    = write;
+    s->ctx      = ctx;
+    s->policy   = (uint8_t)policy;
+    s->spill_fd = -1;
+    snprintf(s->name, sizeof s->name, "%s", name ? name : "sink");
+
+    if (policy == SINK_SPILL) {
+        // Anonymous backlog file: unlinked at once, gone with the process
+        char path[4096];
+        snprintf(path, sizeof path, "%s/.scope-spill-XXXXXX", (spill_dir && spill_dir[0]) ? spill_dir : "/tmp");
+        s->spill_fd  = mkstemp(path);
+        s->spill_buf = malloc(f->buf_bytes ? f->buf_bytes : 1);
+        if (s->spill_fd < 0 || !s->spill_buf) {
+            fprintf(stderr, "[engine] sink %s: no spill file in %s (%s).\n", s->name,
+                    (spill_dir && spill_dir[0]) ? spill_dir : "/tmp", strerror(errno));
+            if (s->spill_fd >= 0) { close(s->spill_fd); unlink(path); }
+            free(s->spill_buf);
+            return -2;
+        }
+        unlink(path);
+    }
+    return (int)f->n_sinks++;
+}
+
+int sink_fanout_start(SinkFanout *f) {
+    if (!f) return -1;
+    for (unsigned i = 0; i < f->n_sinks; ++i) {
+        Sink *s = &f->sinks[i];
+        if (pthread_create(&s->thread, NULL, sink_thread, s) == 0) {
+            s->running = true;
+            if (s->policy != SINK_SPILL || pthread_create(&s->spill_thread, NULL, spill_thread, s) == 0) {
+                s->spill_running = (s->policy == SINK_SPILL);
+                continue;
+            }
+        }
+        fprintf(stderr, "[engine] pthread_create of sink %s failed.\n", s->name);
+        pthread_mutex_lock(&f->mutex);
+        f->closing = true;
+        pthread_cond_broadcast(&f->cv_work);
+        pthread_mutex_unlock(&f->mutex);
+        for (unsigned k = 0; k <= i; ++k) {
+            Sink *o = &f->sinks[k];
+            if (o->running) pthread_join(o->thread, NULL);
+            if (o->spill_running) pthread_join(o->spill_thread, NULL);
+            o->running = o->spill_running = false;
+        }
+        return -2;
+    }
+    return 0;
+}
+
+SinkBatch *sink_fanout_acquire(SinkFanout *f, bool (*stop)(void *ctx), void *stop_ctx, uint64_t *waited_ns) {
+    if (waited_ns) *waited_ns = 0;
+    if (!f) return NULL;
+    uint64_t t0 = 0;
+    pthread_mutex_lock(&f->mutex);
+    SinkBatch *b;
+    for (;;) {
+        b = find_free(f);
+        if (!b) b = reclaim(f);
+        if (b) {
+            b->filling  = true;
+            b->n_traces = 0;
+            break;
+        }
+        if (stop && stop(stop_ctx)) break;
+        if (!t0) {
+            t0 = now_ns();
+            f->acquire_waits++;
+        }
+        struct timespec dl;
+        clock_gettime(CLOCK_REALTIME, &dl);
+        dl.tv_nsec += SINK_WAIT_MS * 1000000L;
+        if (dl.tv_nsec >= 1000000000L) { dl.tv_sec++; dl.tv_nsec -= 1000000000L; }
+        (void)pthread_cond_timedwait(&f->cv_free, &f->mutex, &dl);
+    }
+    pthread_mutex_unlock(&f->mutex);
+    if (t0 && waited_ns) *waited_ns = now_ns() - t0;
+    return b;
+}
+
+void sink_fanout_submit(SinkFanout *f, SinkBatch *b, size_t n_traces, uint64_t first_trace) {
+    if (!f || !b) return;
+    pthread_mutex_lock(&f->mutex);
+    b->filling     = false;
+    b->n_traces    = n_traces;
+    b->first_trace = first_trace;
+    b->refs        = 0;
+    if (n_traces > 0) {
+        const unsigned depth = SINK_QUEUE_DEPTH ? SINK_QUEUE_DEPTH : 1u;
+        for (unsigned i = 0; i < f->n_sinks; ++i) {
+            Sink *s = &f->sinks[i];
+            if (s->gone) continue;
+            b->refs++;
+            if (s->policy == SINK_SPILL && (s->spill_pending > 0 || spill_inflight(s) || s->q_len >= depth)) {
+                shed(f, s, 0);
+                spill(f, s, b);
+                continue;
+            }
+            if (s->policy == SINK_DROP && s->q_len >= depth) shed(f, s, depth - 1);
+            queue_push(s, b);
+        }
+        if (b->refs == 0 && f->retired) f->retired(f->hook_ctx, n_traces); // no sinks left
+        pthread_cond_broadcast(&f->cv_work);
+    }
+    pthread_mutex_unlock(&f->mutex);
+}
+
+void sink_fanout_close(SinkFanout *f) {
+    if (!f || f->n_bufs == 0) return;
+    pthread_mutex_lock(&f->mutex);
+    f->closing = true;
+    f->close_deadline_ns = now_ns() + (uint64_t)SINK_CLOSE_MS * 1000000ull;
+    pthread_cond_broadcast(&f->cv_work);
+    pthread_mutex_unlock(&f->mutex);
+    for (unsigned i = 0; i < f->n_sinks; ++i) {
+        Sink *s = &f->sinks[i];
+        if (s->running) pthread_join(s->thread, NULL);
+        if (s->spill_running) pthread_join(s->spill_thread, NULL);
+        s->running = s->spill_running = false;
+        if (s->spill_fd >= 0) close(s->spill_fd);
+        s->spill_fd = -1;
+        free(s->spill_buf);
+        s->spill_buf = NULL;
+    }
+    pthread_cond_destroy(&f->cv_work);
+    pthread_cond_destroy(&f->cv_free);
+    pthread_mutex_destroy(&f->mutex);
+    f->n_bufs = 0;
+}
@@ -0,0 +1,157 @@
+#ifndef SINK_H
+#define SINK_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <pthread.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* Batch fan-out: the producer fills pool buffers and hands every full batch to all sinks
+   by reference; a buffer is filled again once each sink has released it. Every sink has
+   its own thread, FIFO and policy:
+   - block: sees every batch. A sink that falls behind keeps its buffers until the producer
+            runs out and waits (the .bin, or anything that must be complete).
+   - drop:  at most SINK_QUEUE_DEPTH batches wait behind the one in progress; beyond that,
+            and whenever the producer needs their buffer, the oldest waiting batch is
+            dropped for this sink.
+   - spill: like drop, but the batch is appended to an unlinked temp file instead and
+            replayed in order later. The copy into the page cache runs on the sink's own
+            spill thread, outside the mutex; the buffer is released once it is done.
+   A drop sink holds at most the one batch it is working on, so a pool of 2 + (drop/spill
+   sinks) buffers never makes the producer wait for it. A spill sink also holds batches
+   until its spill thread has copied them, so the producer waits only if spilling is
+   slower than the acquisition.
+   Closing lets block sinks deliver everything; drop/spill sinks get SINK_CLOSE_MS and then
+   drop what they still hold. A sink's write must return in bounded time (the socket and
+   shm sinks give up on a stalled reader), so closing never hangs on a sink. */
+
+#ifndef SINK_MAX
+#define SINK_MAX 8
+#endif
+#ifndef SINK_MAX_BUFS
+#define SINK_MAX_BUFS (2 + SINK_MAX)
+#endif
+#ifndef SINK_QUEUE_DEPTH
+#define SINK_QUEUE_DEPTH 1u
+#endif
+#ifndef SINK_CLOSE_MS
+#define SINK_CLOSE_MS 30000u           // drop/spill sinks: time to catch up once closing
+#endif
+
+typedef enum {
+    SINK_BLOCK = 0,
+    SINK_DROP,
+    SINK_SPILL,
+} SinkPolicy;
+
+static inline const char *sink_policy_name(uint8_t p) {
+    return (p == SINK_DROP) ? "drop" : (p == SINK_SPILL) ? "spill" : "block";
+}
+
+/* Deliver n_traces contiguous traces, the first being trace first_trace of the run.
+   Runs on the sink's thread. 0 ok, <0 => the sink failed and gets no further batches */
+typedef int (*SinkWriteFn)(void *ctx, const uint8_t *src, size_t n_traces, uint64_t first_trace);
+
+typedef struct SinkBatch {
+    uint8_t *data;
+    size_t   n_traces;
+    uint64_t first_trace;
+    unsigned refs;                 // sinks that still need it
+    bool     filling;              // handed out by sink_fanout_acquire, not yet submitted
+} SinkBatch;
+
+typedef struct SinkFanout SinkFanout;
+
+typedef struct Sink {
+    SinkFanout *owner;
+    char        name[16];          // also the thread name in --trace timelines
+    SinkWriteFn write;
+    void       *ctx;
+    uint8_t     policy;            // SinkPolicy
+    pthread_t   thread;
+    bool        running;
+    bool        gone;              // write failed
+
+    SinkBatch  *queue[SINK_MAX_BUFS]; // waiting batches, oldest first
+    unsigned    q_head, q_len;
+    SinkBatch  *active;            // in progress
+
+    // spill backlog: records [spill_rd, spill_wr) of spill_fd, replayed after the queue,
+    // then the batches still waiting for the spill thread (newest last)
+    int         spill_fd;
+    uint8_t    *spill_buf;         // one batch, read back from the file
+    uint64_t    spill_rd, spill_wr;
+    uint64_t    spill_pending;     // records not yet replayed ...
+    uint64_t    spill_pending_traces; // ... and their traces
+    SinkBatch  *spill_q[SINK_MAX_BUFS]; // to be appended, oldest first
+    unsigned    sq_head, sq_len;
+    SinkBatch  *spilling;          // being appended
+    pthread_t   spill_thread;
+    bool        spill_running;
+
+    // Stats
+    uint64_t    batches, traces;   // delivered
+    uint64_t    dropped_batches, dropped_traces;
+    uint64_t    spilled_batches, spilled_bytes;
+    uint64_t    busy_ns, busy_ns_max; // inside write()
+    unsigned    queue_max;         // deepest FIFO seen
+} Sink;
+
+struct SinkFanout {
+    pthread_mutex_t mutex;
+    pthread_cond_t  cv_free;       // producer: a buffer was released
+    pthread_cond_t  cv_work;       // sinks: new batch, or closing
+
+    SinkBatch bufs[SINK_MAX_BUFS];
+    unsigned  n_bufs;
+    size_t    buf_bytes;
+    size_t    bytes_per_trace;
+
+    Sink      sinks[SINK_MAX];
+    unsigned  n_sinks;
+    bool      closing;
+    uint64_t  close_deadline_ns;   // closing: drop/spill sinks stop delivering after this
+
+    // Hooks (optional): per sink thread at start; per batch once every sink is done with it
+    void    (*thread_init)(void *ctx, const char *name);
+    void    (*retired)(void *ctx, size_t n_traces);
+    void     *hook_ctx;
+
+    // Producer side
+    uint64_t  acquire_waits;       // sink_fanout_acquire found no free buffer
+    uint64_t  last_block_ns;       // duration of the latest batch on a block sink ...
+    size_t    last_block_traces;   // ... and its size (writer bandwidth for --batch auto)
+};
+
+/* n_bufs buffers of buf_bytes each (owned by the caller). 0 ok, <0 err */
+int  sink_fanout_init(SinkFanout *f, uint8_t *const *bufs, unsigned n_bufs, size_t buf_bytes, size_t bytes_per_trace);
+
+/* Register a sink before sink_fanout_start. spill_dir: where SINK_SPILL keeps its backlog
+   (NULL => /tmp). Index, or <0 err */
+int  sink_add(SinkFanout *f, const char *name, SinkWriteFn write, void *ctx, SinkPolicy policy, const char *spill_dir);
+
+/* Start one thread per sink, plus a spill thread per spill sink. 0 ok, <0 err (nothing
+   left running) */
+int  sink_fanout_start(SinkFanout *f);
+
+/* Producer: a free buffer to fill, waiting while every buffer is held by a sink.
+   stop(stop_ctx) is polled while waiting; NULL when it returned true. *waited_ns gets
+   the time spent waiting (0 if a buffer was free) */
+SinkBatch *sink_fanout_acquire(SinkFanout *f, bool (*stop)(void *ctx), void *stop_ctx, uint64_t *waited_ns);
+
+/* Producer: hand b (n_traces full traces) to every sink; n_traces == 0 just gives it back */
+void sink_fanout_submit(SinkFanout *f, SinkBatch *b, size_t n_traces, uint64_t first_trace);
+
+/* Let every sink finish its queue and backlog (drop/spill sinks: for up to SINK_CLOSE_MS),
+   then join the threads and drop spill files */
+void sink_fanout_close(SinkFanout *f);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // SINK_H
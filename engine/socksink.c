@@ -0,0 +1,429 @@
+#define _GNU_SOURCE
+#include "socksink.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <netdb.h>
+#include <poll.h>
+#include <pthread.h>
+#include <signal.h>
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <sys/ioctl.h>
+#include <sys/socket.h>
+#include <sys/uio.h>
+#include <sys/un.h>
+#if defined(__linux__)
+#include <linux/errqueue.h>
+#include <linux/sockios.h>
+#endif
+
+#define SOCKSINK_ZC_CHUNK ((size_t)1 << 20) // zerocopy: bytes per send() (one notification each)
+
+static uint64_t now_ns(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ull + (uint64_t)ts.tv_nsec;
+}
+
+static void sleep_us(unsigned us) {
+    struct timespec ts = { (time_t)(us / 1000000u), (long)(us % 1000000u) * 1000L };
+    nanosleep(&ts, NULL);
+}
+
+// "unix:/path", "/path", "./path", "tcp:host:port", "tcp:[v6]:port"
+static int parse_addr(const char *addr, struct sockaddr_storage *ss, socklen_t *len, bool *tcp) {
+    memset(ss, 0, sizeof *ss);
+    if (strncmp(addr, "tcp:", 4) == 0) {
+        char host[128];
+        const char *colon = strrchr(addr + 4, ':');
+        if (!colon || colon == addr + 4 || (size_t)(colon - (addr + 4)) >= sizeof host) return -1;
+        snprintf(host, sizeof host, "%.*s", (int)(colon - (addr + 4)), addr + 4);
+        char *h = host;
+        if (h[0] == '[' && h[strlen(h) - 1] == ']') { h[strlen(h) - 1] = '\0'; ++h; }
+        struct addrinfo hints = { .ai_family = AF_UNSPEC, .ai_socktype = SOCK_STREAM }, *res = NULL;
+        if (getaddrinfo(h, colon + 1, &hints, &res) != 0 || !res) return -1;
+        memcpy(ss, res->ai_addr, res->ai_addrlen);
+        *len = res->ai_addrlen;
+        freeaddrinfo(res);
+        *tcp = true;
+        return 0;
+    }
+    const char *path = (strncmp(addr, "unix:", 5) == 0) ? addr + 5 : addr;
+    if (path == addr && !strchr(addr, '/')) return -1;
+    struct sockaddr_un *un = (struct sockaddr_un*)ss;
+    if (!path[0] || strlen(path) >= sizeof un->sun_path) return -1;
+    un->sun_family = AF_UNIX;
+    strcpy(un->sun_path, path);
+    *len = (socklen_t)sizeof *un;
+    *tcp = false;
+    return 0;
+}
+
+// Zerocopy completion notifications queued on the error queue; returns how many were read
+static uint64_t reap_completions(SockSink *s) {
+    uint64_t n = 0;
+#if defined(__linux__) && defined(SO_EE_ORIGIN_ZEROCOPY)
+    for (;;) {
+        char control[128];
+        struct msghdr msg = { .msg_control = control, .msg_controllen = sizeof control };
+        if (recvmsg(s->fd, &msg, MSG_ERRQUEUE | MSG_DONTWAIT) < 0) break;
+        for (struct cmsghdr *cm = CMSG_FIRSTHDR(&msg); cm; cm = CMSG_NXTHDR(&msg, cm)) {
+            if (!((cm->cmsg_level == SOL_IP && cm->cmsg_type == IP_RECVERR) ||
+                  (cm->cmsg_level == SOL_IPV6 && cm->cmsg_type == IPV6_RECVERR))) continue;
+            const struct sock_extended_err *e = (const struct sock_extended_err*)CMSG_DATA(cm);
+            if (e->ee_errno != 0 || e->ee_origin != SO_EE_ORIGIN_ZEROCOPY) continue;
+            const uint64_t k = (uint64_t)(e->ee_data - e->ee_info) + 1; // sends [ee_info, ee_data]
+            n += k;
+            if (e->ee_code & SO_EE_CODE_ZEROCOPY_COPIED) s->zc_copied += k;
+        }
+    }
+    s->zc_done += n;
+#else
+    (void)s;
+#endif
+    return n;
+}
+
+// No progress since `since` for too long: the receiver is alive but not reading (or the
+// engine is stopping and it had its grace period). Callers treat it as a lost receiver.
+static bool stalled(const SockSink *s, uint64_t since) {
+    const unsigned ms = (s->stop && s->stop(s->stop_ctx)) ? SOCKSINK_STOP_GRACE_MS : SOCKSINK_STALL_MS;
+    if (now_ns() - since < (uint64_t)ms * 1000000ull) return false;
+    errno = ETIMEDOUT;
+    return true;
+}
+
+// Socket buffer full: wait for room (time goes to *waited). 0 ok, -1 peer gone / stalled / error
+static int wait_writable(SockSink *s, uint64_t *waited) {
+    const uint64_t t0 = now_ns();
+    for (;;) {
+        if (stalled(s, t0)) return -1;
+        struct pollfd p = { .fd = s->fd, .events = POLLOUT };
+        int r = poll(&p, 1, 100);
+        if (r < 0) {
+            if (errno == EINTR) continue;
+            return -1;
+        }
+        if (p.revents & POLLERR) {
+            (void)reap_completions(s); // zerocopy notifications also raise POLLERR
+            int err = 0;
+            socklen_t el = sizeof err;
+            if (getsockopt(s->fd, SOL_SOCKET, SO_ERROR, &err, &el) == 0 && err) { errno = err; return -1; }
+        }
+        if (p.revents & (POLLHUP | POLLNVAL)) { errno = EPIPE; return -1; }
+        if (p.revents & POLLOUT) break;
+    }
+    *waited += now_ns() - t0;
+    return 0;
+}
+
+static int send_all(SockSink *s, const void *buf, size_t len, int flags, uint64_t *waited) {
+    const uint8_t *p = (const uint8_t*)buf;
+    size_t off = 0;
+    while (off < len) {
+        ssize_t n = send(s->fd, p + off, len - off, MSG_NOSIGNAL | flags);
+        if (n < 0) {
+            if (errno == EINTR) continue;
+            if (errno == EAGAIN || errno == EWOULDBLOCK) {
+                if (wait_writable(s, waited) != 0) return -1;
+                continue;
+            }
+            return -1;
+        }
+        off += (size_t)n;
+    }
+    return 0;
+}
+
+#if defined(__linux__)
+// The socket references pages it was spliced from until the receiver read them (TCP: acked)
+static int wait_consumed(SockSink *s, uint64_t *waited) {
+    uint64_t t0 = 0, progress = 0;
+    int last_q = 0;
+    for (;;) {
+        int q = 0;
+        if (ioctl(s->fd, SIOCOUTQ, &q) != 0 || q <= 0) break;
+        struct pollfd p = { .fd = s->fd, .events = 0 };
+        if (poll(&p, 1, 0) > 0 && (p.revents & (POLLHUP | POLLERR))) { errno = EPIPE; return -1; }
+        if (!t0) t0 = progress = now_ns();
+        if (q != last_q) { last_q = q; progress = now_ns(); } // the receiver is reading
+        else if (stalled(s, progress)) return -1;
+        sleep_us(SOCKSINK_POLL_US);
+    }
+    if (t0) *waited += now_ns() - t0;
+    return 0;
+}
+
+static int send_splice(SockSink *s, const uint8_t *src, size_t len, uint64_t *waited) {
+    // splice() into a closed socket raises SIGPIPE (no MSG_NOSIGNAL): hold it for this thread
+    sigset_t pipe_set, old;
+    sigemptyset(&pipe_set);
+    sigaddset(&pipe_set, SIGPIPE);
+    pthread_sigmask(SIG_BLOCK, &pipe_set, &old);
+
+    int rc = 0;
+    size_t off = 0;
+    while (off < len && rc == 0) {
+        struct iovec iov = { (void*)(src + off), (len - off < s->pipe_bytes) ? len - off : s->pipe_bytes };
+        ssize_t in = vmsplice(s->pipe_w, &iov, 1, 0);
+        if (in < 0) {
+            if (errno == EINTR) continue;
+            if (off == 0 && (errno == EINVAL || errno == ENOSYS)) { // no vmsplice here: copy instead
+                fprintf(stderr, "[engine] sock %s: vmsplice unavailable (%s), using copy.\n", s->addr, strerror(errno));
+                s->mode = SOCKSINK_COPY;
+                rc = send_all(s, src, len, 0, waited);
+                break;
+            }
+            rc = -2;
+            break;
+        }
+        // MORE only while the frame goes on: a corked tail would sit in SIOCOUTQ for the TCP
+        // cork timer (~200 ms) and wait_consumed() with it
+        const unsigned more = (off + (size_t)in < len) ? SPLICE_F_MORE : 0u;
+        size_t pending = (size_t)in;
+        while (pending > 0) {
+            ssize_t o = splice(s->pipe_r, NULL, s->fd, NULL, pending, SPLICE_F_MOVE | more);
+            if (o < 0) {
+                if (errno == EINTR) continue;
+                if ((errno == EAGAIN || errno == EWOULDBLOCK) && wait_writable(s, waited) == 0) continue;
+                rc = -1;
+                break;
+            }
+            if (o == 0) { errno = EPIPE; rc = -1; break; }
+            pending -= (size_t)o;
+        }
+        off += (size_t)in;
+    }
+    if (rc == 0 && s->mode == SOCKSINK_SPLICE) rc = wait_consumed(s, waited);
+
+    const int saved = errno;
+    struct timespec zero = { 0, 0 };
+    while (sigtimedwait(&pipe_set, NULL, &zero) > 0) {} // discard a SIGPIPE we caused
+    pthread_sigmask(SIG_SETMASK, &old, NULL);
+    errno = saved;
+    return rc;
+}
+#endif
+
+#if defined(__linux__) && defined(SO_ZEROCOPY) && defined(MSG_ZEROCOPY)
+static int send_zerocopy(SockSink *s, const uint8_t *src, size_t len, uint64_t *waited) {
+    size_t off = 0;
+    uint64_t progress = now_ns();
+    while (off < len) {
+        const size_t n = (len - off < SOCKSINK_ZC_CHUNK) ? len - off : SOCKSINK_ZC_CHUNK;
+        ssize_t w = send(s->fd, src + off, n, MSG_NOSIGNAL | MSG_ZEROCOPY);
+        if (w < 0) {
+            if (errno == EINTR) continue;
+            if (errno == ENOBUFS) { // notification memory (optmem_max) exhausted: reap first
+                if (reap_completions(s) > 0) progress = now_ns();
+                else if (stalled(s, progress)) return -1;
+                else sleep_us(SOCKSINK_POLL_US);
+                continue;
+            }
+            if ((errno == EAGAIN || errno == EWOULDBLOCK) && wait_writable(s, waited) == 0) continue;
+            return -1;
+        }
+        s->zc_sent++;
+        off += (size_t)w;
+    }
+
+    // src may only be reused once the kernel let go of every page
+    const uint64_t t0 = now_ns();
+    progress = t0;
+    bool waited_here = false;
+    while (s->zc_done < s->zc_sent) {
+        if (reap_completions(s) > 0) { progress = now_ns(); continue; }
+        if (stalled(s, progress)) return -1;
+        struct pollfd p = { .fd = s->fd, .events = 0 };
+        if (poll(&p, 1, 100) < 0 && errno != EINTR) return -1;
+        if ((p.revents & POLLHUP) && reap_completions(s) == 0) { errno = EPIPE; return -1; }
+        waited_here = true;
+    }
+    if (waited_here) *waited += now_ns() - t0;
+    return 0;
+}
+#endif
+
+int socksink_open(SockSink *s, const char *addr, SockSinkMode mode, const SockStreamHello *hello) {
+    if (!s || !addr || !hello) return -1;
+    memset(s, 0, sizeof *s);
+    s->fd = s->pipe_r = s->pipe_w = -1;
+    snprintf(s->addr, sizeof s->addr, "%s", addr);
+
+    struct sockaddr_storage ss;
+    socklen_t sl;
+    if (parse_addr(addr, &ss, &sl, &s->tcp) != 0) {
+        fprintf(stderr, "[engine] bad socket address '%s' (unix:/path or tcp:host:port).\n", addr);
+        return -2;
+    }
+
+    // The receiver may still be starting up
+    const uint64_t deadline = now_ns() + (uint64_t)SOCKSINK_CONNECT_MS * 1000000ull;
+    for (;;) {
+        s->fd = socket(ss.ss_family, SOCK_STREAM | SOCK_CLOEXEC, 0);
+        if (s->fd < 0) return -3;
+        if (connect(s->fd, (struct sockaddr*)&ss, sl) == 0) break;
+        const int err = errno;
+        close(s->fd);
+        s->fd = -1;
+        if ((err == ENOENT || err == ECONNREFUSED || err == EAGAIN) && now_ns() < deadline) {
+            sleep_us(50000);
+            continue;
+        }
+        fprintf(stderr, "[engine] cannot connect to %s: %s\n", addr, strerror(err));
+        return -4;
+    }
+    if (s->tcp) {
+        int one = 1;
+        (void)setsockopt(s->fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof one);
+    }
+
+    // Resolve the transfer mode: zerocopy -> splice -> copy
+    s->mode = (mode == SOCKSINK_AUTO) ? SOCKSINK_SPLICE : (uint8_t)mode;
+    if (s->mode == SOCKSINK_ZEROCOPY) {
+#if defined(__linux__) && defined(SO_ZEROCOPY) && defined(MSG_ZEROCOPY)
+        int one = 1;
+        if (!s->tcp || setsockopt(s->fd, SOL_SOCKET, SO_ZEROCOPY, &one, sizeof one) != 0)
+#endif
+        {
+            fprintf(stderr, "[engine] sock %s: MSG_ZEROCOPY unavailable%s, using splice.\n", addr,
+                    s->tcp ? "" : " (TCP only)");
+            s->mode = SOCKSINK_SPLICE;
+        }
+    }
+    if (s->mode == SOCKSINK_SPLICE) {
+#if defined(__linux__)
+        int p[2];
+        if (pipe2(p, O_CLOEXEC) == 0) {
+            s->pipe_r = p[0];
+            s->pipe_w = p[1];
+            (void)fcntl(s->pipe_w, F_SETPIPE_SZ, (int)SOCKSINK_PIPE_BYTES); // capped by pipe-max-size
+            const int sz = fcntl(s->pipe_w, F_GETPIPE_SZ);
+            s->pipe_bytes = (sz > 0) ? (size_t)sz : 65536u;
+        } else
+#endif
+        {
+            s->mode = SOCKSINK_COPY;
+        }
+    }
+
+    const int fl = fcntl(s->fd, F_GETFL);
+    if (fl < 0 || fcntl(s->fd, F_SETFL, fl | O_NONBLOCK) != 0) {
+        socksink_close(s);
+        return -5;
+    }
+
+    SockStreamHello h = *hello;
+    h.magic        = SOCKSTREAM_HELLO_MAGIC;
+    h.version      = SOCKSTREAM_VERSION;
+    h.header_bytes = (uint32_t)sizeof h;
+    uint64_t waited = 0;
+    if (send_all(s, &h, sizeof h, 0, &waited) != 0) {
+        fprintf(stderr, "[engine] sock %s: hello failed: %s\n", addr, strerror(errno));
+        socksink_close(s);
+        return -6;
+    }
+    return 0;
+}
+
+static void close_fds(SockSink *s) {
+    if (s->pipe_r >= 0) close(s->pipe_r);
+    if (s->pipe_w >= 0) close(s->pipe_w);
+    if (s->fd >= 0) close(s->fd);
+    s->fd = s->pipe_r = s->pipe_w = -1;
+}
+
+int socksink_send(SockSink *s, const uint8_t *src, size_t n_traces, size_t bytes_per_trace, uint64_t first_trace) {
+    if (!s || s->fd < 0 || (!src && n_traces)) return -2;
+    const size_t len = n_traces * bytes_per_trace;
+    const SockStreamFrame f = {
+        .magic = SOCKSTREAM_FRAME_MAGIC, .header_bytes = (uint32_t)sizeof f, .seq = s->seq,
+        .first_trace = first_trace, .n_traces = n_traces, .payload_bytes = len,
+    };
+
+    uint64_t waited = 0;
+    int rc = send_all(s, &f, sizeof f, len ? MSG_MORE : 0, &waited);
+    if (rc == 0 && len) {
+        switch (s->mode) {
+#if defined(__linux__) && defined(SO_ZEROCOPY) && defined(MSG_ZEROCOPY)
+            case SOCKSINK_ZEROCOPY: rc = send_zerocopy(s, src, len, &waited); break;
+#endif
+#if defined(__linux__)
+            case SOCKSINK_SPLICE:   rc = send_splice(s, src, len, &waited); break;
+#endif
+            default:                rc = send_all(s, src, len, 0, &waited); break;
+        }
+    }
+    if (rc != 0) {
+        fprintf(stderr, "[engine] sock %s: receiver gone after %llu frames (%s); no longer sending.\n",
+                s->addr, (unsigned long long)s->frames, strerror(errno));
+        close_fds(s);
+        return -1;
+    }
+
+    s->seq++;
+    s->frames++;
+    s->bytes += len;
+    s->blocked_ns += waited;
+    if (waited > s->blocked_ns_max) s->blocked_ns_max = waited;
+    if (waited) s->stalls++;
+    return 0;
+}
+
+void socksink_close(SockSink *s) {
+    if (!s) return;
+    if (s->fd >= 0) { // bounded like any send: a receiver that stopped reading forfeits the end frame
+        const SockStreamFrame end = {
+            .magic = SOCKSTREAM_FRAME_MAGIC, .header_bytes = (uint32_t)sizeof end, .seq = s->seq,
+        };
+        uint64_t waited = 0;
+        (void)send_all(s, &end, sizeof end, 0, &waited);
+    }
+    close_fds(s);
+}
+
+// ---------------------------------------------------------------------------
+// Receiver helpers
+// ---------------------------------------------------------------------------
+
+int socksink_listen(const char *addr) {
+    if (!addr) return -1;
+    struct sockaddr_storage ss;
+    socklen_t sl;
+    bool tcp;
+    if (parse_addr(addr, &ss, &sl, &tcp) != 0) return -2;
+
+    int fd = socket(ss.ss_family, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    if (fd < 0) return -3;
+    if (tcp) {
+        int one = 1;
+        (void)setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &one, sizeof one);
+    } else {
+        unlink(((struct sockaddr_un*)&ss)->sun_path); // stale socket from a previous receiver
+    }
+    if (bind(fd, (struct sockaddr*)&ss, sl) != 0 || listen(fd, 1) != 0) {
+        close(fd);
+        return -4;
+    }
+    return fd;
+}
+
+int socksink_read_full(int fd, void *buf, size_t len) {
+    uint8_t *p = (uint8_t*)buf;
+    size_t off = 0;
+    while (off < len) {
+        ssize_t n = recv(fd, p + off, len - off, 0);
+        if (n < 0) {
+            if (errno == EINTR) continue;
+            return -1;
+        }
+        if (n == 0) return (off == 0) ? 0 : -1;
+        off += (size_t)n;
+    }
+    return 1;
+}
@@ -0,0 +1,134 @@
+#ifndef SOCKSINK_H
+#define SOCKSINK_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <stdbool.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* Socket streaming sink (--sock <addr>): the writer thread sends every batch to a receiver
+   process as length-prefixed frames. The receiver listens, the engine connects.
+   Addresses: unix:/path (or any path containing '/'), tcp:host:port.
+
+   Stream: one SockStreamHello (trace geometry), then per batch a SockStreamFrame followed
+   by payload_bytes of whole traces (channel-major, as in the .bin). A frame with
+   n_traces == 0 ends the stream. Integers are in host byte order.
+
+   Transfer (--sock-mode):
+   - splice:   vmsplice the batch pages into a pipe, splice the pipe into the socket. The
+               socket then references the batch buffer instead of a copy, so the send
+               only returns once the receiver has read it (or TCP acked it): SIOCOUTQ == 0.
+   - zerocopy: send(MSG_ZEROCOPY), TCP only; the send returns on the kernel's completion
+               notifications. Loopback TCP copies anyway (counted in zc_copied).
+   - copy:     plain send().
+   - auto:     splice on Linux, else copy.
+   A receiver that does not keep up stalls the sender. One that makes no progress at all for
+   SOCKSINK_STALL_MS (SOCKSINK_STOP_GRACE_MS once stop() reports the engine is stopping) is
+   treated as gone, so no send or close waits forever. */
+
+#define SOCKSTREAM_HELLO_MAGIC 0x48534353u  // "SCSH"
+#define SOCKSTREAM_FRAME_MAGIC 0x52464353u  // "SCFR"
+#define SOCKSTREAM_VERSION     1u
+
+#ifndef SOCKSINK_CONNECT_MS
+#define SOCKSINK_CONNECT_MS 5000u                // retry connect() while the receiver starts
+#endif
+#ifndef SOCKSINK_PIPE_BYTES
+#define SOCKSINK_PIPE_BYTES ((size_t)1 << 20)    // splice: requested pipe size (pipe-max-size caps it)
+#endif
+#ifndef SOCKSINK_POLL_US
+#define SOCKSINK_POLL_US 50u                     // splice: SIOCOUTQ drain poll period
+#endif
+#ifndef SOCKSINK_STALL_MS
+#define SOCKSINK_STALL_MS 10000u                 // no progress this long => receiver gone
+#endif
+#ifndef SOCKSINK_STOP_GRACE_MS
+#define SOCKSINK_STOP_GRACE_MS 1000u             // same, once the engine is stopping
+#endif
+
+typedef enum {
+    SOCKSINK_AUTO = 0,
+    SOCKSINK_SPLICE,
+    SOCKSINK_ZEROCOPY,
+    SOCKSINK_COPY,
+} SockSinkMode;
+
+typedef struct SockStreamHello {
+    uint32_t magic;
+    uint32_t version;
+    uint32_t header_bytes;         // sizeof(SockStreamHello)
+    uint32_t n_channels;
+    uint64_t bytes_per_trace;
+    uint64_t n_samples;            // per channel
+    uint32_t bytes_per_sample;
+    uint32_t reserved;
+    char     channels[256];        // "CHAN1,CHAN2"
+} SockStreamHello;
+
+typedef struct SockStreamFrame {
+    uint32_t magic;
+    uint32_t header_bytes;         // sizeof(SockStreamFrame)
+    uint64_t seq;                  // frame number, from 0
+    uint64_t first_trace;          // run-wide index of the frame's first trace
+    uint64_t n_traces;             // 0 => end of stream
+    uint64_t payload_bytes;        // n_traces * bytes_per_trace
+} SockStreamFrame;
+
+// ---------------------------------------------------------------------------
+// Sender (engine writer thread)
+// ---------------------------------------------------------------------------
+typedef struct SockSink {
+    int      fd;                   // < 0 => not connected
+    int      pipe_r, pipe_w;       // splice mode
+    size_t   pipe_bytes;
+    uint8_t  mode;                 // SockSinkMode in use (never AUTO)
+    bool     tcp;
+    char     addr[128];
+    uint64_t seq;
+    uint64_t zc_sent, zc_done;     // zerocopy: sends issued / completed
+    // Backpressure
+    uint64_t frames;
+    uint64_t bytes;
+    uint64_t blocked_ns;           // socket full or batch not yet consumed
+    uint64_t blocked_ns_max;       // worst single frame
+    uint64_t stalls;               // frames that had to wait for the receiver
+    uint64_t zc_copied;            // zerocopy sends the kernel copied after all
+    // Optional, set after socksink_open: polled while waiting for the receiver
+    bool   (*stop)(void *ctx);
+    void    *stop_ctx;
+} SockSink;
+
+static inline const char *socksink_mode_name(uint8_t m) {
+    return (m == SOCKSINK_SPLICE) ? "splice" : (m == SOCKSINK_ZEROCOPY) ? "zerocopy"
+         : (m == SOCKSINK_COPY) ? "copy" : "auto";
+}
+
+/* Connect to addr (retrying up to SOCKSINK_CONNECT_MS) and send the hello.
+   An unavailable mode falls back (zerocopy -> splice -> copy). 0 ok, <0 err */
+int  socksink_open(SockSink *s, const char *addr, SockSinkMode mode, const SockStreamHello *hello);
+
+/* Send n_traces contiguous traces as one frame; src may be reused on return.
+   0 ok, -1 receiver gone (sink closed), <-1 err */
+int  socksink_send(SockSink *s, const uint8_t *src, size_t n_traces, size_t bytes_per_trace, uint64_t first_trace);
+
+/* Send the end-of-stream frame (best effort) and close */
+void socksink_close(SockSink *s);
+
+// ---------------------------------------------------------------------------
+// Receiver helpers (other processes): only need this header and socksink.c
+// ---------------------------------------------------------------------------
+
+/* Listening socket on addr (a stale Unix socket file is replaced). fd, or <0 err */
+int  socksink_listen(const char *addr);
+
+/* Read exactly len bytes. 1 ok, 0 clean EOF before the first byte, -1 err / short */
+int  socksink_read_full(int fd, void *buf, size_t len);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // SOCKSINK_H
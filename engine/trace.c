@@ -0,0 +1,149 @@
+#define _GNU_SOURCE
+#include "trace.h"
+#include "latency.h"
+
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+typedef struct TraceRing {
+    TraceEvent       ev[TRACE_RING_EVENTS];
+    _Atomic uint64_t n;           // events ever recorded; ev[n % TRACE_RING_EVENTS] is next
+    const char      *thread_name;
+    unsigned         tid;         // 1-based registration order (stable across platforms)
+} TraceRing;
+
+_Atomic bool trace_enabled = false;
+
+// Registry: touched once per thread per session (first event), never on the hot path
+static pthread_mutex_t  g_reg_mutex = PTHREAD_MUTEX_INITIALIZER;
+static TraceRing       *g_rings[TRACE_MAX_THREADS];
+static unsigned         g_n_rings;
+static _Atomic unsigned g_session;   // bumped per start/dump: stale thread-local rings re-register
+static uint64_t         g_t0_ns;
+
+static _Thread_local TraceRing  *tl_ring;
+static _Thread_local unsigned    tl_session;
+static _Thread_local const char *tl_name;
+
+uint64_t trace_clock_ns(void) {
+    return latency_now_ns();
+}
+
+static TraceRing *ring_self(void) {
+    const unsigned sess = atomic_load_explicit(&g_session, memory_order_acquire);
+    if (tl_session == sess) return tl_ring; // NULL => registry was full this session
+
+    tl_session = sess;
+    tl_ring = NULL;
+    TraceRing *r = calloc(1, sizeof *r);
+    if (!r) return NULL;
+    pthread_mutex_lock(&g_reg_mutex);
+    if (g_n_rings < TRACE_MAX_THREADS) {
+        r->tid = g_n_rings + 1;
+        r->thread_name = tl_name;
+        g_rings[g_n_rings++] = r;
+    } else {
+        free(r);
+        r = NULL;
+    }
+    pthread_mutex_unlock(&g_reg_mutex);
+    tl_ring = r;
+    return r;
+}
+
+void trace_end(const char *cat, const char *name, uint64_t t0, uint64_t bytes) {
+    if (t0 == 0) return;
+    const uint64_t t1 = trace_clock_ns();
+    TraceRing *r = ring_self();
+    if (!r) return;
+
+    const uint64_t n = atomic_load_explicit(&r->n, memory_order_relaxed);
+    TraceEvent *e = &r->ev[n & (TRACE_RING_EVENTS - 1)];
+    e->cat    = cat;
+    e->name   = name;
+    e->ts_ns  = t0;
+    e->dur_ns = t1 - t0;
+    e->bytes  = bytes;
+    atomic_store_explicit(&r->n, n + 1, memory_order_release);
+}
+
+void trace_thread_name(const char *name) {
+    tl_name = name;
+    if (!atomic_load_explicit(&trace_enabled, memory_order_relaxed)) return;
+    TraceRing *r = ring_self();
+    if (r) r->thread_name = name;
+}
+
+static void free_rings(void) {
+    pthread_mutex_lock(&g_reg_mutex);
+    for (unsigned i = 0; i < g_n_rings; ++i) {
+        free(g_rings[i]);
+        g_rings[i] = NULL;
+    }
+    g_n_rings = 0;
+    atomic_fetch_add_explicit(&g_session, 1, memory_order_release);
+    pthread_mutex_unlock(&g_reg_mutex);
+}
+
+int trace_start(void) {
+    _Static_assert((TRACE_RING_EVENTS & (TRACE_RING_EVENTS - 1)) == 0, "TRACE_RING_EVENTS must be a power of two");
+    atomic_store_explicit(&trace_enabled, false, memory_order_relaxed);
+    free_rings();
+    g_t0_ns = trace_clock_ns();
+    atomic_store_explicit(&trace_enabled, true, memory_order_release);
+    return 0;
+}
+
+int trace_dump(const char *path) {
+    atomic_store_explicit(&trace_enabled, false, memory_order_relaxed);
+    if (!path) { free_rings(); return -1; }
+
+    FILE *fp = fopen(path, "w");
+    if (!fp) {
+        fprintf(stderr, "[engine] trace: cannot create %s\n", path);
+        free_rings();
+        return -2;
+    }
+
+    const int pid = (int)getpid();
+    uint64_t written = 0, dropped = 0;
+    fprintf(fp, "{\"displayTimeUnit\":\"ns\",\"traceEvents\":[\n");
+    fprintf(fp, "{\"name\":\"process_name\",\"ph\":\"M\",\"pid\":%d,\"args\":{\"name\":\"scope-acquire\"}}", pid);
+
+    pthread_mutex_lock(&g_reg_mutex);
+    for (unsigned i = 0; i < g_n_rings; ++i) {
+        const TraceRing *r = g_rings[i];
+        if (r->thread_name) {
+            fprintf(fp, ",\n{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":%d,\"tid\":%u,\"args\":{\"name\":\"%s\"}}",
+                    pid, r->tid, r->thread_name);
+        }
+        const uint64_t n = atomic_load_explicit(&r->n, memory_order_acquire);
+        const uint64_t first = (n > TRACE_RING_EVENTS) ? n - TRACE_RING_EVENTS : 0;
+        dropped += first;
+        for (uint64_t k = first; k < n; ++k) {
+            const TraceEvent *e = &r->ev[k & (TRACE_RING_EVENTS - 1)];
+            const uint64_t ts = (e->ts_ns > g_t0_ns) ? e->ts_ns - g_t0_ns : 0;
+            fprintf(fp, ",\n{\"name\":\"%s\",\"cat\":\"%s\",\"ph\":\"X\",\"pid\":%d,\"tid\":%u,\"ts\":%.3f,\"dur\":%.3f",
+                    e->name, e->cat, pid, r->tid, (double)ts / 1e3, (double)e->dur_ns / 1e3);
+            if (e->bytes) fprintf(fp, ",\"args\":{\"bytes\":%llu}", (unsigned long long)e->bytes);
+            fputc('}', fp);
+        }
+        written += n - first;
+    }
+    pthread_mutex_unlock(&g_reg_mutex);
+
+    fprintf(fp, "\n]}\n");
+    int rc = (fclose(fp) == 0) ? 0 : -3;
+    free_rings();
+    if (rc == 0) {
+        fprintf(stderr, "[engine] trace: %llu events -> %s", (unsigned long long)written, path);
+        if (dropped) fprintf(stderr, " (%llu oldest overwritten; raise TRACE_RING_EVENTS)", (unsigned long long)dropped);
+        fprintf(stderr, "\n");
+    } else {
+        fprintf(stderr, "[engine] trace: write to %s failed\n", path);
+    }
+    return rc;
+}
@@ -0,0 +1,58 @@
+#ifndef TRACE_H
+#define TRACE_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <stdatomic.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#ifndef TRACE_RING_EVENTS
+#define TRACE_RING_EVENTS 65536u    // per thread, power of two; the oldest events are overwritten
+#endif
+#ifndef TRACE_MAX_THREADS
+#define TRACE_MAX_THREADS 64
+#endif
+
+/* Timeline tracing (--trace): every thread records complete (begin + duration) events
+   into its own ring, allocated on its first event. Recording takes no lock: one
+   producer per ring, and the rings are only read by trace_dump() once the traced
+   threads are done. Disabled => trace_begin() is one relaxed load. */
+typedef struct TraceEvent {
+    const char *cat;     // static string: "phase", "visa", "syscall", "engine"
+    const char *name;    // static string
+    uint64_t    ts_ns;   // begin (latency_now_ns clock)
+    uint64_t    dur_ns;
+    uint64_t    bytes;   // 0 => no args
+} TraceEvent;
+
+extern _Atomic bool trace_enabled;
+
+uint64_t trace_clock_ns(void);
+
+/* Begin timestamp, 0 when tracing is off (pass it to trace_end unchanged) */
+static inline uint64_t trace_begin(void) {
+    return atomic_load_explicit(&trace_enabled, memory_order_relaxed) ? trace_clock_ns() : 0;
+}
+
+/* Record [t0, now) on the calling thread's ring; t0 == 0 => no-op */
+void trace_end(const char *cat, const char *name, uint64_t t0, uint64_t bytes);
+
+/* Label the calling thread in the timeline (static string; no-op when off) */
+void trace_thread_name(const char *name);
+
+/* Enable recording (drops events of a previous session). 0 ok */
+int  trace_start(void);
+
+/* Disable recording and write every ring as Chrome/Perfetto trace-event JSON,
+   then free the rings. Call after the traced threads have finished. 0 ok, <0 err */
+int  trace_dump(const char *path);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // TRACE_H
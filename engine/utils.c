@@ -1,6 +1,7 @@
 #define _GNU_SOURCE
 #include "engine.h"   // needs full struct defs + SCOPE_MAX_CHANS
 #include "utils.h"
+#include "bufpool.h"
 
 #include <unistd.h>
 #include <errno.h>
@@ -36,29 +37,207 @@ static int mul_size_checked(size_t a, size_t b, size_t *out) {
     return 0;
 }
 
-int enforce_flush_limit(const RunConfig *cfg) {
-    if (!cfg) return -1;
+static bool read_size_file(const char *path, size_t *out) {
+    FILE *fp = fopen(path, "r");
+    if (!fp) return false;
+    char buf[64];
+    bool ok = (fgets(buf, sizeof buf, fp) != NULL && isdigit((unsigned char)buf[0])); // "max" => unlimited
+    fclose(fp);
+    if (ok) *out = (size_t)strtoull(buf, NULL, 10);
+    return ok;
+}
+
+// One "<key> <value>" line of a cgroup memory.stat
+static bool read_stat_field(const char *path, const char *key, size_t *out) {
+    FILE *fp = fopen(path, "r");
+    if (!fp) return false;
+    char line[128];
+    const size_t klen = strlen(key);
+    bool ok = false;
+    while (!ok && fgets(line, sizeof line, fp)) {
+        if (strncmp(line, key, klen) == 0 && line[klen] == ' ') {
+            *out = (size_t)strtoull(line + klen + 1, NULL, 10);
+            ok = true;
+        }
+    }
+    fclose(fp);
+    return ok;
+}
+
+// Tightest memory.max / memory.high headroom from our cgroup v2 up to the root (0 => none or
+// unknown: MemAvailable decides). Usage leaves out inactive page cache, mostly the .bin we
+// wrote ourselves, which the kernel reclaims before it enforces a limit.
+static size_t cgroup_headroom_bytes(void) {
+    FILE *fp = fopen("/proc/self/cgroup", "r");
+    if (!fp) return 0;
+    char line[512], rel[512] = "";
+    while (fgets(line, sizeof line, fp)) {
+        if (strncmp(line, "0::", 3) == 0) {
+            snprintf(rel, sizeof rel, "%s", line + 3);
+            rel[strcspn(rel, "\r\n")] = '\0';
+            break;
+        }
+    }
+    fclose(fp);
+    if (rel[0] != '/') return 0; // cgroup v1 or no cgroup fs
+
+    size_t best = 0;
+    char dir[600];
+    for (;;) {
+        snprintf(dir, sizeof dir, "/sys/fs/cgroup%s", (strcmp(rel, "/") == 0) ? "" : rel);
+        char path[640];
+        size_t cur = 0, cache = 0, lim;
+        snprintf(path, sizeof path, "%s/memory.current", dir);
+        const bool have_cur = read_size_file(path, &cur);
+        snprintf(path, sizeof path, "%s/memory.stat", dir);
+        if (have_cur && read_stat_field(path, "inactive_file", &cache)) cur -= (cache < cur) ? cache : cur;
+        static const char *const limits[] = { "memory.max", "memory.high" };
+        for (int i = 0; have_cur && i < 2; ++i) {
+            snprintf(path, sizeof path, "%s/%s", dir, limits[i]);
+            if (!read_size_file(path, &lim) || cur >= lim) continue; // no limit, or no sensible figure
+            if (best == 0 || lim - cur < best) best = lim - cur;
+        }
+        char *slash = strrchr(rel, '/');
+        if (!slash || slash == rel) {
+            if (strcmp(rel, "/") == 0) break;
+            strcpy(rel, "/");
+        } else {
+            *slash = '\0';
+        }
+    }
+    return best;
+}
 
-    // bytes_per_sample = coding+1 (0=>1 byte, 1=>2 bytes)
-    size_t bps = (size_t)(cfg->coding + 1);
+static size_t mem_available_bytes(void) {
+    FILE *fp = fopen("/proc/meminfo", "r");
+    if (!fp) return 0;
+    char line[128];
+    unsigned long long kb = 0;
+    while (fgets(line, sizeof line, fp)) {
+        if (sscanf(line, "MemAvailable: %llu kB", &kb) == 1) break;
+    }
+    fclose(fp);
+    return (size_t)kb * 1024u;
+}
 
-    // trace_size = n_samples * n_channels * bps
+int get_memory_budget(MemBudget *out) {
+    if (!out) return -1;
+    out->mem_available   = mem_available_bytes();
+    out->cgroup_headroom = cgroup_headroom_bytes();
+    out->pool_idle       = bufpool_idle_bytes();
+
+    size_t avail = out->mem_available ? out->mem_available : get_total_ram_bytes() / 2; // no /proc: old 50% rule
+    if (out->cgroup_headroom && out->cgroup_headroom < avail) avail = out->cgroup_headroom;
+    avail += out->pool_idle; // counted as used by both, yet ours to reuse
+    out->budget = avail / 100u * ENGINE_MEM_BUDGET_PCT;
+    return 0;
+}
+
+// Batch outputs that do not hold back the producer; *spills => how many of them spill
+static unsigned nonblock_sinks(const RunConfig *cfg, unsigned *spills) {
+    const bool on[ENGINE_SINK_KINDS] = {
+        [ENGINE_SINK_SHM]   = cfg->shm_name != NULL,
+        [ENGINE_SINK_SOCK]  = cfg->sock_addr != NULL,
+        [ENGINE_SINK_STATS] = cfg->stats_sink,
+        [ENGINE_SINK_NULL]  = cfg->null_sink,
+    };
+    unsigned n = 0;
+    *spills = 0;
+    for (int k = 0; k < ENGINE_SINK_KINDS; ++k) {
+        if (!on[k] || cfg->sink_policy[k] == SINK_BLOCK) continue;
+        n++;
+        if (cfg->sink_policy[k] == SINK_SPILL) (*spills)++;
+    }
+    return n;
+}
+
+unsigned engine_batch_buffers(const RunConfig *cfg) {
+    unsigned spills;
+    return cfg ? 2u + nonblock_sinks(cfg, &spills) : 2u;
+}
+
+size_t engine_memory_required(const RunConfig *cfg, size_t n_flush_traces) {
+    if (!cfg) return SIZE_MAX;
+    const size_t frames = cfg->n_frames ? cfg->n_frames : 1;
+
+    // trace_size = n_samples * n_channels * bps (WORD is packed to 1 byte unless keep_high_byte)
     size_t tmp, trace_size;
-    if (mul_size_checked(cfg->n_samples, (size_t)cfg->n_channels, &tmp) != 0) return -1;
-    if (mul_size_checked(tmp, bps, &trace_size) != 0) return -1;
-    if (trace_size == 0) return -1;
+    if (mul_size_checked(cfg->n_samples, (size_t)cfg->n_channels, &tmp) != 0) return SIZE_MAX;
+    if (mul_size_checked(tmp, run_config_sample_bytes(cfg), &trace_size) != 0) return SIZE_MAX;
+
+    size_t total = ENGINE_MEM_RESERVE_BYTES, part;
+    if (cfg->stream) {
+        total += (size_t)ENGINE_STREAM_CHUNKS * ENGINE_STREAM_CHUNK_BYTES;
+    } else {
+        // batch buffers (2 + drop/spill sinks) and the read-back buffer of each spill sink,
+        // each with (n_frames - 1) traces of spill slack
+        unsigned spills;
+        const size_t n_bufs = 2u + nonblock_sinks(cfg, &spills) + spills;
+        if (n_flush_traces > SIZE_MAX - frames) return SIZE_MAX;
+        if (mul_size_checked(trace_size, n_flush_traces + frames - 1, &part) != 0) return SIZE_MAX;
+        if (part > (SIZE_MAX - total) / n_bufs) return SIZE_MAX;
+        total += n_bufs * part;
+    }
+    // --stats: two double accumulators per sample
+    if (cfg->stats_sink) {
+        if (mul_size_checked(cfg->n_samples * cfg->n_channels, 2 * sizeof(double), &part) != 0) return SIZE_MAX;
+        if (part > SIZE_MAX - total) return SIZE_MAX;
+        total += part;
+    }
+    // segmented readout staging (multiscope scratch / frame drain): one arm cycle
+    if (frames > 1) {
+        if (mul_size_checked(trace_size, frames, &part) != 0 || part > SIZE_MAX - total) return SIZE_MAX;
+        total += part;
+    }
+    // --shm ring lives in tmpfs, i.e. RAM: at least one trace per slot
+    if (cfg->shm_name) {
+        part = cfg->shm_bytes ? cfg->shm_bytes : SHMRING_DEFAULT_BYTES;
+        if (trace_size > part / SHMRING_SLOTS) {
+            if (mul_size_checked(trace_size, SHMRING_SLOTS, &part) != 0) return SIZE_MAX;
+        }
+        if (part > SIZE_MAX - total) return SIZE_MAX;
+        total += part;
+    }
+    return total;
+}
+
+size_t auto_flush_traces(const RunConfig *cfg, const MemBudget *mb) {
+    const size_t frames = (cfg && cfg->n_frames) ? cfg->n_frames : 1;
+    if (!cfg || !mb || cfg->stream) return frames;
+    const size_t trace_size = cfg->n_samples * cfg->n_channels * run_config_sample_bytes(cfg);
+    if (trace_size == 0) return frames;
+
+    const size_t fixed = engine_memory_required(cfg, 0); // reserve + slack + staging
+    if (fixed == SIZE_MAX || fixed >= mb->budget) return frames;
+    unsigned spills;
+    const size_t n_bufs = 2u + nonblock_sinks(cfg, &spills) + spills;
+    size_t n = (mb->budget - fixed) / n_bufs / trace_size;
+
+    size_t cap = ENGINE_AUTO_BATCH_MAX_BYTES / trace_size;
+    if (n > cap) n = cap;
+    if (cfg->n_traces && n > cfg->n_traces) n = cfg->n_traces;
+    n -= n % frames;
+    return (n < frames) ? frames : n;
+}
 
-    // flush_batch_size = trace_size * n_flush_traces
-    size_t flush_batch_size;
-    if (mul_size_checked(trace_size, cfg->n_flush_traces, &flush_batch_size) != 0) return -1;
+int enforce_flush_limit(const RunConfig *cfg) {
+    if (!cfg) return -1;
+    if (!cfg->stream && cfg->n_samples * cfg->n_channels == 0) return -1;
 
-    size_t total_ram = get_total_ram_bytes();
-    size_t max_bytes = total_ram / 2; // 50%
+    const size_t need = engine_memory_required(cfg, cfg->n_flush_traces);
+    if (need == SIZE_MAX) return -1;
 
-    if (flush_batch_size > max_bytes) {
+    MemBudget mb;
+    get_memory_budget(&mb);
+    if (need > mb.budget) {
+        char cg[48] = "none";
+        if (mb.cgroup_headroom) snprintf(cg, sizeof cg, "%.2f MiB", mb.cgroup_headroom / 1048576.0);
         fprintf(stderr,
-                "[engine] Requested batch (%.2f MiB) exceeds 50%% RAM limit (%.2f MiB).\n",
-                flush_batch_size / 1048576.0, max_bytes / 1048576.0);
+                "[engine] Buffers need %.2f MiB, over the memory budget of %.2f MiB "
+                "(%u%% of MemAvailable %.2f MiB / cgroup headroom %s, plus %.2f MiB of idle pool); "
+                "lower --batch or use --stream.\n",
+                need / 1048576.0, mb.budget / 1048576.0, ENGINE_MEM_BUDGET_PCT,
+                mb.mem_available / 1048576.0, cg, mb.pool_idle / 1048576.0);
         return -2;
     }
     return 0;
@@ -175,7 +354,7 @@ FILE* open_log_file(const RunConfig *cfg){
     if (asprintf(&logpath, "%s.log", cfg->outfile) < 0 || !logpath) {
         return NULL;
     }
-    FILE *fp_log = fopen(logpath, "w");
+    FILE *fp_log = fopen(logpath, cfg->resume ? "a" : "w"); // resume: one header per session
     if (!fp_log) {
         fprintf(stderr,"[engine] Failed to open '%s': %s\n", logpath, strerror(errno));
         free(logpath);
@@ -191,26 +370,34 @@ FILE* open_log_file(const RunConfig *cfg){
     strftime(tbuf, sizeof tbuf, "%Y.%m.%d-%H:%M:%S", &tm_utc);
 
     // Channels
-    char chbuf[256] = {0};
-    for (uint8_t i = 0; i < cfg->n_channels; i++) {
-        if (!cfg->channels || !cfg->channels[i]) continue;
-        if (i > 0 && chbuf[0] != '\0') strncat(chbuf, ",", sizeof(chbuf)-strlen(chbuf)-1);
-        strncat(chbuf, cfg->channels[i], sizeof(chbuf)-strlen(chbuf)-1);
-    }
+    char chbuf[256];
+    run_config_channels(cfg, chbuf, sizeof chbuf);
 
     fprintf(fp_log,
         "acq_start_time=%s\n"
         //"instrument_name=%s\n"
         "channels=%s\n"
         "coding=%s\n"
+        "bytes_per_sample=%zu\n"
         "nsamples=%zu\n"
-        "ntraces_per_flush=%zu\n",
+        "ntraces_per_flush=%zu\n"
+        "nframes_per_arm=%zu\n"
+        "write_mode=%s\n"
+        "writeback=%s\n"
+        "sync_interval_ms=%u\n"
+        "drop_cache=%d\n",
         tbuf,
         //(cfg->instr_name ? cfg->instr_name : ""),
         chbuf,
         (cfg->coding == 0 ? "BYTE" : "SHORT"),
+        run_config_sample_bytes(cfg),
         cfg->n_samples,
-        cfg->n_flush_traces
+        cfg->n_flush_traces,
+        (cfg->n_frames ? cfg->n_frames : (size_t)1),
+        (cfg->stream ? "STREAM" : "BATCH"),
+        writeback_name(cfg->writeback),
+        (cfg->sync_interval_ms ? cfg->sync_interval_ms : ENGINE_CHECKPOINT_INTERVAL_MS),
+        (int)cfg->drop_cache
     );
 
     return fp_log;
@@ -227,15 +414,131 @@ int close_log_file(EngineCore *core) {
 
     fprintf(core->fp_log,
         "acquisition_end_time=%s\n"
-        "ntraces_written=%zu\n",
+        "ntraces_written=%zu\n"
+        "reconnects=%llu\n"
+        "reconnect_attempts=%llu\n"
+        "reconnect_ms_avg=%.3f\n"
+        "reconnect_ms_max=%.3f\n"
+        "handovers_waited=%llu\n"
+        "handovers_nowait=%llu\n"
+        "batch_traces_final=%zu\n"
+        "batch_resizes=%zu\n",
         tbuf,
-        core->total_traces_written
+        core->total_traces_written,
+        (unsigned long long)core->reconnects,
+        (unsigned long long)core->reconnect_attempts,
+        core->reconnects ? core->reconnect_us_total / 1000.0 / (double)core->reconnects : 0.0,
+        core->reconnect_us_max / 1000.0,
+        (unsigned long long)core->handovers_waited,
+        (unsigned long long)core->handovers_nowait,
+        (core->cfg && core->cfg->stream) ? (size_t)0 : core->batch_traces,
+        core->batch_resizes
     );
+    if (core->cfg && core->cfg->adaptive_batch && !core->cfg->stream) {
+        fprintf(core->fp_log, "acq_traces_per_s=%.3f\nwriter_bytes_per_s=%.0f\n",
+                core->acq_traces_per_s, core->writer_bytes_per_s);
+    }
+    if (core->phase_seq > 0) { // phased run: stored trace k is seq k + (lost seqs before it)
+        fprintf(core->fp_log, "phase_seqs_lost=%llu\n", (unsigned long long)core->phase_seqs_lost);
+    }
+    phase_stats_print(&core->phase_stats, core->fp_log, true);
     fclose(core->fp_log);
     core->fp_log = NULL;
     return 0;
 }
 
+void run_config_channels(const RunConfig *cfg, char *out, size_t cap) {
+    if (!out || cap == 0) return;
+    out[0] = '\0';
+    if (!cfg) return;
+    for (uint8_t i = 0; i < cfg->n_channels; i++) {
+        if (!cfg->channels || !cfg->channels[i]) continue;
+        if (i > 0 && out[0] != '\0') strncat(out, ",", cap - strlen(out) - 1);
+        strncat(out, cfg->channels[i], cap - strlen(out) - 1);
+    }
+}
+
+int file_sync_data(int fd) {
+    if (fd < 0) return -1;
+#if defined(__linux__)
+    return (fdatasync(fd) == 0) ? 0 : -2;
+#else
+    return (fsync(fd) == 0) ? 0 : -2;
+#endif
+}
+
+// --------------------
+// Checkpoint
+// --------------------
+
+int checkpoint_write(const char *base, const RunCheckpoint *ck) {
+    if (!base || !ck) return -1;
+
+    char *path = NULL, *tmp = NULL;
+    if (asprintf(&path, "%s.ckpt", base) < 0) return -1;
+    if (asprintf(&tmp, "%s.ckpt.tmp", base) < 0) { free(path); return -1; }
+
+    int rc = -2;
+    int fd = open(tmp, O_CREAT | O_TRUNC | O_WRONLY, 0644);
+    if (fd >= 0) {
+        char text[512];
+        int n = snprintf(text, sizeof text,
+                         "traces_written=%zu\n"
+                         "bytes_per_trace=%zu\n"
+                         "nsamples=%zu\n"
+                         "bytes_per_sample=%zu\n"
+                         "channels=%s\n",
+                         ck->traces_written, ck->bytes_per_trace, ck->n_samples,
+                         ck->bytes_per_sample, ck->channels);
+        bool ok = (n > 0 && (size_t)n < sizeof text && write(fd, text, (size_t)n) == n);
+        ok = (fsync(fd) == 0) && ok;
+        ok = (close(fd) == 0) && ok;
+        if (ok && rename(tmp, path) == 0) {
+            rc = 0;
+            // make the rename itself durable
+            char *slash = strrchr(path, '/');
+            if (slash) *slash = '\0';
+            int dfd = open(slash ? (slash == path ? "/" : path) : ".", O_RDONLY);
+            if (dfd >= 0) { (void)fsync(dfd); close(dfd); }
+        }
+    }
+    if (rc != 0) unlink(tmp);
+    free(tmp);
+    free(path);
+    return rc;
+}
+
+int checkpoint_read(const char *base, RunCheckpoint *ck) {
+    if (!base || !ck) return -2;
+    memset(ck, 0, sizeof *ck);
+
+    char *path = NULL;
+    if (asprintf(&path, "%s.ckpt", base) < 0) return -2;
+    FILE *fp = fopen(path, "r");
+    free(path);
+    if (!fp) return -1;
+
+    char line[320];
+    unsigned seen = 0;
+    while (fgets(line, sizeof line, fp)) {
+        char *eq = strchr(line, '=');
+        if (!eq) continue;
+        *eq = '\0';
+        char *val = eq + 1;
+        val[strcspn(val, "\r\n")] = '\0';
+        if      (strcmp(line, "traces_written") == 0)   { ck->traces_written   = strtoull(val, NULL, 10); seen |= 1u; }
+        else if (strcmp(line, "bytes_per_trace") == 0)  { ck->bytes_per_trace  = strtoull(val, NULL, 10); seen |= 2u; }
+        else if (strcmp(line, "nsamples") == 0)         { ck->n_samples        = strtoull(val, NULL, 10); seen |= 4u; }
+        else if (strcmp(line, "bytes_per_sample") == 0) { ck->bytes_per_sample = strtoull(val, NULL, 10); seen |= 8u; }
+        else if (strcmp(line, "channels") == 0) {
+            snprintf(ck->channels, sizeof ck->channels, "%s", val);
+            seen |= 16u;
+        }
+    }
+    fclose(fp);
+    return (seen == 31u && ck->bytes_per_trace != 0) ? 0 : -2;
+}
+
 // --------------------
 // Config lifecycle
 // --------------------
@@ -243,14 +546,38 @@ int close_log_file(EngineCore *core) {
 int destroy_run_config(RunConfig *cfg) {
     if (!cfg) return -1;
 
+    // instr_name aliases instr_names[0] when set from the CLI
+    bool aliased = false;
+    for (uint8_t i = 0; i < cfg->n_instr; i++) {
+        if (cfg->instr_names[i] == cfg->instr_name) aliased = true;
+        free(cfg->instr_names[i]);
+        cfg->instr_names[i] = NULL;
+    }
+    cfg->n_instr = 0;
     if (cfg->instr_name) {
-        free(cfg->instr_name);
+        if (!aliased) free(cfg->instr_name);
         cfg->instr_name = NULL;
     }
     if (cfg->outfile) {
         free(cfg->outfile);
         cfg->outfile = NULL;
     }
+    free(cfg->metrics_file);
+    cfg->metrics_file = NULL;
+    free(cfg->metrics_socket);
+    cfg->metrics_socket = NULL;
+    cfg->metrics_interval_ms = 0;
+    free(cfg->trace_file);
+    cfg->trace_file = NULL;
+    free(cfg->shm_name);
+    cfg->shm_name = NULL;
+    cfg->shm_bytes = 0;
+    free(cfg->sock_addr);
+    cfg->sock_addr = NULL;
+    cfg->sock_mode = SOCKSINK_AUTO;
+    cfg->stats_sink = false;
+    cfg->null_sink = false;
+    memset(cfg->sink_policy, 0, sizeof cfg->sink_policy);
     if (cfg->channels) {
         for (uint8_t i = 0; i < cfg->n_channels; i++) {
             free(cfg->channels[i]);
@@ -262,7 +589,16 @@ int destroy_run_config(RunConfig *cfg) {
     cfg->n_samples       = 0;
     cfg->n_traces        = 0;
     cfg->n_flush_traces  = 0;
+    cfg->n_frames        = 0;
     cfg->coding          = 0;
+    cfg->keep_high_byte  = false;
+    cfg->stream          = false;
+    cfg->resume          = false;
+    cfg->writeback       = WRITEBACK_KERNEL;
+    cfg->sync_interval_ms = 0;
+    cfg->drop_cache      = false;
+    cfg->hugepages       = false;
+    cfg->mlock_buffers   = false;
     cfg->verbose         = false;
 
     return 0;
@@ -13,7 +13,25 @@ typedef struct EngineCore EngineCore;
 // System / memory
 size_t get_total_ram_bytes(void);
 
-// Enforce memory cap for flush batches (returns 0 OK, -1 bad params, -2 over cap)
+typedef struct MemBudget {
+    size_t mem_available;   // /proc/meminfo MemAvailable (0 => unknown)
+    size_t cgroup_headroom; // min over the cgroup v2 ancestry of memory.max/high - (memory.current
+                            //   - inactive_file) (0 => unlimited or unknown)
+    size_t pool_idle;       // bufpool regions kept from an earlier run, reused or unmapped by this one
+    size_t budget;          // ENGINE_MEM_BUDGET_PCT of the tighter of the two, plus pool_idle
+} MemBudget;
+int    get_memory_budget(MemBudget *out);                          // 0 ok (falls back to 50% of RAM)
+
+// Batch buffers engine_run allocates for cfg: 2, plus one per drop/spill sink
+unsigned engine_batch_buffers(const RunConfig *cfg);
+
+// Bytes engine_run allocates for cfg with n_flush_traces per batch (SIZE_MAX on overflow)
+size_t engine_memory_required(const RunConfig *cfg, size_t n_flush_traces);
+
+// Largest n_flush_traces (multiple of n_frames) that fits the budget; >= n_frames
+size_t auto_flush_traces(const RunConfig *cfg, const MemBudget *mb);
+
+// Enforce the memory budget for all buffers (returns 0 OK, -1 bad params, -2 over budget)
 int enforce_flush_limit(const RunConfig *cfg);
 
 // Channels
@@ -23,8 +41,21 @@ int parse_channels_list(RunConfig *out, const char *arg);         // 0 ok; <0 on
 // Filenames / files
 char *make_timestamped_filename(const char *base);                // malloc'd; caller frees
 int   open_out_file(const char *path, const char *extension);     // returns fd or <0
-FILE *open_log_file(const RunConfig *cfg);                        // returns FILE* or NULL
+FILE *open_log_file(const RunConfig *cfg);                        // returns FILE* or NULL (appends on resume)
 int   close_log_file(EngineCore *core);                           // appends trailer, closes
+int   file_sync_data(int fd);                                     // fdatasync (fsync where missing); 0 ok
+void  run_config_channels(const RunConfig *cfg, char *out, size_t cap); // "CHAN1,CHAN2"
+
+// Checkpoint (<base>.ckpt): durable trace count + trace geometry, for --resume
+typedef struct RunCheckpoint {
+    size_t traces_written;    // traces known to be on stable storage
+    size_t bytes_per_trace;
+    size_t n_samples;
+    size_t bytes_per_sample;
+    char   channels[256];
+} RunCheckpoint;
+int checkpoint_write(const char *base, const RunCheckpoint *ck);  // tmp + fsync + rename; 0 ok
+int checkpoint_read (const char *base, RunCheckpoint *ck);        // 0 ok; -1 missing; -2 malformed
 
 // Config lifecycle
 int destroy_run_config(RunConfig *cfg);                           // frees strings/arrays
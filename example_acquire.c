@@ -2,13 +2,17 @@
 #include <stdbool.h>
  
 #include "engine/engine.h"
+#include "engine/latency.h"
 #include "scope/scope.h"
 
 #define DEBUG 0
+#define PHASED 0 // 1 => split prepare/arm/trigger/collect (target I/O overlaps readout)
 
-#define POLL_SLEEP_US 100u // microseconds
-#define ARM_TIMEOUT_MS 100u // miliseconds
-#define ARM_TIMEOUT_US ((useconds_t)ARM_TIMEOUT_MS * 1000u)
+#define ARM_TIMEOUT_MS 100u // miliseconds (upper bound; learned timeout takes over)
+
+// Arm/trigger latency models, learned online by the engine wait helpers
+static LatencyModel arm_lat;
+static LatencyModel trig_lat;
 
 static inline void simulate_trigger(Scope *s) {
     //usleep(500000);
@@ -18,6 +22,9 @@ static inline void simulate_trigger(Scope *s) {
 int prep(Scope *s, const RunConfig *cfg) {
     (void)cfg; // silence unused param warning if not used    
 
+    latency_model_init(&arm_lat);
+    latency_model_init(&trig_lat);
+
     // -- Initialize your target device here.
     // ... your code ...
 
@@ -29,37 +36,53 @@ int prep(Scope *s, const RunConfig *cfg) {
     return 0;
 }
 
+int cleanup(void) {
+    // -- Release your target device here.
+    return 0;
+}
+
+// Waveform-record mode (--frames K): one arm cycle captures K triggered frames
+static int acquire_frames(Scope *s, uint8_t *dst, RunConfig *cfg) {
+    if (!s->driver->arm_record || !s->driver->read_frames) return -1;
+
+    // 1) Start recording K frames
+    if (s->driver->arm_record(s, cfg->n_frames) != 0) return -1;
+
+    // 2) Trigger K times (one stimulus per frame)
+    for (size_t f = 0; f < cfg->n_frames; ++f) {
+        simulate_trigger(s);
+    }
+
+    // 3) Wait until the record stops by itself
+    int rc = scope_poll_until(s, s->driver->check_if_recorded, s->timeout_ms);
+    if (rc < 0) return -3;
+    if (rc > 0) return ACQ_ERR_TRIGGER_TIMEOUT;
+
+    // 4) Drain frames into consecutive trace slots
+    return s->driver->read_frames(s, dst, cfg->n_frames, cfg);
+}
+
 int acquire(Scope *s, uint8_t *dst, RunConfig *cfg) {
+    if (cfg->n_frames > 1) return acquire_frames(s, dst, cfg);
+
     // 1) Arm
     if (s->driver->arm(s) != 0) {
         return -1;
     }
     // 2) Wait until armed
     {
-        bool armed = false;
-        useconds_t waited = 0;
-        while (!armed && waited < ARM_TIMEOUT_US) { 
-            if (s->driver->check_if_armed(s, &armed) != 0) return -2;
-            if (!armed) { usleep(POLL_SLEEP_US); waited += POLL_SLEEP_US; }
-        }
-        if (!armed) return ACQ_ERR_ARM_TIMEOUT;  // -1000
+        int rc = engine_wait_armed(s, &arm_lat, ARM_TIMEOUT_MS);
+        if (rc != ACQ_OK) return rc; // ACQ_ERR_ARM_TIMEOUT (-1000) or driver error
         if (DEBUG) printf("Armed.");
-    } 
+    }
 
     // 3) Trigger
     simulate_trigger(s);
 
-    // 4) Wait for triggered
-    {   
-        const unsigned trig_timeout_ms  = s->timeout_ms;
-        const useconds_t trig_timeout_us = (useconds_t)trig_timeout_ms * 1000u;
-        bool triggered = false;
-        useconds_t waited = 0;
-        while (!triggered && waited < trig_timeout_us) {
-            if (s->driver->check_if_triggered(s, &triggered) != 0) return -3;
-            if (!triggered) { usleep(POLL_SLEEP_US); waited += POLL_SLEEP_US; }
-        }
-        if (!triggered) return ACQ_ERR_TRIGGER_TIMEOUT; // -1001
+    // 4) Wait for triggered (learned sleep + tight polling)
+    {
+        int rc = engine_wait_triggered(s, &trig_lat, s->timeout_ms);
+        if (rc != ACQ_OK) return rc; // ACQ_ERR_TRIGGER_TIMEOUT (-1001) or driver error
         if (DEBUG) printf("Triggered.");
     }
 
@@ -68,3 +91,42 @@ int acquire(Scope *s, uint8_t *dst, RunConfig *cfg) {
     if (DEBUG) printf("Trace acquired.\n");
 }
 
+
+// ---------------------------------------------------------------
+// Phased variant: the engine calls prepare_next(seq+1) on a second
+// thread while collect(seq) reads the waveform of the previous trace.
+// ---------------------------------------------------------------
+
+static int phased_prepare_next(uint64_t seq, const RunConfig *cfg) {
+    (void)seq; (void)cfg;
+    // -- Generate input #seq and load it into your target here (no scope access).
+    return 0;
+}
+
+static int phased_arm(Scope *s, uint64_t seq, const RunConfig *cfg) {
+    (void)seq; (void)cfg;
+    if (s->driver->arm(s) != 0) return -1;
+    return engine_wait_armed(s, &arm_lat, ARM_TIMEOUT_MS);
+}
+
+static int phased_trigger(Scope *s, uint64_t seq, const RunConfig *cfg) {
+    (void)seq; (void)cfg;
+    simulate_trigger(s); // -- start the prepared operation #seq on your target
+    return engine_wait_triggered(s, &trig_lat, s->timeout_ms);
+}
+
+static int phased_collect(Scope *s, uint8_t *dst, uint64_t seq, const RunConfig *cfg) {
+    (void)seq;
+    return s->driver->read_trace(s, dst, cfg);
+}
+
+static const AcquirePhases example_phases = {
+    .prepare_next = phased_prepare_next,
+    .arm          = phased_arm,
+    .trigger      = phased_trigger,
+    .collect      = phased_collect,
+};
+
+const AcquirePhases *acquire_phases(void) {
+    return PHASED ? &example_phases : NULL;
+}
@@ -3,12 +3,17 @@
 
 #include "engine/engine.h"
 #include "scope/scope.h"
+#include "scope/multiscope.h"
 #include "scope/rigol/ds1000ze.h"
 
 int acquire(Scope *s, uint8_t *dst, const RunConfig *cfg);
 int prep(Scope *s, const RunConfig *cfg);
 int cleanup(void);
 
+// Optional phased hook: an acquire file that defines acquire_phases() overrides this weak
+// default; files that only define acquire() keep building and run the serial loop.
+__attribute__((weak)) const AcquirePhases *acquire_phases(void) { return NULL; }
+
 int main(int argc, char **argv) {
     // Initialize the RunConfig and EngineCore
     EngineCore core = {0};
@@ -23,19 +28,30 @@ int main(int argc, char **argv) {
         printf("Output base path: %s\n", core.cfg->outfile);
     } 
 
-    // We currently acquire BYTE (8-bit) samples only
-    if (core.cfg->coding != 0) {
-        fprintf(stderr, "Only 8-bit BYTE waveform reads are supported. Use -w 0.\n");
-        return -2;
+    if (core.cfg->n_instr > 1) {
+        // Several -i: drive all instruments in parallel as one composite scope
+        Scope *subs[ENGINE_MAX_INSTRUMENTS] = {0};
+        for (uint8_t i = 0; i < core.cfg->n_instr; ++i) {
+            RunConfig one = {0};
+            one.instr_name = core.cfg->instr_names[i];
+            subs[i] = ds1000ze_new(&one);
+            if (!subs[i]) {
+                fprintf(stderr, "Failed to create scope object.\n");
+                return -3;
+            }
+        }
+        core.scope = multiscope_new(subs, core.cfg->n_instr);
+    } else {
+        core.scope = ds1000ze_new(core.cfg);
     }
-
-    core.scope = ds1000ze_new(core.cfg);
     if (!core.scope) {
         fprintf(stderr, "Failed to create scope object.\n");
         return -3;
     }
 
-    int rc = engine_run(&core, acquire, prep, cleanup);
+    const AcquirePhases *phases = acquire_phases();
+    int rc = phases ? engine_run_phased(&core, phases, prep, cleanup)
+                    : engine_run(&core, acquire, prep, cleanup);
     if (rc != 0) {
         fprintf(stderr, "[main] engine_run failed.\n");
         return -4;
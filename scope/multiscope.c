@@ -0,0 +1,437 @@
+#define _GNU_SOURCE
+#include "multiscope.h"
+#include "engine/engine.h"
+#include "engine/trace.h"
+#include "utils.h"
+
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+// --- Forward declarations for functions used in multiscope_driver ---
+static int  ms_init              (Scope *s, RunConfig *cfg);
+static void ms_destroy           (Scope *s);
+static int  ms_arm               (Scope *s);
+static int  ms_stop              (Scope *s);
+static int  ms_force_trigger     (Scope *s);
+static int  ms_read_trace        (Scope *s, uint8_t *dst, const RunConfig *cfg);
+static int  ms_check_if_armed    (Scope *s, bool *out);
+static int  ms_check_if_triggered(Scope *s, bool *out);
+static int  ms_wait_for_trigger  (Scope *s, unsigned timeout_ms);
+static int  ms_dump_log          (Scope *s, FILE *fp, const RunConfig *cfg);
+static int  ms_arm_record        (Scope *s, size_t n_frames);
+static int  ms_check_if_recorded (Scope *s, bool *out);
+static int  ms_read_frames       (Scope *s, uint8_t *dst, size_t n_frames, const RunConfig *cfg);
+static int  ms_calibrate_transfer(Scope *s, const RunConfig *cfg, FILE *report);
+static int  ms_reconnect         (Scope *s);
+// ---------------------------------------------------------
+
+static const ScopeDriver multiscope_driver = {
+    .init               = ms_init,
+    .destroy            = ms_destroy,
+    .arm                = ms_arm,
+    .stop               = ms_stop,
+    .force_trigger      = ms_force_trigger,
+    .read_trace         = ms_read_trace,
+    .check_if_armed     = ms_check_if_armed,
+    .check_if_triggered = ms_check_if_triggered,
+    .wait_for_trigger   = ms_wait_for_trigger,
+    .dump_log           = ms_dump_log,
+    .arm_record         = ms_arm_record,
+    .check_if_recorded  = ms_check_if_recorded,
+    .read_frames        = ms_read_frames,
+    .calibrate_transfer = ms_calibrate_transfer,
+    .reconnect          = ms_reconnect,
+};
+
+typedef enum {
+    MS_OP_ARM,
+    MS_OP_STOP,
+    MS_OP_FORCE_TRIGGER,
+    MS_OP_READ_TRACE,
+    MS_OP_CHECK_ARMED,
+    MS_OP_CHECK_TRIGGERED,
+    MS_OP_WAIT_TRIGGER,
+    MS_OP_ARM_RECORD,
+    MS_OP_CHECK_RECORDED,
+    MS_OP_READ_FRAMES,
+    MS_OP_RECONNECT,
+    MS_OP_EXIT,
+} MsOp;
+
+typedef struct MultiScope MultiScope;
+
+typedef struct {
+    pthread_t   thread;
+    MultiScope *ms;
+    Scope      *sub;
+    RunConfig   cfg;             // per-instrument config (own channel list)
+    size_t      offset;          // byte offset of this sub-trace inside a merged trace
+    size_t      bytes_per_trace; // this instrument's share of a merged trace
+    uint8_t    *scratch;         // read_frames staging (n_frames sub-traces)
+    int         rc;
+    bool        flag;
+} MsWorker;
+
+struct MultiScope {
+    MsWorker w[MULTISCOPE_MAX];
+    uint8_t  n;
+    bool     threads_up;
+
+    // - Op dispatch: one generation per op, all workers run it, last one signals done
+    pthread_mutex_t mutex;
+    pthread_cond_t  condvar_go;
+    pthread_cond_t  condvar_done;
+    uint64_t gen;
+    uint8_t  pending;
+    MsOp     op;
+    unsigned arg_timeout_ms;
+    size_t   arg_n;
+    uint8_t *arg_dst;
+
+    size_t   bytes_per_trace;    // merged trace
+};
+
+Scope *multiscope_new(Scope **subs, uint8_t n) {
+    if (!subs || n == 0 || n > MULTISCOPE_MAX) return NULL;
+    Scope *s = calloc(1, sizeof *s);
+    MultiScope *ms = calloc(1, sizeof *ms);
+    if (!s || !ms) { free(s); free(ms); return NULL; }
+
+    ms->n = n;
+    for (uint8_t i = 0; i < n; ++i) {
+        if (!subs[i]) { free(s); free(ms); return NULL; }
+        ms->w[i].ms  = ms;
+        ms->w[i].sub = subs[i];
+    }
+    s->driver = &multiscope_driver;
+    s->priv   = ms;
+    return s;
+}
+
+// ===============================================================
+// ============= Worker threads
+// ===============================================================
+
+static int ms_exec(MsWorker *w, MsOp op, unsigned timeout_ms, size_t n, uint8_t *dst) {
+    Scope *sub = w->sub;
+    const ScopeDriver *d = sub->driver;
+    w->flag = false;
+
+    switch (op) {
+        case MS_OP_ARM:           return d->arm(sub);
+        case MS_OP_STOP:          return d->stop(sub);
+        case MS_OP_FORCE_TRIGGER: return d->force_trigger(sub);
+        case MS_OP_READ_TRACE:    return d->read_trace(sub, dst + w->offset, &w->cfg);
+        case MS_OP_CHECK_ARMED:   return d->check_if_armed(sub, &w->flag);
+        case MS_OP_CHECK_TRIGGERED: return d->check_if_triggered(sub, &w->flag);
+        case MS_OP_WAIT_TRIGGER:
+            if (d->wait_for_trigger) return d->wait_for_trigger(sub, timeout_ms);
+            return scope_poll_until(sub, d->check_if_triggered, timeout_ms);
+        case MS_OP_ARM_RECORD:
+            return d->arm_record ? d->arm_record(sub, n) : -1;
+        case MS_OP_CHECK_RECORDED:
+            return d->check_if_recorded ? d->check_if_recorded(sub, &w->flag) : -1;
+        case MS_OP_READ_FRAMES: {
+            if (!d->read_frames || !w->scratch) return -1;
+            int rc = d->read_frames(sub, w->scratch, n, &w->cfg);
+            if (rc != 0) return rc;
+            // scatter: frame f of this instrument -> merged trace f at our offset
+            for (size_t f = 0; f < n; ++f) {
+                memcpy(dst + f * w->ms->bytes_per_trace + w->offset,
+                       w->scratch + f * w->bytes_per_trace, w->bytes_per_trace);
+            }
+            return 0;
+        }
+        case MS_OP_RECONNECT:
+            return d->reconnect ? d->reconnect(sub) : scope_reconnect(sub);
+        case MS_OP_EXIT:
+            return 0;
+    }
+    return -1;
+}
+
+static void *ms_worker_func(void *arg) {
+    static const char *const names[] = { "scope0", "scope1", "scope2", "scope3", "scope4", "scope5", "scope6", "scope7" };
+    MsWorker *w = (MsWorker*)arg;
+    MultiScope *ms = w->ms;
+    uint64_t seen = 0;
+    const size_t idx = (size_t)(w - ms->w);
+    trace_thread_name(idx < sizeof names / sizeof names[0] ? names[idx] : "scope");
+    (void)affinity_apply(&w->cfg.sched, AFFINITY_WORKER, NULL, 0);
+
+    for (;;) {
+        pthread_mutex_lock(&ms->mutex);
+        while (ms->gen == seen) {
+            pthread_cond_wait(&ms->condvar_go, &ms->mutex);
+        }
+        seen = ms->gen;
+        MsOp op = ms->op;
+        unsigned tmo = ms->arg_timeout_ms;
+        size_t n = ms->arg_n;
+        uint8_t *dst = ms->arg_dst;
+        pthread_mutex_unlock(&ms->mutex);
+
+        w->rc = ms_exec(w, op, tmo, n, dst);
+
+        pthread_mutex_lock(&ms->mutex);
+        if (--ms->pending == 0) pthread_cond_signal(&ms->condvar_done);
+        pthread_mutex_unlock(&ms->mutex);
+
+        if (op == MS_OP_EXIT) break;
+    }
+    return NULL;
+}
+
+// Run op on every instrument in parallel; returns first error, else largest positive rc
+// (e.g. 1 = timeout), else 0. *all_flags (optional) = AND of the per-instrument flags.
+static int ms_dispatch(MultiScope *ms, MsOp op, unsigned timeout_ms, size_t n, uint8_t *dst,
+                       bool *all_flags) {
+    if (!ms->threads_up) return -1;
+
+    pthread_mutex_lock(&ms->mutex);
+    ms->op = op;
+    ms->arg_timeout_ms = timeout_ms;
+    ms->arg_n = n;
+    ms->arg_dst = dst;
+    ms->pending = ms->n;
+    ms->gen++;
+    pthread_cond_broadcast(&ms->condvar_go);
+    while (ms->pending != 0) {
+        pthread_cond_wait(&ms->condvar_done, &ms->mutex);
+    }
+    pthread_mutex_unlock(&ms->mutex);
+
+    int rc = 0;
+    bool all = true;
+    for (uint8_t i = 0; i < ms->n; ++i) {
+        int r = ms->w[i].rc;
+        if (r < 0 && rc >= 0) rc = r;
+        else if (r > rc && rc >= 0) rc = r;
+        all = all && ms->w[i].flag;
+    }
+    if (all_flags) *all_flags = all;
+    return rc;
+}
+
+// ===============================================================
+// ============= Driver ops
+// ===============================================================
+
+static int ms_init(Scope *s, RunConfig *cfg) {
+    if (!s || !s->priv || !cfg) return -1;
+    MultiScope *ms = (MultiScope*)s->priv;
+
+    if (cfg->stream) {
+        fprintf(stderr, "[multiscope] --stream is not supported with several instruments\n");
+        return -2;
+    }
+
+    // 1) Per-instrument configs share the user's channel list and sizing options
+    for (uint8_t i = 0; i < ms->n; ++i) {
+        MsWorker *w = &ms->w[i];
+        destroy_run_config(&w->cfg);
+        w->cfg.coding         = cfg->coding;
+        w->cfg.keep_high_byte = cfg->keep_high_byte;
+        w->cfg.n_samples      = cfg->n_samples;
+        w->cfg.raw_start_idx  = cfg->raw_start_idx;
+        w->cfg.n_traces       = cfg->n_traces;
+        w->cfg.n_flush_traces = cfg->n_flush_traces;
+        w->cfg.n_frames       = cfg->n_frames;
+        w->cfg.verbose        = cfg->verbose;
+        w->cfg.diagnose       = cfg->diagnose;
+        w->cfg.sched          = cfg->sched;
+        for (uint8_t c = 0; c < cfg->n_channels; ++c) {
+            if (add_channel(&w->cfg, cfg->channels[c]) == -2) return -3;
+        }
+        w->sub->stats = s->stats; // timings land in the engine's histograms (atomic adds)
+        if (w->sub->driver->init(w->sub, &w->cfg) != 0) {
+            fprintf(stderr, "[multiscope] init of instrument %u failed.\n", (unsigned)i);
+            return -4;
+        }
+    }
+
+    // 2) Traces are merged sample-for-sample: every instrument must read the same window
+    const size_t n_samples = ms->w[0].cfg.n_samples;
+    for (uint8_t i = 1; i < ms->n; ++i) {
+        if (ms->w[i].cfg.n_samples != n_samples) {
+            fprintf(stderr, "[multiscope] instruments disagree on n_samples (%zu vs %zu); pass --nsamples.\n",
+                    n_samples, ms->w[i].cfg.n_samples);
+            return -5;
+        }
+    }
+
+    // 3) Merged layout: instrument 0 channels, then instrument 1, ...
+    const size_t bps = run_config_sample_bytes(cfg);
+    size_t off = 0;
+    for (uint8_t i = 0; i < ms->n; ++i) {
+        MsWorker *w = &ms->w[i];
+        w->offset = off;
+        w->bytes_per_trace = n_samples * w->cfg.n_channels * bps;
+        off += w->bytes_per_trace;
+
+        free(w->scratch);
+        w->scratch = NULL;
+        if (cfg->n_frames > 1) {
+            w->scratch = malloc(cfg->n_frames * w->bytes_per_trace);
+            if (!w->scratch) return -6;
+        }
+    }
+    ms->bytes_per_trace = off;
+
+    // 4) Engine sees one instrument with the union of channels ("S<i>.<chan>")
+    for (uint8_t c = 0; c < cfg->n_channels; ++c) free(cfg->channels[c]);
+    free(cfg->channels);
+    cfg->channels = NULL;
+    cfg->n_channels = 0;
+    for (uint8_t i = 0; i < ms->n; ++i) {
+        for (uint8_t c = 0; c < ms->w[i].cfg.n_channels; ++c) {
+            char name[64];
+            snprintf(name, sizeof name, "S%u.%s", (unsigned)i, ms->w[i].cfg.channels[c]);
+            if (add_channel(cfg, name) != 0) {
+                fprintf(stderr, "[multiscope] too many channels in total (max %d).\n", SCOPE_MAX_CHANS);
+                return -7;
+            }
+        }
+    }
+    cfg->n_samples     = n_samples;
+    cfg->raw_start_idx = 1;
+
+    // Longest I/O timeout wins
+    s->timeout_ms = 0;
+    for (uint8_t i = 0; i < ms->n; ++i) {
+        if (ms->w[i].sub->timeout_ms > s->timeout_ms) s->timeout_ms = ms->w[i].sub->timeout_ms;
+    }
+
+    // 5) One worker thread per instrument
+    if (!ms->threads_up) {
+        pthread_mutex_init(&ms->mutex, NULL);
+        pthread_cond_init(&ms->condvar_go, NULL);
+        pthread_cond_init(&ms->condvar_done, NULL);
+        ms->gen = 0;
+        uint8_t started = 0;
+        for (; started < ms->n; ++started) {
+            if (pthread_create(&ms->w[started].thread, NULL, ms_worker_func, &ms->w[started]) != 0) break;
+        }
+        if (started != ms->n) {
+            // unwind the threads that did start
+            pthread_mutex_lock(&ms->mutex);
+            ms->op = MS_OP_EXIT;
+            ms->pending = started;
+            ms->gen++;
+            pthread_cond_broadcast(&ms->condvar_go);
+            pthread_mutex_unlock(&ms->mutex);
+            for (uint8_t i = 0; i < started; ++i) pthread_join(ms->w[i].thread, NULL);
+            pthread_cond_destroy(&ms->condvar_go);
+            pthread_cond_destroy(&ms->condvar_done);
+            pthread_mutex_destroy(&ms->mutex);
+            fprintf(stderr, "[multiscope] pthread_create failed.\n");
+            return -8;
+        }
+        ms->threads_up = true;
+    }
+    return 0;
+}
+
+static void ms_destroy(Scope *s) {
+    if (!s) return;
+    MultiScope *ms = (MultiScope*)s->priv;
+    if (ms) {
+        if (ms->threads_up) {
+            (void)ms_dispatch(ms, MS_OP_EXIT, 0, 0, NULL, NULL);
+            for (uint8_t i = 0; i < ms->n; ++i) pthread_join(ms->w[i].thread, NULL);
+            pthread_cond_destroy(&ms->condvar_go);
+            pthread_cond_destroy(&ms->condvar_done);
+            pthread_mutex_destroy(&ms->mutex);
+        }
+        for (uint8_t i = 0; i < ms->n; ++i) {
+            ms->w[i].sub->driver->destroy(ms->w[i].sub);
+            destroy_run_config(&ms->w[i].cfg);
+            free(ms->w[i].scratch);
+        }
+        free(ms);
+    }
+    free(s);
+}
+
+static int ms_arm(Scope *s) {
+    return ms_dispatch((MultiScope*)s->priv, MS_OP_ARM, 0, 0, NULL, NULL);
+}
+
+static int ms_stop(Scope *s) {
+    return ms_dispatch((MultiScope*)s->priv, MS_OP_STOP, 0, 0, NULL, NULL);
+}
+
+static int ms_force_trigger(Scope *s) {
+    return ms_dispatch((MultiScope*)s->priv, MS_OP_FORCE_TRIGGER, 0, 0, NULL, NULL);
+}
+
+static int ms_read_trace(Scope *s, uint8_t *dst, const RunConfig *cfg) {
+    (void)cfg; // each instrument reads with its own config
+    if (!dst) return -1;
+    return ms_dispatch((MultiScope*)s->priv, MS_OP_READ_TRACE, 0, 0, dst, NULL);
+}
+
+static int ms_check_if_armed(Scope *s, bool *armed) {
+    if (!armed) return -1;
+    return ms_dispatch((MultiScope*)s->priv, MS_OP_CHECK_ARMED, 0, 0, NULL, armed);
+}
+
+static int ms_check_if_triggered(Scope *s, bool *triggered) {
+    if (!triggered) return -1;
+    return ms_dispatch((MultiScope*)s->priv, MS_OP_CHECK_TRIGGERED, 0, 0, NULL, triggered);
+}
+
+static int ms_wait_for_trigger(Scope *s, unsigned timeout_ms) {
+    if (timeout_ms == 0) timeout_ms = s->timeout_ms;
+    return ms_dispatch((MultiScope*)s->priv, MS_OP_WAIT_TRIGGER, timeout_ms, 0, NULL, NULL);
+}
+
+static int ms_arm_record(Scope *s, size_t n_frames) {
+    return ms_dispatch((MultiScope*)s->priv, MS_OP_ARM_RECORD, 0, n_frames, NULL, NULL);
+}
+
+static int ms_check_if_recorded(Scope *s, bool *done) {
+    if (!done) return -1;
+    return ms_dispatch((MultiScope*)s->priv, MS_OP_CHECK_RECORDED, 0, 0, NULL, done);
+}
+
+static int ms_read_frames(Scope *s, uint8_t *dst, size_t n_frames, const RunConfig *cfg) {
+    if (!dst || !cfg || n_frames == 0 || n_frames > cfg->n_frames) return -1;
+    return ms_dispatch((MultiScope*)s->priv, MS_OP_READ_FRAMES, 0, n_frames, dst, NULL);
+}
+
+static int ms_reconnect(Scope *s) {
+    return ms_dispatch((MultiScope*)s->priv, MS_OP_RECONNECT, 0, 0, NULL, NULL);
+}
+
+static int ms_dump_log(Scope *s, FILE *fp_log, const RunConfig *cfg) {
+    if (!s || !fp_log || !cfg) return -1;
+    MultiScope *ms = (MultiScope*)s->priv;
+    int first_error_rc = 0;
+
+    if (fprintf(fp_log, "MULTISCOPE.N=%u\n", (unsigned)ms->n) < 0) return -2;
+    for (uint8_t i = 0; i < ms->n; ++i) {
+        if (fprintf(fp_log, "MULTISCOPE.SCOPE=%u\nMULTISCOPE.OFFSET_BYTES=%zu\n",
+                    (unsigned)i, ms->w[i].offset) < 0) return -2;
+        int rc = ms->w[i].sub->driver->dump_log(ms->w[i].sub, fp_log, &ms->w[i].cfg);
+        if (rc != 0 && first_error_rc == 0) first_error_rc = rc;
+    }
+    fflush(fp_log);
+    return first_error_rc;
+}
+
+static int ms_calibrate_transfer(Scope *s, const RunConfig *cfg, FILE *report) {
+    (void)cfg;
+    MultiScope *ms = (MultiScope*)s->priv;
+    int first_error_rc = 0;
+    for (uint8_t i = 0; i < ms->n; ++i) {
+        Scope *sub = ms->w[i].sub;
+        if (!sub->driver->calibrate_transfer) continue;
+        if (report) fprintf(report, "[instrument %u]\n", (unsigned)i);
+        int rc = sub->driver->calibrate_transfer(sub, &ms->w[i].cfg, report);
+        if (rc != 0 && first_error_rc == 0) first_error_rc = rc;
+    }
+    return first_error_rc;
+}
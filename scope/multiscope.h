@@ -0,0 +1,17 @@
+#ifndef MULTISCOPE_H
+#define MULTISCOPE_H
+
+#include "scope.h"
+
+#ifndef MULTISCOPE_MAX
+#define MULTISCOPE_MAX 4
+#endif
+
+/* Composite scope: drives n already-created sub-scopes (each with its own driver) as one
+   instrument. Every vtable op runs on one worker thread per sub-scope in parallel; a trace
+   is the concatenation of the sub-scopes' traces (scope 0 channels first), so the engine's
+   trace index is the shared sequence number. Takes ownership of subs[]; engine channel
+   names become "S<i>.<chan>". Not combinable with --stream. */
+Scope *multiscope_new(Scope **subs, uint8_t n);
+
+#endif
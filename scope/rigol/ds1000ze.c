@@ -1,5 +1,8 @@
+#define _GNU_SOURCE
 #include "ds1000ze.h"
 #include "engine/engine.h"
+#include "engine/latency.h"
+#include "engine/trace.h"
 #include "utils.h"
 #include <unistd.h> 
 
@@ -18,13 +21,31 @@ static int  ds1000ze_force_trigger   (Scope *s);
 static int  ds1000ze_read_trace      (Scope *s, uint8_t *dst, const RunConfig *cfg);
 static int  ds1000ze_check_if_armed  (Scope *s, bool *out);
 static int  ds1000ze_check_if_triggered(Scope *s, bool *out);
+static int  ds1000ze_wait_for_trigger(Scope *s, unsigned timeout_ms);
 static int  ds1000ze_dump_log        (Scope *s, FILE *fp, const RunConfig *cfg);
 static int  ds1000ze_get_n_samples   (Scope *s, size_t *out, size_t *raw_start_idx);
 static int  ds1000ze_list_displayed_channels(Scope *s, char ***out, uint8_t *out_n);
+static int  ds1000ze_arm_record      (Scope *s, size_t n_frames);
+static int  ds1000ze_check_if_recorded(Scope *s, bool *done);
+static int  ds1000ze_read_frames     (Scope *s, uint8_t *dst, size_t n_frames, const RunConfig *cfg);
 // helpers used before definition
 //static int  ds1000ze_get_sampling_rate(Scope *s, double *sampling_rate);
 static int  ds1000ze_get_channels_properties(Scope *s, FILE *fp_log, const RunConfig *cfg);
+
 static inline size_t max_points_per_read(uint8_t coding);
+static int  ds1000ze_calibrate_transfer(Scope *s, const RunConfig *cfg, FILE *report);
+static int  ds1000ze_load_transfer_cache(Scope *s, const char *idn);
+
+/* Instrument profile: results of init-time probing, reused while the fingerprint matches */
+typedef struct {
+    char   fingerprint[256];  /* timebase/acquire/display state answers, ';'-joined */
+    char   channels[128];     /* displayed sources, comma-separated ("" => unknown) */
+    size_t n_samples;         /* 0 => unknown */
+    size_t raw_start_idx;
+} Ds1000zeProfile;
+static int ds1000ze_state_fingerprint(Scope *s, char *fp, size_t cap);
+static int ds1000ze_load_profile(const char *idn, const char *fingerprint, Ds1000zeProfile *prof);
+static int ds1000ze_save_profile(const char *idn, const Ds1000zeProfile *prof);
 //static int ds1000ze_prime_record(Scope *s);
 typedef struct {
     int    format, type;
@@ -33,6 +54,7 @@ typedef struct {
     int    xref, yref;
 } RigolPreamble;
 static int ds1000ze_query_preamble(Scope *s, RigolPreamble *pr);
+static void ds1000ze_parse_preamble(const char *pre, RigolPreamble *pr);
 // ---------------------------------------------------------
 
 static const ScopeDriver ds1000ze_driver = {
@@ -44,8 +66,13 @@ static const ScopeDriver ds1000ze_driver = {
     .read_trace         = ds1000ze_read_trace,
     .check_if_armed     = ds1000ze_check_if_armed,
     .check_if_triggered = ds1000ze_check_if_triggered,
+    .wait_for_trigger   = ds1000ze_wait_for_trigger,
     .dump_log           = ds1000ze_dump_log,
     .list_displayed_channels = ds1000ze_list_displayed_channels,
+    .arm_record         = ds1000ze_arm_record,
+    .check_if_recorded  = ds1000ze_check_if_recorded,
+    .read_frames        = ds1000ze_read_frames,
+    .calibrate_transfer = ds1000ze_calibrate_transfer,
 };
 
 Scope *ds1000ze_new(RunConfig *cfg) {
@@ -54,6 +81,8 @@ Scope *ds1000ze_new(RunConfig *cfg) {
     if (!s) return NULL;
     s->driver = &ds1000ze_driver;
     s->instr_name = cfg->instr_name ? strdup(cfg->instr_name) : NULL;  // own copy
+    s->priv = calloc(1, sizeof(Ds1000zeProfile));
+    if (!s->priv) { free(s->instr_name); free(s); return NULL; }
     return s;
 }
 
@@ -77,7 +106,29 @@ static int ds1000ze_init(Scope *s, RunConfig *cfg){
         }
     }
 
-    // If user didn’t pass channels, query displayed sources (incl. MATH/FFT)
+    char idn[128] = {0};
+    (void)scope_query(s, "*IDN?", idn, sizeof idn);
+
+    // Chunk/buffer sizes from a previous calibration (--diagnose), if cached
+    if (ds1000ze_load_transfer_cache(s, idn) == 0 && cfg->verbose) {
+        fprintf(stdout, "[ds1000ze] cached transfer tuning: chunk=%zu pts, read_buf=%u B\n",
+                s->read_chunk_pts, s->read_buf_bytes);
+    }
+
+    // Profile of a previous run with the same IDN and front-panel state (skips probing below)
+    Ds1000zeProfile *prof = (Ds1000zeProfile*)s->priv;
+    memset(prof, 0, sizeof *prof);
+    bool have_fp = idn[0] && ds1000ze_state_fingerprint(s, prof->fingerprint, sizeof prof->fingerprint) == 0;
+    bool hit = have_fp && ds1000ze_load_profile(idn, prof->fingerprint, prof) == 0;
+    if (hit && cfg->verbose) {
+        fprintf(stdout, "[ds1000ze] profile cache hit: channels=%s nsamples=%zu\n",
+                prof->channels[0] ? prof->channels : "-", prof->n_samples);
+    }
+
+    // If user didn’t pass channels, query displayed sources (incl. MATH)
+    if ((cfg->n_channels == 0 || !cfg->channels || !cfg->channels[0]) && prof->channels[0]) {
+        (void)parse_channels_list(cfg, prof->channels);
+    }
     if (cfg->n_channels == 0 || !cfg->channels || !cfg->channels[0]) {
         char **srcs = NULL; uint8_t nsrc = 0;
         if (s->driver->list_displayed_channels &&
@@ -85,9 +136,12 @@ static int ds1000ze_init(Scope *s, RunConfig *cfg){
             nsrc > 0) {
             for (uint8_t i = 0; i < nsrc; ++i) {
                 (void)add_channel(cfg, srcs[i]); // ignore dup/capacity errors quietly
+                if (prof->channels[0]) strncat(prof->channels, ",", sizeof prof->channels - strlen(prof->channels) - 1);
+                strncat(prof->channels, srcs[i], sizeof prof->channels - strlen(prof->channels) - 1);
                 free(srcs[i]);
             }
             free(srcs);
+            hit = false; /* learned the displayed sources */
         }
         // Fallback to CHAN1 if still empty
         if (cfg->n_channels == 0) 
@@ -98,22 +152,48 @@ static int ds1000ze_init(Scope *s, RunConfig *cfg){
     ds1000ze_stop(s);
 
     // Configure format/mode
+    // (scope_config journals these so scope_reconnect can replay them)
     char cmd[32];
     snprintf(cmd, sizeof cmd, ":WAV:FORM %s", (cfg->coding == 0) ? "BYTE" : "WORD");
-    if (scope_writeline(s, cmd, 0) != 0) { 
+    if (scope_config(s, cmd) != 0) { 
         fprintf(stderr,"\"%s\" failed\n", cmd); 
         return -4; 
     }
-    if (scope_writeline(s, ":WAV:MODE RAW", 0) != 0) {  //:WAV:MODE NORM if you want to acquire in HIGHRES mode or other modes. or MATH/FFT channels!
+    if (scope_config(s, ":WAV:MODE RAW") != 0) {  //:WAV:MODE NORM if you want to acquire in HIGHRES mode or other modes. or MATH/FFT channels!
         fprintf(stderr,":WAV:MODE RAW failed\n"); 
         return -5; 
     }
 
-    if (scope_writeline(s, ":TRIG:SWE SING", 0) != 0) { 
+    if (scope_config(s, ":TRIG:SWE SING") != 0) { 
         fprintf(stderr,":TRIG:SWE SING failed\n"); 
         return -5; 
     }
 
+    /* read_trace only switches :WAV:SOUR with several channels; pin the single one */
+    if (cfg->n_channels == 1) {
+        char src[48];
+        snprintf(src, sizeof src, ":WAV:SOUR %s", cfg->channels[0]);
+        if (scope_config(s, src) != 0) {
+            fprintf(stderr,"\"%s\" failed\n", src);
+            return -5;
+        }
+    }
+
+    /* Waveform record (segmented memory) for multi-frame arm cycles */
+    if (cfg->n_frames > 1) {
+        size_t fmax = 0;
+        if (scope_config(s, ":FUNC:WREC:ENAB ON") != 0 ||
+            scope_query_u64(s, ":FUNC:WREC:FMAX?", &fmax) != 0) {
+            fprintf(stderr,"waveform record unavailable\n");
+            return -6;
+        }
+        if (cfg->n_frames > fmax) {
+            fprintf(stderr,"--frames %zu exceeds waveform record capacity (%zu) at this depth\n",
+                    cfg->n_frames, fmax);
+            return -7;
+        }
+    }
+
    
     /* Prefer AUTO memory depth so the scope chooses a sensible record length for the current timebase. */
     //(void)scope_writeline(s, ":ACQ:MDEP AUTO",  0);
@@ -124,8 +204,11 @@ static int ds1000ze_init(Scope *s, RunConfig *cfg){
     // }
 
 
-    // Read n_samples
-    if (cfg->n_samples == 0){
+    // Read n_samples (the preamble/timebase probe may prime a capture: ~1 s)
+    if (cfg->n_samples == 0 && prof->n_samples > 0) {
+        cfg->n_samples     = prof->n_samples;
+        cfg->raw_start_idx = prof->raw_start_idx;
+    } else if (cfg->n_samples == 0){
         size_t L = 1;
         int rc = ds1000ze_get_n_samples(s, &cfg->n_samples, &L);
         if (rc != 0) {
@@ -133,8 +216,14 @@ static int ds1000ze_init(Scope *s, RunConfig *cfg){
             return -8;
         }
         cfg->raw_start_idx = L;
+        prof->n_samples     = cfg->n_samples;
+        prof->raw_start_idx = L;
+        hit = false; /* learned something new */
     }
 
+    if (have_fp && !hit) (void)ds1000ze_save_profile(idn, prof);
+    if (!have_fp) memset(prof, 0, sizeof *prof); /* state unknown: never reuse */
+
     return 0;
 }
 
@@ -148,7 +237,13 @@ static int ds1000ze_force_trigger(Scope *s) {
 }
 
 static int ds1000ze_arm(Scope *s) {
-    return scope_writeline(s, ":SING", 5);
+    if (!s) return -1;
+    const uint64_t t0 = latency_now_ns();
+    const uint64_t tt = trace_begin();
+    int rc = scope_writeline(s, ":SING", 5);
+    phase_stats_add(s->stats, PHASE_ARM, latency_now_ns() - t0);
+    trace_end("phase", phase_name(PHASE_ARM), tt, 0);
+    return rc;
 }
 
 // static int ds1000ze_check_if_armed(Scope *s, bool *armed) {
@@ -217,18 +312,35 @@ static int ds1000ze_check_if_triggered(Scope *s, bool *triggered) {
     return 0;
 }
 
+/* The DS1000Z status system has only the IEEE 488.2 common registers: *OPC completes once
+   :SING is parsed, not when the sweep triggers, so there is no event to wait on (no SRQ).
+   Adaptive polling of :TRIG:STAT? it is. */
+static int ds1000ze_wait_for_trigger(Scope *s, unsigned timeout_ms) {
+    if (!s) return -1;
+    if (timeout_ms == 0) timeout_ms = s->timeout_ms;
+    return scope_poll_until(s, ds1000ze_check_if_triggered, timeout_ms);
+}
+
 static inline size_t max_points_per_read(uint8_t coding) {
     /* BYTE => 250k, WORD => 125k (Rigol DS1000Z/E manual) */
     return (coding == 0) ? 250000u : 125000u;
 }
 
+/* Calibrated chunk (if any), never above the manual's per-read limit */
+static inline size_t chunk_points(const Scope *s, uint8_t coding) {
+    const size_t max_pts = max_points_per_read(coding);
+    return (s->read_chunk_pts && s->read_chunk_pts < max_pts) ? s->read_chunk_pts : max_pts;
+}
+
 static int ds1000ze_read_trace(Scope *s, uint8_t *dst, const RunConfig *cfg) {
-    if (!s || !dst || !cfg || !cfg->channels || cfg->n_channels == 0) return -1;
+    if (!s || (!dst && !s->stream) || !cfg || !cfg->channels || cfg->n_channels == 0) return -1;
     if (cfg->n_samples == 0 || cfg->raw_start_idx == 0) return -2;  /* must be set at init */
 
-    const size_t bps           = (size_t)(cfg->coding + 1);
+    /* WORD carries 8 significant bits in 16: pack to 1 B/sample unless keep_high_byte */
+    const size_t bps           = run_config_sample_bytes(cfg);
+    const bool   narrow        = (cfg->coding == 1 && bps == 1);
     const size_t bytes_per_ch  = cfg->n_samples * bps;
-    const size_t chunk_pts     = max_points_per_read(cfg->coding);
+    const size_t chunk_pts     = chunk_points(s, cfg->coding);
 
     // /* Generous read timeout for chunked RAW transfers */
     // if (s->timeout_ms < 15000) viSetAttribute(s->instr, VI_ATTR_TMO_VALUE, (ViAttrState)15000);
@@ -244,11 +356,13 @@ static int ds1000ze_read_trace(Scope *s, uint8_t *dst, const RunConfig *cfg) {
 
         size_t remaining = cfg->n_samples;
         size_t start     = cfg->raw_start_idx;     /* ← precomputed at init */
-        uint8_t *out_ch  = dst + ((size_t)ch_i * bytes_per_ch);
+        uint8_t *out_ch  = dst ? dst + ((size_t)ch_i * bytes_per_ch) : NULL;
 
         while (remaining > 0) {
             const size_t this_pts = (remaining > chunk_pts) ? chunk_pts : remaining;
             const size_t stop     = start + this_pts - 1;
+            const uint64_t t0     = latency_now_ns();
+            const uint64_t tt     = trace_begin(); /* timeline event spans the slot wait too */
 
             /* One write per chunk: set START, STOP, then request DATA */
             int n = snprintf(cmd, sizeof cmd, ":WAV:STARt %zu;:WAV:STOP %zu;:WAV:DATA?\n", start, stop);
@@ -259,10 +373,29 @@ static int ds1000ze_read_trace(Scope *s, uint8_t *dst, const RunConfig *cfg) {
             /* One read per chunk: exact SCPI definite-length block */
             const size_t need = this_pts * bps;
             size_t got = 0;
-            if (scope_read_defblock(s, out_ch, need, &got) != 0) return -6;
+            uint8_t *buf = out_ch;
+            uint64_t t_slot = 0; /* writer back-pressure, accounted as handoff wait */
+            if (s->stream) {
+                /* Streaming: chunk goes to the writer while the next one transfers */
+                const uint64_t tb = latency_now_ns();
+                buf = s->stream->get_buf(s->stream->ctx, need);
+                if (!buf) return -8;
+                t_slot = latency_now_ns() - tb;
+            }
+            if (narrow) {
+                if (scope_read_defblock_word(s, buf, this_pts, &got) != 0) return -6;
+            } else {
+                if (scope_read_defblock(s, buf, need, &got) != 0) return -6;
+            }
             if (got != need) return -7;
+            phase_stats_add(s->stats, PHASE_READ_CHUNK, latency_now_ns() - t0 - t_slot);
+            trace_end("phase", phase_name(PHASE_READ_CHUNK), tt, got);
+            if (s->stream) {
+                if (s->stream->commit(s->stream->ctx, buf, got) != 0) return -9;
+            } else {
+                out_ch += got;
+            }
 
-            out_ch    += got;
             start     += this_pts;
             remaining -= this_pts;
         }
@@ -271,6 +404,42 @@ static int ds1000ze_read_trace(Scope *s, uint8_t *dst, const RunConfig *cfg) {
 }
 
 
+static int ds1000ze_arm_record(Scope *s, size_t n_frames) {
+    if (!s || n_frames == 0) return -1;
+    char cmd[64];
+    snprintf(cmd, sizeof cmd, ":FUNC:WREC:FEND %zu;:FUNC:WREC:OPER RUN", n_frames);
+    return scope_writeline(s, cmd, 0);
+}
+
+static int ds1000ze_check_if_recorded(Scope *s, bool *done) {
+    char resp[16];
+    if (!s || !done)
+        return -1;
+
+    if (scope_query(s, ":FUNC:WREC:OPER?", resp, sizeof resp) < 0)
+        return -2;
+
+    // Recording stops by itself once FEND frames were captured
+    *done = (resp[0] == 'S');
+    return 0;
+}
+
+static int ds1000ze_read_frames(Scope *s, uint8_t *dst, size_t n_frames, const RunConfig *cfg) {
+    if (!s || (!dst && !s->stream) || !cfg || n_frames == 0) return -1;
+
+    const size_t bytes_per_trace = cfg->n_samples * (size_t)cfg->n_channels * run_config_sample_bytes(cfg);
+    char cmd[48];
+
+    /* Replay each recorded frame (1-based) and read it like a single capture */
+    for (size_t f = 0; f < n_frames; ++f) {
+        snprintf(cmd, sizeof cmd, ":FUNC:WREP:FCUR %zu", f + 1);
+        if (scope_writeline(s, cmd, 0) != 0) return -2;
+        int rc = ds1000ze_read_trace(s, dst ? dst + f * bytes_per_trace : NULL, cfg);
+        if (rc != 0) return -3;
+    }
+    return 0;
+}
+
 static int ds1000ze_dump_log(Scope *s, FILE *fp_log, const RunConfig *cfg){
     if (!s || !fp_log || !cfg) return -1;
     int first_error_rc = 0;
@@ -278,11 +447,15 @@ static int ds1000ze_dump_log(Scope *s, FILE *fp_log, const RunConfig *cfg){
     // 0) Identify instrument (resource + IDN)
     const char *visa = s->instr_name ? s->instr_name : (cfg && cfg->instr_name ? cfg->instr_name : "");
     if (fprintf(fp_log, "INSTR_NAME=\"%s\"\n", visa) < 0) return -2;
-    char idn[256] = {0};
-    if (scope_query(s, "*IDN?", idn, sizeof idn) == 0) {
-        /* strip trailing CR/LF if any */
-        size_t cut = strcspn(idn, "\r\n");
-        idn[cut] = '\0';
+
+    /* IDN, mode and preamble in one round trip */
+    static const char *const hdr_q[] = { "*IDN?", ":WAV:MODE?", ":WAV:PRE?" };
+    char hdr[512] = {0};
+    char *hf[3] = {0};
+    if (scope_query_multi(s, hdr_q, 3, hdr, sizeof hdr, hf) < 0) hf[0] = hf[1] = hf[2] = NULL;
+
+    const char *idn = hf[0];
+    if (idn) {
         if (fprintf(fp_log, "IDN=\"%s\"\n", idn) < 0) return -2;
     } else {
         if (fprintf(fp_log, "IDN=FAILED\n") < 0) return -2;
@@ -296,9 +469,8 @@ static int ds1000ze_dump_log(Scope *s, FILE *fp_log, const RunConfig *cfg){
     }
     if (fprintf(fp_log, "CHANNELS=%s\n", chbuf) < 0) return -2;
     // WAV:MODE? (RAW/NORM/MAX)
-    char wmode[32] = {0};
-    if (scope_query(s, ":WAV:MODE?", wmode, sizeof wmode) == 0) {
-        wmode[strcspn(wmode, "\r\n")] = '\0';
+    const char *wmode = hf[1];
+    if (wmode) {
         if (fprintf(fp_log, "WAV:MODE=%s\n", wmode) < 0) return -2;
     } else {
         if (fprintf(fp_log, "WAV:MODE=FAILED\n") < 0) return -2;
@@ -310,8 +482,9 @@ static int ds1000ze_dump_log(Scope *s, FILE *fp_log, const RunConfig *cfg){
 
     // 2) Preamble (ground truth for points & scaling)
     RigolPreamble pr = {0};
-    rc = ds1000ze_query_preamble(s, &pr);
+    rc = hf[2] ? 0 : -2;
     if (rc == 0) {
+        ds1000ze_parse_preamble(hf[2], &pr);
         if (fprintf(fp_log, "WAV:PRE.FORMAT=%d\n", pr.format) < 0) return -2;
         if (fprintf(fp_log, "WAV:PRE.TYPE=%d\n",   pr.type)   < 0) return -2;
         if (fprintf(fp_log, "WAV:PRE.POINTS=%zu\n",pr.points) < 0) return -2;
@@ -338,7 +511,15 @@ static int ds1000ze_dump_log(Scope *s, FILE *fp_log, const RunConfig *cfg){
     // 3) Number of samples (keep this for quick grep; now consistent with preamble)
     size_t n_samples = 0;
     size_t L = 1;
-    rc = ds1000ze_get_n_samples(s, &n_samples, &L);
+    const Ds1000zeProfile *prof = (const Ds1000zeProfile*)s->priv;
+    if (prof && prof->n_samples > 0) {
+        /* probed (or cached) at init for the current fingerprint */
+        n_samples = prof->n_samples;
+        L         = prof->raw_start_idx;
+        rc = 0;
+    } else {
+        rc = ds1000ze_get_n_samples(s, &n_samples, &L);
+    }
     if (rc == 0) {
         if (fprintf(fp_log, "MDEPTH=%zu\nRAW_START_IDX=%zu\nNSAMPLES_READ=%zu\n", n_samples, L, cfg->n_samples) < 0) 
             return -2;
@@ -367,11 +548,13 @@ static int ds1000ze_dump_log(Scope *s, FILE *fp_log, const RunConfig *cfg){
 static void ds1000ze_destroy(Scope *s) {
     if (!s) return;
     ds1000ze_stop(s); // :STOP
+    scope_journal_clear(s);
     if (s->instr_name) {
         free(s->instr_name);
         s->instr_name = NULL;
     }
     scope_close(s);    // closes VISA
+    free(s->priv);
     free(s);           // free the Scope object
 }
 
@@ -390,6 +573,11 @@ static int ds1000ze_query_preamble(Scope *s, RigolPreamble *pr) {
     if (scope_query(s, ":WAV:PRE?", pre, sizeof pre) != 0)  // aka ":WAVeform:PREamble?"
         return -2;
     //printf("[ds1000ze] Preamble: %s\n", pre);
+    ds1000ze_parse_preamble(pre, pr);
+    return 0;
+}
+
+static void ds1000ze_parse_preamble(const char *pre, RigolPreamble *pr) {
     // Parse CSV in-place (robust to whitespace)
     const char *p = pre;
     char tmp[48];
@@ -417,7 +605,6 @@ static int ds1000ze_query_preamble(Scope *s, RigolPreamble *pr) {
         if (!comma) break;
         p = comma + 1;
     }
-    return 0;
 }
 
 
@@ -426,9 +613,13 @@ static int ds1000ze_get_n_samples(Scope *s, size_t *n_samples, size_t *raw_start
     *n_samples = 0;
     if (raw_start_idx) *raw_start_idx = 1;
 
-    /* Mode? */
+    /* Mode, preamble and timebase in one round trip */
+    static const char *const q[] = { ":WAV:MODE?", ":WAV:PRE?", ":TIM:SCAL?", ":TIM:OFFS?" };
+    char reply[384] = {0};
+    char *f[4] = {0};
+    if (scope_query_multi(s, q, 4, reply, sizeof reply, f) < 0 || !f[0]) return -2;
     char mode[16] = {0};
-    if (scope_query(s, ":WAV:MODE?", mode, sizeof mode) != 0) return -2;
+    snprintf(mode, sizeof mode, "%s", f[0]);
     for (char *p = mode; *p; ++p) *p = (char)toupper((unsigned char)*p);
 
     /* Non-RAW → simple path */
@@ -441,7 +632,8 @@ static int ds1000ze_get_n_samples(Scope *s, size_t *n_samples, size_t *raw_start
         }
         /* fallback to preamble points if available */
         RigolPreamble pr = {0};
-        if (ds1000ze_query_preamble(s, &pr) == 0 && pr.points > 0) {
+        if (f[1]) ds1000ze_parse_preamble(f[1], &pr);
+        if (pr.points > 0) {
             *n_samples = pr.points;
             if (raw_start_idx) *raw_start_idx = 1;
             return 0;
@@ -451,7 +643,8 @@ static int ds1000ze_get_n_samples(Scope *s, size_t *n_samples, size_t *raw_start
 
     /* RAW → use preamble + timebase to derive [L..R] for the visible window */
     RigolPreamble pr = {0};
-    if (ds1000ze_query_preamble(s, &pr) != 0) return -4;
+    if (!f[1]) return -4;
+    ds1000ze_parse_preamble(f[1], &pr);
 
     if (pr.points == 0) {
         /* Prime one capture (arm → small delay → force trigger → wait → stop) */
@@ -471,11 +664,10 @@ static int ds1000ze_get_n_samples(Scope *s, size_t *n_samples, size_t *raw_start
     }
 
     /* Timebase (12 divisions centered at OFFS) */
-    char buf[64];
-    if (scope_query(s, ":TIM:SCAL?", buf, sizeof buf) != 0) return -6;
-    double scale = strtod(buf, NULL);
-    if (scope_query(s, ":TIM:OFFS?", buf, sizeof buf) != 0) return -7;
-    double offs = strtod(buf, NULL);
+    if (!f[2]) return -6;
+    double scale = strtod(f[2], NULL);
+    if (!f[3]) return -7;
+    double offs = strtod(f[3], NULL);
     if (scale <= 0.0 || pr.xincr <= 0.0) return -8;
 
     const double tL = offs - 6.0 * scale;
@@ -497,6 +689,177 @@ static int ds1000ze_get_n_samples(Scope *s, size_t *n_samples, size_t *raw_start
     *n_samples = R - L + 1;
     return (*n_samples > 0) ? 0 : -10;
 }
+// Transfer tuning cache key: IDN + transport (e.g. "USB0"), since both set the optimum.
+// idn NULL or "" => query it.
+static int ds1000ze_transfer_key(Scope *s, const char *idn, char *key, size_t cap) {
+    char idn_buf[128];
+    if (!idn || !idn[0]) {
+        if (scope_query(s, "*IDN?", idn_buf, sizeof idn_buf) != 0) return -1;
+        idn = idn_buf;
+    }
+    const char *name = s->instr_name ? s->instr_name : "";
+    size_t tlen = strcspn(name, ":");
+    snprintf(key, cap, "%s_%.*s", idn, (int)tlen, name);
+    return 0;
+}
+
+static int ds1000ze_load_transfer_cache(Scope *s, const char *idn) {
+    char key[192], path[768];
+    if (ds1000ze_transfer_key(s, idn, key, sizeof key) != 0) return -1;
+    if (scope_cache_path("transfer", key, path, sizeof path) != 0) return -2;
+
+    FILE *fp = fopen(path, "r");
+    if (!fp) return -3;
+    size_t chunk = 0;
+    unsigned buf = 0;
+    int n = fscanf(fp, "chunk_pts=%zu\nread_buf=%u", &chunk, &buf);
+    fclose(fp);
+    if (n != 2) return -4;
+
+    s->read_chunk_pts = chunk;
+    if (buf) (void)scope_set_read_buf(s, buf);
+    return 0;
+}
+
+static int ds1000ze_calibrate_transfer(Scope *s, const RunConfig *cfg, FILE *report) {
+    if (!s || !cfg || !cfg->channels || cfg->n_channels == 0 || cfg->n_samples == 0) return -1;
+    if (!report) report = stdout;
+
+    static const size_t chunk_cands[] = { 250000, 125000, 62500, 31250, 15625 };
+    const size_t n_chunks = sizeof chunk_cands / sizeof chunk_cands[0];
+    enum { REPS = 3 };
+
+    /* Measure on the first channel, capped at 1 Mpts to keep the sweep short */
+    RunConfig one = *cfg;
+    one.n_channels = 1;
+    if (one.n_samples > 1000000u) one.n_samples = 1000000u;
+    const size_t bytes = one.n_samples * (size_t)(one.coding + 1);
+    uint8_t *scratch = malloc(bytes);
+    if (!scratch) return -2;
+
+    const size_t   prev_chunk = s->read_chunk_pts;
+    const unsigned prev_buf   = s->read_buf_bytes;
+
+    /* Every candidate is set explicitly, so the winner is the buffer that was measured
+       (the VISA default has no size to set back). The one in effect competes too */
+    unsigned buf_cands[6] = { 65536, 262144, 1048576, 4194304 };
+    size_t n_bufs = 4;
+    if (prev_buf && prev_buf != 65536 && prev_buf != 262144 && prev_buf != 1048576 && prev_buf != 4194304)
+        buf_cands[n_bufs++] = prev_buf;
+    double best_mbps = 0.0;
+    size_t best_chunk = 0;
+    unsigned best_buf = 0;
+
+    fprintf(report, "-- Transfer calibration (%zu pts, %s) --\n", one.n_samples, one.channels[0]);
+    bool any_buf = false;
+    for (size_t b = 0; b <= n_bufs; ++b) {
+        if (b < n_bufs) {
+            if (scope_set_read_buf(s, buf_cands[b]) != 0) continue; /* unsupported */
+            any_buf = true;
+        } else if (any_buf) {
+            break;
+        } else {
+            buf_cands[b] = prev_buf; /* no buffer size settable here: tune the chunk alone */
+        }
+        for (size_t c = 0; c < n_chunks; ++c) {
+            if (chunk_cands[c] > max_points_per_read(one.coding)) continue;
+            s->read_chunk_pts = chunk_cands[c];
+
+            uint64_t t0 = latency_now_us();
+            int rc = 0;
+            for (int r = 0; r < REPS && rc == 0; ++r) rc = ds1000ze_read_trace(s, scratch, &one);
+            uint64_t dt = latency_now_us() - t0;
+            if (rc != 0 || dt == 0) {
+                fprintf(report, "read_buf=%-8u chunk=%-7zu FAILED rc=%d\n", buf_cands[b], chunk_cands[c], rc);
+                continue;
+            }
+            double mbps = (double)(bytes * REPS) / (double)dt; /* bytes/us == MB/s */
+            fprintf(report, "read_buf=%-8u chunk=%-7zu %8.2f MB/s\n", buf_cands[b], chunk_cands[c], mbps);
+            if (mbps > best_mbps) { best_mbps = mbps; best_chunk = chunk_cands[c]; best_buf = buf_cands[b]; }
+        }
+    }
+    free(scratch);
+
+    if (best_chunk == 0) {
+        s->read_chunk_pts = prev_chunk;
+        if (prev_buf) (void)scope_set_read_buf(s, prev_buf);
+        return -3;
+    }
+    s->read_chunk_pts = best_chunk;
+    if (best_buf) (void)scope_set_read_buf(s, best_buf); /* 0: nothing was changed */
+    fprintf(report, "best: read_buf=%u chunk=%zu (%.2f MB/s)\n", best_buf, best_chunk, best_mbps);
+
+    /* Persist for later runs on this instrument/transport */
+    char key[192], path[768];
+    if (ds1000ze_transfer_key(s, NULL, key, sizeof key) != 0 ||
+        scope_cache_path("transfer", key, path, sizeof path) != 0) return -4;
+    FILE *fp = fopen(path, "w");
+    if (!fp) return -5;
+    fprintf(fp, "chunk_pts=%zu\nread_buf=%u\n", best_chunk, best_buf);
+    fclose(fp);
+    fprintf(report, "saved: %s\n", path);
+    return 0;
+}
+
+// Cheap state fingerprint: one compound query over everything the init probing depends on
+// (timebase, memory depth, sample rate, displayed sources). Any front-panel change => miss.
+// A field that fails on its own fallback query reads "?", the same on every run.
+static int ds1000ze_state_fingerprint(Scope *s, char *fp, size_t cap) {
+    static const char *const q[] = {
+        ":TIM:SCAL?", ":TIM:OFFS?", ":ACQ:MDEP?", ":ACQ:SRAT?", ":CHAN1:DISP?",
+        ":CHAN2:DISP?", ":CHAN3:DISP?", ":CHAN4:DISP?", ":MATH:DISP?", ":MATH:OPER?",
+    };
+    enum { NQ = sizeof q / sizeof q[0] };
+    char reply[320];
+    char *f[NQ];
+    if (scope_query_multi(s, q, NQ, reply, sizeof reply, f) < 0) return -1;
+
+    size_t len = 0;
+    int have = 0;
+    fp[0] = '\0';
+    for (size_t i = 0; i < NQ; ++i) {
+        have += (f[i] != NULL);
+        int n = snprintf(fp + len, cap - len, "%s%s", i ? ";" : "", f[i] ? f[i] : "?");
+        if (n < 0 || (size_t)n >= cap - len) return -2;
+        len += (size_t)n;
+    }
+    return have ? 0 : -3;
+}
+
+static int ds1000ze_load_profile(const char *idn, const char *fingerprint, Ds1000zeProfile *prof) {
+    char path[768];
+    if (scope_cache_path("profile", idn, path, sizeof path) != 0) return -1;
+    FILE *fp = fopen(path, "r");
+    if (!fp) return -2;
+
+    Ds1000zeProfile got = {0};
+    char line[320];
+    while (fgets(line, sizeof line, fp)) {
+        line[strcspn(line, "\r\n")] = '\0';
+        if (strncmp(line, "fingerprint=", 12) == 0) snprintf(got.fingerprint, sizeof got.fingerprint, "%.255s", line + 12);
+        else if (strncmp(line, "channels=", 9) == 0) snprintf(got.channels, sizeof got.channels, "%.127s", line + 9);
+        else (void)(sscanf(line, "n_samples=%zu", &got.n_samples) == 1 ||
+                    sscanf(line, "raw_start_idx=%zu", &got.raw_start_idx) == 1);
+    }
+    fclose(fp);
+
+    if (strcmp(got.fingerprint, fingerprint) != 0) return -3; /* setup changed */
+    if (got.n_samples > 0 && got.raw_start_idx == 0) got.n_samples = 0;
+    *prof = got;
+    return 0;
+}
+
+static int ds1000ze_save_profile(const char *idn, const Ds1000zeProfile *prof) {
+    char path[768];
+    if (scope_cache_path("profile", idn, path, sizeof path) != 0) return -1;
+    FILE *fp = fopen(path, "w");
+    if (!fp) return -2;
+    fprintf(fp, "fingerprint=%s\nchannels=%s\nn_samples=%zu\nraw_start_idx=%zu\n",
+            prof->fingerprint, prof->channels, prof->n_samples, prof->raw_start_idx);
+    fclose(fp);
+    return 0;
+}
+
 // static int ds1000ze_get_sampling_rate(Scope *s, double *sampling_rate) {
 //     if (!s || !sampling_rate)
 //         return -1;
@@ -516,19 +879,6 @@ static int ds1000ze_get_n_samples(Scope *s, size_t *n_samples, size_t *raw_start
 //     return 0;
 // }
 
-// Query a single property like ":CHANnel<n>:SCALe?" into resp.
-// Returns 0 on success.
-static int ds1000ze_get_channel_property(Scope *s, const char *channel, const char *property, char *resp, size_t len) {
-    char cmd[32];
-    // SCPI is case-insensitive; use canonical spelling
-    snprintf(cmd, sizeof cmd, ":%s:%s?", channel, property);
-    if (scope_query(s, cmd, resp, len) != 0) {
-        return -1;
-    }
-    //rtrim(resp);
-    return 0;
-}
-
 static int ds1000ze_get_channels_properties(Scope *s, FILE *fp_log, const RunConfig *cfg) {
     // Log format: key=value lines like "CHAN1.BWLimit=ON"
     if (!s || !fp_log || !cfg || !cfg->channels)
@@ -545,12 +895,29 @@ static int ds1000ze_get_channels_properties(Scope *s, FILE *fp_log, const RunCon
     const size_t n_properties =
         sizeof chan_properties / sizeof chan_properties[0];
 
+    enum { MAX_Q = SCOPE_MAX_CHANS * 6 };
+    const size_t n_q = (size_t)cfg->n_channels * n_properties;
+    if (n_q == 0 || n_q > MAX_Q) return -1;
+
+    /* Every (channel, property) pair as one compound query: a single round trip */
+    char cmds[MAX_Q][32];
+    const char *q[MAX_Q];
+    for (size_t k = 0; k < n_q; ++k) {
+        snprintf(cmds[k], sizeof cmds[k], ":%s:%s?", cfg->channels[k / n_properties], chan_properties[k % n_properties]);
+        q[k] = cmds[k];
+    }
+    char reply[MAX_Q * 24];
+    char *f[MAX_Q];
+    if (scope_query_multi(s, q, n_q, reply, sizeof reply, f) < 0) {
+        for (size_t k = 0; k < n_q; ++k) f[k] = NULL;
+    }
+
     int first_error_rc = 0;
     for (uint8_t i = 0; i < cfg->n_channels; ++i) {
         const char *channel = cfg->channels[i];
         for (size_t p = 0; p < n_properties; ++p) {
-            char resp[64];
-            int rc = ds1000ze_get_channel_property(s, channel, chan_properties[p], resp, sizeof resp);
+            const char *resp = f[(size_t)i * n_properties + p];
+            int rc = resp ? 0 : -1;
             if (rc == 0) {
                 /* e.g. CHAN1.SCAL=0.200000  */
                 if (fprintf(fp_log, "%s:%s=%s\n",
@@ -575,14 +942,19 @@ static int ds1000ze_list_displayed_channels(Scope *s, char ***out, uint8_t *out_
     *out = NULL;
     *out_n = 0;
 
-    const char *cands[] = { "CHAN1","CHAN2","CHAN3","CHAN4","MATH","FFT" };
+    // No ":FFT" root on the DS1000Z: FFT is a :MATH:OPER and shows up as MATH
+    const char *cands[] = { "CHAN1","CHAN2","CHAN3","CHAN4","MATH" };
+    static const char *const q[] = { ":CHAN1:DISP?", ":CHAN2:DISP?", ":CHAN3:DISP?",
+                                     ":CHAN4:DISP?", ":MATH:DISP?" };
     const size_t nc = sizeof cands / sizeof cands[0];
 
+    char reply[64];
+    char *f[sizeof cands / sizeof cands[0]];
+    if (scope_query_multi(s, q, nc, reply, sizeof reply, f) < 0) return -3;
+
     for (size_t i = 0; i < nc; ++i) {
-        char cmd[32], resp[8];
-        snprintf(cmd, sizeof cmd, ":%s:DISP?", cands[i]);
-        if (scope_query(s, cmd, resp, sizeof resp) != 0) continue; // ignore errors
-        if (resp[0] == '1') {
+        if (!f[i]) continue; // ignore errors
+        if (f[i][0] == '1') {
             char **tmp = realloc(*out, ((size_t)*out_n + 1) * sizeof(char*));
             if (!tmp) {
                 // cleanup already-added entries
@@ -1,7 +1,21 @@
+#define _GNU_SOURCE
 #include "scope.h"
+#include "engine/trace.h"
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <errno.h>
+#include <ctype.h>
+#include <sys/stat.h>
+#include <pthread.h>
+
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#elif defined(__ARM_NEON)
+#include <arm_neon.h>
+#endif
 
 
 /* ---------- Internal helpers ---------- */
@@ -24,6 +38,12 @@ static int _set_common_attrs(ViSession instr, unsigned timeout_ms) {
     return 0;
 }
 
+static uint64_t _now_us(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000u + (uint64_t)ts.tv_nsec / 1000u;
+}
+
 /* ---------- Generic scope methods ---------- */
 
 int scope_open(Scope *s) {
@@ -55,6 +75,7 @@ int scope_open(Scope *s) {
         viClose(s->rm);    s->rm    = VI_NULL;
         return -3;
     }
+    if (s->read_buf_bytes) (void)scope_set_read_buf(s, s->read_buf_bytes);
 
     return 0;
 }
@@ -85,6 +106,59 @@ static int _idn_matches(ViSession instr, const char *needle) {
     return (!needle || strstr(buf, needle) != NULL);
 }
 
+/* One probe per candidate resource, run concurrently on a shared RM */
+typedef struct {
+    pthread_t   thread;
+    ViSession   rm;
+    char        desc[VI_FIND_BUFLEN];
+    const char *needle;
+    unsigned    timeout_ms;
+    ViSession   instr;   /* left open on match */
+    int         match;
+} _Probe;
+
+/* Open rsrc with a short probe timeout and test *IDN?; keeps the session on match */
+static int _probe_one(ViSession rm, const char *rsrc, const char *needle, unsigned timeout_ms, ViSession *out) {
+    ViSession test = VI_NULL;
+    if (viOpen(rm, (ViRsrc)rsrc, VI_NULL, VI_NULL, &test) < VI_SUCCESS) return 0;
+
+    /* Short probe timeout so a misbehaving device doesn't stall us */
+    if (_set_common_attrs(test, SCOPE_PROBE_TIMEOUT_MS) == 0 && _idn_matches(test, needle)) {
+        viSetAttribute(test, VI_ATTR_TMO_VALUE, (ViAttrState)timeout_ms);
+        *out = test;
+        return 1;
+    }
+    viClose(test);
+    return 0;
+}
+
+static void *_probe_thread(void *arg) {
+    _Probe *p = (_Probe*)arg;
+    p->match = _probe_one(p->rm, p->desc, p->needle, p->timeout_ms, &p->instr);
+    return NULL;
+}
+
+static void _discovery_cache_save(const char *idn_substr, const char *rsrc) {
+    char path[768];
+    if (scope_cache_path("discovery", idn_substr ? idn_substr : "any", path, sizeof path) != 0) return;
+    FILE *fp = fopen(path, "w");
+    if (!fp) return;
+    fprintf(fp, "%s\n", rsrc);
+    fclose(fp);
+}
+
+static int _discovery_cache_load(const char *idn_substr, char *rsrc, size_t cap) {
+    char path[768];
+    if (scope_cache_path("discovery", idn_substr ? idn_substr : "any", path, sizeof path) != 0) return -1;
+    FILE *fp = fopen(path, "r");
+    if (!fp) return -2;
+    int ok = (fgets(rsrc, (int)cap, fp) != NULL);
+    fclose(fp);
+    if (!ok) return -3;
+    rsrc[strcspn(rsrc, "\r\n")] = '\0';
+    return rsrc[0] ? 0 : -3;
+}
+
 int scope_auto_open(Scope *s, const char *idn_substr) {
     if (!s) return -1;
 
@@ -98,71 +172,92 @@ int scope_auto_open(Scope *s, const char *idn_substr) {
         return -2;
     }
 
-    /* Tiers: USB -> GPIB -> TCPIP; optionally add the broad fallback */
+    /* 1) Cached resource from a previous run: one quick *IDN? validates it */
+    char cached[VI_FIND_BUFLEN];
+    if (_discovery_cache_load(idn_substr, cached, sizeof cached) == 0) {
+        ViSession instr = VI_NULL;
+        if (_probe_one(s->rm, cached, idn_substr, s->timeout_ms, &instr)) {
+            fprintf(stdout, "[scope] auto_open using cached \"%s\"\n", cached);
+            if (s->instr_name) free(s->instr_name);
+            s->instr_name = strdup(cached);
+            s->instr = instr;
+            return 0; /* keep RM open */
+        }
+        fprintf(stdout, "[scope] cached \"%s\" did not answer; rescanning\n", cached);
+    }
+
+    /* 2) Collect candidates. Tiers: USB -> GPIB -> TCPIP; optionally add the broad fallback */
     const char *tier_name[] = { "USB", "GPIB", "TCPIP", "BROAD" };
     const char *pattern[]   = { "USB?*::INSTR", "GPIB?*::INSTR", "TCPIP?*::INSTR", "?*::INSTR" };
     const int allow_broad = 0;
     const size_t n_tiers = allow_broad ? 4u : 3u;
 
-    ViFindList list = VI_NULL;
-    ViUInt32 count = 0;
-    char desc[VI_FIND_BUFLEN];
-    int found_list = 0;
-
-    for (size_t t = 0; t < n_tiers; ++t) {
-        fprintf(stdout, "[scope] searching %s tier (%s)...\n", tier_name[t], pattern[t]);
-        fflush(stdout);
+    _Probe probes[SCOPE_PROBE_MAX];
+    size_t n_probes = 0;
+    for (size_t t = 0; t < n_tiers && n_probes < SCOPE_PROBE_MAX; ++t) {
+        ViFindList list = VI_NULL;
+        ViUInt32 count = 0;
+        char desc[VI_FIND_BUFLEN];
 
         st = viFindRsrc(s->rm, (ViString)pattern[t], &list, &count, (ViChar*)desc);
         if (st >= VI_SUCCESS && count > 0) {
-            fprintf(stdout, "[scope] find %s → %u candidate(s)\n", pattern[t], count);
-            found_list = 1;
-            break;
+            fprintf(stdout, "[scope] find %s tier (%s) → %u candidate(s)\n", tier_name[t], pattern[t], (unsigned)count);
+            for (ViUInt32 i = 0; i < count && n_probes < SCOPE_PROBE_MAX; ++i) {
+                _Probe *p = &probes[n_probes++];
+                memset(p, 0, sizeof *p);
+                snprintf(p->desc, sizeof p->desc, "%s", desc);
+                p->rm = s->rm;
+                p->needle = idn_substr;
+                p->timeout_ms = s->timeout_ms;
+                if (i + 1 < count && viFindNext(list, (ViChar*)desc) < VI_SUCCESS) break;
+            }
         }
-        if (list) { viClose(list); list = VI_NULL; }  /* defensive */
+        if (list) viClose(list);
     }
 
-    if (!found_list) {
-        if (list) viClose(list);
+    if (n_probes == 0) {
         viClose(s->rm); s->rm = VI_NULL;
         fprintf(stderr, "[scope] no VISA instruments found on searched tiers.\n");
         return -3;
     }
 
-    /* Probe candidates quickly (you already had this; keeping your prints & 1s probe TMO) */
-    for (ViUInt32 i = 0; i < count; ++i) {
-        ViSession test = VI_NULL;
-
-        fprintf(stdout, "[scope] auto_open trying \"%s\"\n", desc);
-        if (viOpen(s->rm, (ViRsrc)desc, VI_NULL, VI_NULL, &test) >= VI_SUCCESS) {
-            /* Short probe timeout so a misbehaving device doesn’t stall us */
-            viSetAttribute(test, VI_ATTR_TMO_VALUE, (ViAttrState)1000);
-
-            /* Apply common attrs and test *IDN? substring */
-            if (_set_common_attrs(test, s->timeout_ms) == 0 && _idn_matches(test, idn_substr)) {
-                if (s->instr_name) free(s->instr_name);
-                s->instr_name = strdup(desc);
-                s->instr = test;
-                viClose(list);
-                return 0; /* keep RM open */
-            }
-            viClose(test);
+    /* 3) Probe all candidates concurrently (each bounded by SCOPE_PROBE_TIMEOUT_MS) */
+    for (size_t i = 0; i < n_probes; ++i) {
+        fprintf(stdout, "[scope] auto_open trying \"%s\"\n", probes[i].desc);
+        if (pthread_create(&probes[i].thread, NULL, _probe_thread, &probes[i]) != 0) {
+            _probe_thread(&probes[i]); /* fall back to probing inline */
+            probes[i].thread = pthread_self();
         }
+    }
+    for (size_t i = 0; i < n_probes; ++i) {
+        if (!pthread_equal(probes[i].thread, pthread_self())) pthread_join(probes[i].thread, NULL);
+    }
 
-        if (i + 1 < count) {
-            if (viFindNext(list, (ViChar*)desc) < VI_SUCCESS)
-                break;
-        }
+    /* 4) First match in tier/list order wins; close the others */
+    int chosen = -1;
+    for (size_t i = 0; i < n_probes; ++i) {
+        if (!probes[i].match) continue;
+        if (chosen < 0) { chosen = (int)i; continue; }
+        viClose(probes[i].instr);
+    }
+    if (chosen < 0) {
+        viClose(s->rm); s->rm = VI_NULL;
+        return -4; /* not found */
     }
 
-    viClose(list);
-    viClose(s->rm); s->rm = VI_NULL;
-    return -4; /* not found */
+    if (s->instr_name) free(s->instr_name);
+    s->instr_name = strdup(probes[chosen].desc);
+    s->instr = probes[chosen].instr;
+    _discovery_cache_save(idn_substr, probes[chosen].desc);
+    return 0; /* keep RM open */
 }
 
 int scope_close(Scope *s) {
     if (!s) return -1;
 
+    free(s->word_buf);
+    s->word_buf = NULL;
+    s->word_cap = 0;
     if (s->instr != VI_NULL) {
         viClose(s->instr);
         s->instr = VI_NULL;
@@ -197,7 +292,9 @@ int scope_read(Scope *s, void *buf, size_t len, size_t *out_len, bool exact) {
     if (!exact) {
         /* Old semantics: single viRead, return whatever arrives */
         ViUInt32 got = 0;
+        const uint64_t tt = trace_begin();
         ViStatus st = viRead(s->instr, (ViBuf)buf, (ViUInt32)len, &got);
+        trace_end("visa", "viRead", tt, got);
         if (st < VI_SUCCESS && st != VI_SUCCESS_MAX_CNT) return -2;
         if (out_len) *out_len = (size_t)got;
         return 0;
@@ -210,7 +307,9 @@ int scope_read(Scope *s, void *buf, size_t len, size_t *out_len, bool exact) {
 
     while (rem > 0) {
         ViUInt32 got = 0;
+        const uint64_t tt = trace_begin();
         ViStatus st = viRead(s->instr, (ViBuf)p, (ViUInt32)rem, &got);
+        trace_end("visa", "viRead", tt, got);
 
         if (st < VI_SUCCESS && st != VI_SUCCESS_MAX_CNT) {
             /* VISA timeout (e.g., VI_ERROR_TMO) or other error */
@@ -247,7 +346,9 @@ int scope_write(Scope *s, const void *buf, size_t len) {
                                                        : (ViUInt32)len;
 
         ViUInt32 wrote = 0;
+        const uint64_t tt = trace_begin();
         ViStatus st = viWrite(s->instr, (ViBuf)p, this_len, &wrote);
+        trace_end("visa", "viWrite", tt, wrote);
         if (st < VI_SUCCESS || wrote == 0) return -2;
 
         p   += wrote;
@@ -283,7 +384,9 @@ int scope_writeline(Scope *s, const char *line, size_t len) {
     return rc; /* 0 ok */
 }
 
-int scope_query(Scope *s, const char *cmd, char *resp, size_t resp_cap) {
+/* scope_query; *truncated (optional) tells whether the reply went on past resp_cap */
+static int query_reply(Scope *s, const char *cmd, char *resp, size_t resp_cap, bool *truncated) {
+    if (truncated) *truncated = false;
     if (!s || s->instr == VI_NULL || !cmd || !resp || resp_cap == 0)
         return -1;
 
@@ -306,7 +409,9 @@ int scope_query(Scope *s, const char *cmd, char *resp, size_t resp_cap) {
     outbuf[cmd_len] = '\n';
 
     ViUInt32 wrote = 0;
+    uint64_t tt = trace_begin();
     ViStatus stw = viWrite(s->instr, (ViBuf)outbuf, (ViUInt32)need, &wrote);
+    trace_end("visa", "viWrite", tt, wrote);
     if (heapbuf) free(heapbuf);
     if (stw < VI_SUCCESS || wrote != (ViUInt32)need)
         return -2;
@@ -317,13 +422,16 @@ int scope_query(Scope *s, const char *cmd, char *resp, size_t resp_cap) {
 
     /* Read up to capacity-1; VISA returns when it sees '\n' */
     ViUInt32 got = 0;
+    tt = trace_begin();
     ViStatus str = viRead(s->instr, (ViBuf)resp, (ViUInt32)(resp_cap - 1), &got);
+    trace_end("visa", "viRead", tt, got);
 
     /* Always restore for binary traffic afterwards */
     viSetAttribute(s->instr, VI_ATTR_TERMCHAR_EN, VI_FALSE);
 
     if (str < VI_SUCCESS && str != VI_SUCCESS_MAX_CNT)
         return -3;
+    if (truncated) *truncated = (str == VI_SUCCESS_MAX_CNT);
 
     /* NUL-terminate */
     size_t n = (got < (resp_cap - 1)) ? (size_t)got : (resp_cap - 1);
@@ -339,6 +447,71 @@ int scope_query(Scope *s, const char *cmd, char *resp, size_t resp_cap) {
     return 0;
 }
 
+int scope_query(Scope *s, const char *cmd, char *resp, size_t resp_cap) {
+    return query_reply(s, cmd, resp, resp_cap, NULL);
+}
+
+/* Read and discard the rest of a reply that did not fit, up to its '\n' */
+static void drain_reply(Scope *s) {
+    char junk[256];
+    ViStatus st;
+    viSetAttribute(s->instr, VI_ATTR_TERMCHAR_EN, VI_TRUE);
+    do {
+        ViUInt32 got = 0;
+        st = viRead(s->instr, (ViBuf)junk, (ViUInt32)sizeof junk, &got);
+    } while (st == VI_SUCCESS_MAX_CNT);
+    viSetAttribute(s->instr, VI_ATTR_TERMCHAR_EN, VI_FALSE);
+    viFlush(s->instr, VI_READ_BUF_DISCARD);
+}
+
+int scope_query_multi(Scope *s, const char *const *cmds, size_t n, char *resp, size_t resp_cap, char **fields) {
+    if (!s || !cmds || n == 0 || !resp || resp_cap == 0 || !fields) return -1;
+
+    /* 1) "<q1>;<q2>;..." in one write, one read */
+    size_t len = 0;
+    for (size_t i = 0; i < n; ++i) len += strlen(cmds[i]) + 1;
+    char *cmd = malloc(len);
+    if (!cmd) return -2;
+    char *w = cmd;
+    for (size_t i = 0; i < n; ++i) {
+        size_t l = strlen(cmds[i]);
+        memcpy(w, cmds[i], l);
+        w += l;
+        *w++ = (i + 1 < n) ? ';' : '\0';
+    }
+    bool truncated = false;
+    int rc = query_reply(s, cmd, resp, resp_cap, &truncated);
+    free(cmd);
+
+    if (rc == 0 && !truncated) {
+        size_t k = 0;
+        char *p = resp;
+        for (;;) {
+            if (k < n) fields[k] = p;
+            ++k;
+            char *sep = strchr(p, ';');
+            if (!sep) break;
+            *sep = '\0';
+            p = sep + 1;
+        }
+        if (k == n) return 0;
+    }
+
+    /* 2) A sub-query was rejected (or the reply got truncated: its tail is still on the
+          device and would shift every answer below): ask one by one */
+    if (truncated) drain_reply(s);
+    else viFlush(s->instr, VI_READ_BUF_DISCARD);
+    size_t off = 0;
+    for (size_t i = 0; i < n; ++i) {
+        fields[i] = NULL;
+        if (off + 1 >= resp_cap) continue;
+        if (query_reply(s, cmds[i], resp + off, resp_cap - off, &truncated) != 0) continue;
+        if (truncated) { drain_reply(s); continue; } /* a cut answer is no answer */
+        fields[i] = resp + off;
+        off += strlen(resp + off) + 1;
+    }
+    return 1;
+}
 
 int scope_ping(Scope *s){
     char buf[64];
@@ -395,6 +568,48 @@ int scope_read_defblock(Scope *s, uint8_t *dst, size_t cap, size_t *out_len) {
     return 0;
 }
 
+void scope_narrow_word(uint8_t *dst, const uint8_t *src, size_t n_pts) {
+    size_t i = 0;
+#if defined(__SSE2__)
+    /* 16 points per step: mask the high bytes away, then saturating pack is exact */
+    const __m128i lo = _mm_set1_epi16(0x00FF);
+    for (; i + 16 <= n_pts; i += 16) {
+        __m128i a = _mm_loadu_si128((const __m128i*)(src + 2 * i));
+        __m128i b = _mm_loadu_si128((const __m128i*)(src + 2 * i + 16));
+        a = _mm_and_si128(a, lo);
+        b = _mm_and_si128(b, lo);
+        _mm_storeu_si128((__m128i*)(dst + i), _mm_packus_epi16(a, b));
+    }
+#elif defined(__ARM_NEON)
+    /* De-interleave 32 bytes: val[0] holds the even (low) bytes */
+    for (; i + 16 <= n_pts; i += 16) {
+        uint8x16x2_t v = vld2q_u8(src + 2 * i);
+        vst1q_u8(dst + i, v.val[0]);
+    }
+#endif
+    for (; i < n_pts; ++i) dst[i] = src[2 * i];
+}
+
+int scope_read_defblock_word(Scope *s, uint8_t *dst, size_t n_pts, size_t *out_pts) {
+    if (!s || !dst) return -1;
+
+    const size_t need = n_pts * 2u;
+    if (need > s->word_cap) {
+        uint8_t *p = realloc(s->word_buf, need);
+        if (!p) return -8;
+        s->word_buf = p;
+        s->word_cap = need;
+    }
+
+    size_t got = 0;
+    int rc = scope_read_defblock(s, s->word_buf, need, &got);
+    if (rc != 0) return rc;
+
+    scope_narrow_word(dst, s->word_buf, got / 2u);
+    if (out_pts) *out_pts = got / 2u;
+    return 0;
+}
+
 int scope_reconnect(Scope *s) {
     // Close any half-open sessions
     scope_close(s);
@@ -411,9 +626,55 @@ int scope_reconnect(Scope *s) {
         scope_close(s);
         return -1;
     }
+
+    // Replay configuration: the instrument may have power-cycled or reset its state
+    for (uint8_t i = 0; i < s->n_journal; ++i) {
+        if (scope_writeline(s, s->journal[i], 0) != 0) {
+            scope_close(s);
+            return -2;
+        }
+    }
     return 0;
 }
 
+static size_t _cmd_header_len(const char *cmd) {
+    return strcspn(cmd, " ");
+}
+
+int scope_config(Scope *s, const char *cmd) {
+    if (!s || !cmd) return -1;
+    int rc = scope_writeline(s, cmd, 0);
+    if (rc != 0) return rc;
+
+    char *dup = strdup(cmd);
+    if (!dup) return -2;
+
+    size_t hlen = _cmd_header_len(cmd);
+    for (uint8_t i = 0; i < s->n_journal; ++i) {
+        if (_cmd_header_len(s->journal[i]) == hlen && strncmp(s->journal[i], cmd, hlen) == 0) {
+            /* keep order of first appearance, latest value wins */
+            free(s->journal[i]);
+            s->journal[i] = dup;
+            return 0;
+        }
+    }
+    if (s->n_journal >= SCOPE_JOURNAL_MAX) {
+        free(dup);
+        return -3;
+    }
+    s->journal[s->n_journal++] = dup;
+    return 0;
+}
+
+void scope_journal_clear(Scope *s) {
+    if (!s) return;
+    for (uint8_t i = 0; i < s->n_journal; ++i) {
+        free(s->journal[i]);
+        s->journal[i] = NULL;
+    }
+    s->n_journal = 0;
+}
+
 // Query an unsigned 64-bit value into *out (decimal)
 int scope_query_u64(Scope *s, const char *cmd, size_t *out) {
     char buf[32];
@@ -431,3 +692,65 @@ int scope_query_u64(Scope *s, const char *cmd, size_t *out) {
     return 0;
 }
 
+
+/* ---------- Transfer tuning ---------- */
+
+int scope_set_read_buf(Scope *s, unsigned bytes) {
+    if (!s || s->instr == VI_NULL || bytes == 0) return -1;
+    /* Not every transport honours this (USBTMC may report VI_WARN_NSUP_BUF) */
+    if (viSetBuf(s->instr, VI_READ_BUF, (ViUInt32)bytes) < VI_SUCCESS) return -2;
+    s->read_buf_bytes = bytes;
+    return 0;
+}
+
+int scope_cache_path(const char *kind, const char *key, char *out, size_t cap) {
+    if (!kind || !key || !out || cap == 0) return -1;
+
+    char dir[512];
+    const char *xdg  = getenv("XDG_CACHE_HOME");
+    const char *home = getenv("HOME");
+    if (xdg && *xdg)        snprintf(dir, sizeof dir, "%s/scope-acquire", xdg);
+    else if (home && *home) snprintf(dir, sizeof dir, "%s/.cache/scope-acquire", home);
+    else return -2;
+
+    /* mkdir -p (parents of the leaf are expected to exist except .cache) */
+    char *slash = strrchr(dir, '/');
+    if (slash) {
+        *slash = '\0';
+        if (mkdir(dir, 0755) != 0 && errno != EEXIST) return -3;
+        *slash = '/';
+    }
+    if (mkdir(dir, 0755) != 0 && errno != EEXIST) return -3;
+
+    char safe[192];
+    size_t n = 0;
+    for (const char *p = key; *p && n + 1 < sizeof safe; ++p) {
+        safe[n++] = isalnum((unsigned char)*p) ? *p : '_';
+    }
+    safe[n] = '\0';
+
+    int w = snprintf(out, cap, "%s/%s_%s.conf", dir, kind, safe);
+    return (w > 0 && (size_t)w < cap) ? 0 : -4;
+}
+
+/* ---------- Trigger wait helpers ---------- */
+
+int scope_poll_until(Scope *s, int (*check)(Scope *s, bool *out), unsigned timeout_ms) {
+    if (!s || !check) return -1;
+
+    const uint64_t deadline = _now_us() + (uint64_t)timeout_ms * 1000u;
+    unsigned sleep_us = SCOPE_POLL_MIN_US;
+    for (;;) {
+        bool done = false;
+        if (check(s, &done) != 0) return -2;
+        if (done) return 0;
+
+        uint64_t now = _now_us();
+        if (now >= deadline) return 1;
+        if (now + sleep_us > deadline) sleep_us = (unsigned)(deadline - now);
+        usleep(sleep_us);
+
+        /* Back off: fast first polls for quick events, fewer round trips for slow ones */
+        sleep_us = (sleep_us >= SCOPE_POLL_MAX_US / 2) ? SCOPE_POLL_MAX_US : sleep_us * 2;
+    }
+}
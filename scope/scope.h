@@ -13,25 +13,65 @@ extern "C" {
 
 /* Forward-declare to avoid circular include with engine.h */
 typedef struct RunConfig RunConfig;
+struct PhaseStats;
 
 /* Default VISA timeout (ms) if caller leaves Scope.timeout_ms = 0 */
 #ifndef DEFAULT_VISA_TIMEOUT_MS
 #define DEFAULT_VISA_TIMEOUT_MS 2500u
 #endif
 
+/* scope_auto_open(): per-device *IDN? probe timeout and max concurrently probed resources */
+#ifndef SCOPE_PROBE_TIMEOUT_MS
+#define SCOPE_PROBE_TIMEOUT_MS 300u
+#endif
+#ifndef SCOPE_PROBE_MAX
+#define SCOPE_PROBE_MAX 32
+#endif
+
+/* Adaptive polling back-off bounds (us) used by scope_poll_until() */
+#ifndef SCOPE_POLL_MIN_US
+#define SCOPE_POLL_MIN_US 50u
+#endif
+#ifndef SCOPE_POLL_MAX_US
+#define SCOPE_POLL_MAX_US 2000u
+#endif
+
+/* Max configuration commands remembered for replay on reconnect */
+#ifndef SCOPE_JOURNAL_MAX
+#define SCOPE_JOURNAL_MAX 16
+#endif
+
 /* Forward declaration of Scope */
 typedef struct Scope Scope;
 
+/* Streaming readout target: drivers fill one chunk at a time (get_buf, read, commit)
+   instead of assembling the whole trace in dst. get_buf may block until a buffer frees up. */
+typedef struct ScopeChunkSink {
+    uint8_t *(*get_buf)(void *ctx, size_t len);          /* NULL => len too big / stopping */
+    int      (*commit) (void *ctx, uint8_t *buf, size_t len); /* 0 ok */
+    void     *ctx;
+} ScopeChunkSink;
+
 typedef struct {
     int (*init)(Scope *s, RunConfig *cfg);                              /* open VISA session and configure */
     void (*destroy)(Scope *s);                           /* close VISA session, cleanup and free memory */
     int (*arm)(Scope *s);
     int (*stop)(Scope *s);
     int (*force_trigger)(Scope *s);
-    int (*read_trace)(Scope *s, uint8_t *dst, const RunConfig *cfg); /* use cfg->n_samples, cfg->channels, cfg->n_channels */
+    int (*read_trace)(Scope *s, uint8_t *dst, const RunConfig *cfg); /* use cfg->n_samples, cfg->channels, cfg->n_channels; dst unused if s->stream */
     int (*check_if_armed)(Scope *s, bool *armed);
     int (*check_if_triggered)(Scope *s, bool *triggered);
+    int (*wait_for_trigger)(Scope *s, unsigned timeout_ms);              /* 0 triggered, 1 timeout, <0 err (optional; blocking poll) */
     int (*list_displayed_channels)(Scope *s, char ***out, uint8_t *out_n);
+    /* Segmented capture (optional, NULL if unsupported): record n_frames triggers per arm
+       cycle, then drain them into consecutive trace slots of dst */
+    int (*arm_record)(Scope *s, size_t n_frames);
+    int (*check_if_recorded)(Scope *s, bool *done);
+    int (*read_frames)(Scope *s, uint8_t *dst, size_t n_frames, const RunConfig *cfg);
+    /* Measure readout throughput over chunk/buffer sizes, apply + cache the best (optional) */
+    int (*calibrate_transfer)(Scope *s, const RunConfig *cfg, FILE *report);
+    /* Re-establish the link after a hard failure (optional; NULL => scope_reconnect) */
+    int (*reconnect)(Scope *s);
     int (*dump_log)(Scope *s, FILE *fp_log, const RunConfig *cfg);
 } ScopeDriver;
 
@@ -41,6 +81,17 @@ struct Scope {
     ViSession instr;          /* VISA Instrument session */
     char    *instr_name;      /* VISA resource string (may be set by auto-open) */
     unsigned timeout_ms;      /* I/O timeout (ms) */
+    size_t   read_chunk_pts;  /* points per :WAV:DATA? chunk (0 => driver default) */
+    unsigned read_buf_bytes;  /* VISA read buffer size applied on open (0 => VISA default) */
+    const ScopeChunkSink *stream; /* non-NULL => read_trace streams chunks here (set by engine) */
+    struct PhaseStats *stats; /* per-phase timing sink (set by engine; NULL => not recorded) */
+    void    *priv;            /* driver-private state (e.g. composite multi-scope) */
+    uint8_t *word_buf;        /* staging for scope_read_defblock_word() (freed by scope_close) */
+    size_t   word_cap;
+
+    /* Configuration journal: replayed by scope_reconnect() after reopening */
+    char    *journal[SCOPE_JOURNAL_MAX];
+    uint8_t  n_journal;
 
     const ScopeDriver *driver;/* bound driver vtable */
 };
@@ -51,12 +102,18 @@ struct Scope {
 int scope_open(Scope *s);
 
 /* Auto-detect and open a scope whose *IDN? contains idn_substr (if non-NULL).
+   Tries the resource cached for idn_substr first, then probes all candidates in parallel.
    On success, s->instr_name is set to a malloc'd copy of the matched resource. */
 int scope_auto_open(Scope *s, const char *idn_substr);
 
 /* Close instrument and RM sessions, free s->instr_name if set */
 int scope_close(Scope *s);
-int scope_reconnect(Scope *s); /* 0 ok */
+int scope_reconnect(Scope *s); /* 0 ok; reopens, pings, replays journal */
+
+/* Send a configuration command and journal it for replay on reconnect. A later command
+   with the same header (text before the first space) replaces the earlier entry. 0 ok */
+int  scope_config(Scope *s, const char *cmd);
+void scope_journal_clear(Scope *s); /* forget journal (call from destroy) */
 
 /* Binary-safe I/O */
 int scope_read(Scope *s, void *buf, size_t len, size_t *out_len, bool exact);
@@ -68,11 +125,37 @@ int scope_query   (Scope *s, const char *cmd, char *resp, size_t resp_cap);  /*
 
 int scope_query_u64(Scope *s, const char *cmd, size_t *out); /* 0 ok, -1 err */
 
+/* Send n queries as one ';'-joined compound message (one round trip) and split the
+   reply into fields[i] (pointers into resp). If the reply does not carry n answers,
+   falls back to one query each; fields of failed (or cut off) queries are NULL. A rejected header
+   costs the compound round trip plus n single queries, so only put headers every
+   supported instrument knows into one call.
+   0 compound ok, 1 fallback used, <0 err */
+int scope_query_multi(Scope *s, const char *const *cmds, size_t n, char *resp, size_t resp_cap, char **fields);
+
 int scope_ping(Scope *s); /* 0 ok, -1 no response */
 
 /* Read SCPI definite-length block (#<n><len><payload>) into dst */
 int scope_read_defblock(Scope *s, uint8_t *dst, size_t cap, size_t *out_len);/* 0 ok */
 
+/* Read a block of n_pts 16-bit little-endian points and keep only the low
+   (significant) byte of each: dst receives n_pts bytes, *out_pts the count. 0 ok */
+int scope_read_defblock_word(Scope *s, uint8_t *dst, size_t n_pts, size_t *out_pts);
+
+/* WORD -> BYTE narrowing kernel (SSE2/NEON, scalar tail). dst may alias src. */
+void scope_narrow_word(uint8_t *dst, const uint8_t *src, size_t n_pts);
+
+/* Resize the VISA read buffer (also stored in s->read_buf_bytes for reopen). 0 ok */
+int scope_set_read_buf(Scope *s, unsigned bytes);
+
+/* Per-user cache file path: $XDG_CACHE_HOME/scope-acquire/<kind>_<key>.conf
+   (falls back to $HOME/.cache). Non-alphanumerics in key become '_'. 0 ok */
+int scope_cache_path(const char *kind, const char *key, char *out, size_t cap);
+
+/* Poll check() with exponential back-off (SCOPE_POLL_MIN_US..SCOPE_POLL_MAX_US)
+   until it reports true. 0 true, 1 timeout, <0 err */
+int scope_poll_until(Scope *s, int (*check)(Scope *s, bool *out), unsigned timeout_ms);
+
 
 #ifdef __cplusplus
 }
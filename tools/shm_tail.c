@@ -0,0 +1,59 @@
+#define _GNU_SOURCE
+// shm_tail: minimal live reader of an engine --shm ring (example for engine/shmring.h).
+// Prints one line per record and a summary when the producer closes the ring.
+//
+//   ./build_tools/shm_tail <name> [--blocking] [--quiet]
+#include "engine/shmring.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+int main(int argc, char **argv) {
+    if (argc < 2) {
+        fprintf(stderr, "usage: %s <shm name> [--blocking] [--quiet]\n", argv[0]);
+        return 2;
+    }
+    bool blocking = false, quiet = false;
+    for (int i = 2; i < argc; ++i) {
+        if      (strcmp(argv[i], "--blocking") == 0) blocking = true;
+        else if (strcmp(argv[i], "--quiet") == 0)    quiet = true;
+    }
+
+    // The producer may not have created the ring yet
+    ShmRingConsumer c;
+    int rc;
+    for (int tries = 0; (rc = shmring_attach(&c, argv[1], blocking)) == -2 && tries < 100; ++tries) usleep(100000);
+    if (rc != 0) {
+        fprintf(stderr, "[shm_tail] cannot attach to %s (rc=%d)\n", argv[1], rc);
+        return 1;
+    }
+    fprintf(stderr, "[shm_tail] %s: %s, %llu B/trace (%u ch x %llu samples x %u B), %u slots x %llu B, %s\n",
+            argv[1], c.hdr->channels, (unsigned long long)c.hdr->bytes_per_trace, c.hdr->n_channels,
+            (unsigned long long)c.hdr->n_samples, c.hdr->bytes_per_sample, c.hdr->n_slots,
+            (unsigned long long)c.hdr->slot_bytes, blocking ? "blocking" : "lossy");
+
+    uint64_t records = 0, traces = 0, torn = 0;
+    ShmRingRecord rec;
+    while ((rc = shmring_next(&c, &rec, -1)) == 1) {
+        // Zero copy: rec.data points into the ring. Example work: mean of the first trace
+        uint64_t sum = 0;
+        const size_t n = (size_t)(c.hdr->n_samples * c.hdr->bytes_per_sample);
+        for (size_t i = 0; i < n && i < rec.bytes; ++i) sum += rec.data[i];
+        const double mean = n ? (double)sum / (double)n : 0.0;
+
+        if (shmring_release(&c, &rec) != 0) { torn++; continue; } // overwritten while reading
+        records++;
+        traces += rec.n_traces;
+        if (!quiet) {
+            printf("seq=%llu first_trace=%llu n_traces=%llu mean0=%.2f\n", (unsigned long long)rec.seq,
+                   (unsigned long long)rec.first_trace, (unsigned long long)rec.n_traces, mean);
+        }
+    }
+    fprintf(stderr, "[shm_tail] %s: %llu records, %llu traces, %llu lost, %llu torn\n",
+            (rc == -1) ? "producer closed the ring" : "error", (unsigned long long)records,
+            (unsigned long long)traces, (unsigned long long)c.lost, (unsigned long long)torn);
+    shmring_detach(&c);
+    return (rc == -1) ? 0 : 1;
+}
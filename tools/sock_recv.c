@@ -0,0 +1,118 @@
+#define _GNU_SOURCE
+// sock_recv: minimal receiver of an engine --sock stream (example for engine/socksink.h).
+// Listens on <addr>, accepts one engine connection, checks frame continuity, and prints
+// a summary when the stream ends. --out stores the payload (same bytes as the .bin),
+// --delay-us sleeps per frame to play a slow consumer (watch sock_blocked_ms in the .log).
+//
+//   ./build_tools/sock_recv <unix:/path | tcp:host:port> [--out <file>] [--delay-us <N>] [--quiet]
+#include "engine/socksink.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/socket.h>
+
+static double now_s(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (double)ts.tv_sec + (double)ts.tv_nsec / 1e9;
+}
+
+int main(int argc, char **argv) {
+    if (argc < 2) {
+        fprintf(stderr, "usage: %s <unix:/path | tcp:host:port> [--out <file>] [--delay-us <N>] [--quiet]\n", argv[0]);
+        return 2;
+    }
+    const char *out_path = NULL;
+    unsigned delay_us = 0;
+    bool quiet = false;
+    for (int i = 2; i < argc; ++i) {
+        if      (strcmp(argv[i], "--out") == 0 && i + 1 < argc)      out_path = argv[++i];
+        else if (strcmp(argv[i], "--delay-us") == 0 && i + 1 < argc) delay_us = (unsigned)strtoul(argv[++i], NULL, 10);
+        else if (strcmp(argv[i], "--quiet") == 0)                    quiet = true;
+    }
+
+    int lfd = socksink_listen(argv[1]);
+    if (lfd < 0) {
+        fprintf(stderr, "[sock_recv] cannot listen on %s (rc=%d)\n", argv[1], lfd);
+        return 1;
+    }
+    fprintf(stderr, "[sock_recv] listening on %s\n", argv[1]);
+    int fd = accept(lfd, NULL, NULL);
+    close(lfd);
+    if (fd < 0) return 1;
+
+    SockStreamHello hello;
+    if (socksink_read_full(fd, &hello, sizeof hello) != 1 || hello.magic != SOCKSTREAM_HELLO_MAGIC ||
+        hello.version != SOCKSTREAM_VERSION || hello.header_bytes != sizeof hello) {
+        fprintf(stderr, "[sock_recv] not an engine stream\n");
+        close(fd);
+        return 1;
+    }
+    hello.channels[sizeof hello.channels - 1] = '\0';
+    fprintf(stderr, "[sock_recv] %s, %llu B/trace (%u ch x %llu samples x %u B)\n", hello.channels,
+            (unsigned long long)hello.bytes_per_trace, hello.n_channels,
+            (unsigned long long)hello.n_samples, hello.bytes_per_sample);
+
+    FILE *out = out_path ? fopen(out_path, "wb") : NULL;
+    if (out_path && !out) {
+        perror(out_path);
+        close(fd);
+        return 1;
+    }
+
+    uint8_t *buf = NULL;
+    size_t cap = 0;
+    uint64_t frames = 0, traces = 0, bytes = 0, gaps = 0, expect = 0;
+    double t_first = 0.0, t_last = 0.0;
+    bool ended = false;
+    SockStreamFrame f;
+    while (socksink_read_full(fd, &f, sizeof f) == 1) {
+        if (f.magic != SOCKSTREAM_FRAME_MAGIC || f.header_bytes != sizeof f ||
+            f.payload_bytes != f.n_traces * hello.bytes_per_trace) {
+            fprintf(stderr, "[sock_recv] bad frame header after %llu frames\n", (unsigned long long)frames);
+            break;
+        }
+        if (f.n_traces == 0) { ended = true; break; }
+        if (f.payload_bytes > cap) {
+            uint8_t *nb = realloc(buf, f.payload_bytes);
+            if (!nb) break;
+            buf = nb;
+            cap = f.payload_bytes;
+        }
+        if (socksink_read_full(fd, buf, f.payload_bytes) != 1) break;
+        if (frames == 0) { t_first = now_s(); expect = f.first_trace; }
+        t_last = now_s();
+        if (f.first_trace != expect) gaps++;
+        expect = f.first_trace + f.n_traces;
+
+        // Example work: mean of the first trace's first channel
+        uint64_t sum = 0;
+        const size_t n = (size_t)(hello.n_samples * hello.bytes_per_sample);
+        for (size_t i = 0; i < n && i < f.payload_bytes; ++i) sum += buf[i];
+        if (!quiet) {
+            printf("seq=%llu first_trace=%llu n_traces=%llu mean0=%.2f\n", (unsigned long long)f.seq,
+                   (unsigned long long)f.first_trace, (unsigned long long)f.n_traces, n ? (double)sum / (double)n : 0.0);
+        }
+        if (out && fwrite(buf, 1, f.payload_bytes, out) != f.payload_bytes) {
+            perror(out_path);
+            break;
+        }
+        frames++;
+        traces += f.n_traces;
+        bytes  += f.payload_bytes;
+        if (delay_us) usleep(delay_us);
+    }
+
+    const double dt = t_last - t_first;
+    fprintf(stderr, "[sock_recv] %s: %llu frames, %llu traces, %.2f MiB (%.1f MiB/s), %llu gaps\n",
+            ended ? "end of stream" : "connection lost", (unsigned long long)frames,
+            (unsigned long long)traces, bytes / 1048576.0, (dt > 0.0) ? bytes / 1048576.0 / dt : 0.0,
+            (unsigned long long)gaps);
+    if (out) fclose(out);
+    free(buf);
+    close(fd);
+    return (ended && gaps == 0) ? 0 : 1;
+}